@@ -1,9 +1,39 @@
 #define _CRT_SECURE_NO_WARNINGS
+#ifdef __linux__
+#define _GNU_SOURCE         // memrchr, accept4, open_memstream
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <math.h>   // for roundf()
+#include <limits.h> // for INT_MAX
+#include <stdarg.h> // for cms_printf()
+#include <time.h>   // for SAVE STATUS / AUTOSAVE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>     // for _commit()
+#endif
+#ifdef __linux__
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
 
 // Predefined usernames and passwords for role-based login
 #define ADMIN_USERNAME "admin"
@@ -23,40 +53,635 @@
 #define PROG_MAX_LEN 128
 // Maximum length for each input line (file / user input)
 #define LINE_MAX_LEN 1024
+// Records per copy-on-write page of the table
+#define PAGE_ROWS 256
+#define MAX_PAGES ((MAX_STUDENTS + PAGE_ROWS - 1) / PAGE_ROWS)
 
 /* ---------- Data type ---------- */
+// The record schema, declared once. Each column is
+//   X(kind, field, tag, header, JSON key, alias, display width, array size)
+// and the kind decides its C type, validation, formatting and comparison:
+//   ID    7-digit student ID starting with 2 (int, unique key)
+//   TEXT  letters and spaces (char array of the given size)
+//   MARK  final mark 0-100, one decimal place (float)
+// The record struct, column lookup, WHERE kernels, sort comparators,
+// record comparison (WATCH, UNDO, DIFF), INSERT prompts and every row
+// formatter below are expanded from this list, so a column added here
+// reaches all of them. The text database
+// parser (ID first, mark last, name/programme split by spacing), the
+// UPDATE dialogs and the columnar encoding stay written for these four.
+#define STUDENT_COLUMNS(X) \
+    X(ID,   id,        ID,   "ID",        "id",        NULL,      10, 0)            \
+    X(TEXT, name,      NAME, "Name",      "name",      NULL,      20, NAME_MAX_LEN) \
+    X(TEXT, programme, PROG, "Programme", "programme", "PROGRAM", 25, PROG_MAX_LEN) \
+    X(MARK, mark,      MARK, "Mark",      "mark",      NULL,       6, 0)
+
+// C type of each kind
+#define COLUMN_DECL_ID(f, size)    int   f;
+#define COLUMN_DECL_TEXT(f, size)  char  f[size];
+#define COLUMN_DECL_MARK(f, size)  float f;
+#define COLUMN_DECL(kind, field, tag, head, key, alias, width, size) COLUMN_DECL_##kind(field, size)
+
 // Single student record
 typedef struct {
-    int   id;                        // 7-digit student ID starting with 2
-    char  name[NAME_MAX_LEN];        // Full name
-    char  programme[PROG_MAX_LEN];   // Programme name (e.g. "Digital SC")
-    float mark;                      // Final mark (0–100)
+    STUDENT_COLUMNS(COLUMN_DECL)
 } Student;
 
+// Column kinds as values (for code that looks a column up at run time)
+enum { KIND_ID, KIND_TEXT, KIND_MARK };
+
+// Column numbers, COL_<tag> for each schema column (WHERE, SORT BY)
+#define COLUMN_ENUM(kind, field, tag, head, key, alias, width, size) COL_##tag,
+enum { COL_NONE, STUDENT_COLUMNS(COLUMN_ENUM) COL_COUNT };
+
+// Name and kind of each column, indexed by COL_*
+typedef struct {
+    const char *head, *alias;
+    int         kind;
+} ColumnInfo;
+
+#define COLUMN_INFO(kind, field, tag, head, key, alias, width, size) { head, alias, KIND_##kind },
+const ColumnInfo g_columns[COL_COUNT] = { { NULL, NULL, 0 }, STUDENT_COLUMNS(COLUMN_INFO) };
+
+// Row formats, built at compile time by pasting one piece per column.
+// Each piece starts with its separator; callers skip the first one (+1).
+#define SHOW_HEAD_PIECE(kind, field, tag, head, key, alias, width, size) " %-" #width "s"
+#define SHOW_ROW_ID(w)    " %-" #w "d"
+#define SHOW_ROW_TEXT(w)  " %-" #w "s"
+#define SHOW_ROW_MARK(w)  " %-" #w ".1f"
+#define SHOW_ROW_PIECE(kind, field, tag, head, key, alias, width, size) SHOW_ROW_##kind(width)
+#define TSV_HEAD_PIECE(kind, field, tag, head, key, alias, width, size) "\t" head
+#define TSV_ROW_ID    "\t%d"
+#define TSV_ROW_TEXT  "\t%s"
+#define TSV_ROW_MARK  "\t%.1f"
+#define TSV_ROW_PIECE(kind, field, tag, head, key, alias, width, size) TSV_ROW_##kind
+
+// SHOW ALL table and tab-separated (database file) layouts
+#define SHOW_HEAD_FMT ((STUDENT_COLUMNS(SHOW_HEAD_PIECE) "\n") + 1)
+#define SHOW_ROW_FMT  ((STUDENT_COLUMNS(SHOW_ROW_PIECE) "\n") + 1)
+#define TSV_HEAD      ((STUDENT_COLUMNS(TSV_HEAD_PIECE) "\n") + 1)
+#define TSV_ROW_FMT   ((STUDENT_COLUMNS(TSV_ROW_PIECE) "\n") + 1)
+
+// Argument lists to go with them: ", s->id, s->name, ..." / ", "ID", ..."
+#define COLUMN_ARG(kind, field, tag, head, key, alias, width, size) , s->field
+#define COLUMN_HEAD(kind, field, tag, head, key, alias, width, size) , head
+
+// Per-column inequality of records a and b, as a bit 1 << COL_<tag>
+#define COLUMN_DIFFERS_ID(f)   (a->f != b->f)
+#define COLUMN_DIFFERS_TEXT(f) (strcmp(a->f, b->f) != 0)
+#define COLUMN_DIFFERS_MARK(f) (a->f != b->f)
+#define COLUMN_DIFFERS(kind, field, tag, head, key, alias, width, size) \
+    | (COLUMN_DIFFERS_##kind(field) ? 1u << COL_##tag : 0u)
+
+// The columns in which two records differ (0 = the same record)
+unsigned row_changes(const Student *a, const Student *b) {
+    return 0u STUDENT_COLUMNS(COLUMN_DIFFERS);
+}
+
+// Same record? (NULL = no row with that ID)
+int same_row(const Student *a, const Student *b) {
+    if (!a || !b) return a == b;
+    return row_changes(a, b) == 0;
+}
+
 /* ---------- UNDO FEATURE STRUCTURE ---------- */
 // One entry in the undo history (for INSERT/UPDATE/DELETE)
 typedef struct {
-    char op;          // 'I' (insert), 'U' (update), 'D' (delete)
+    char op;          // 'I' (insert), 'U' (update), 'D' (delete),
+                      // 'B' (bulk update), 'X' (bulk delete)
     Student before;   // State BEFORE modification
     Student after;    // State AFTER modification
+    int      nrows;   // Bulk operations: number of rows in 'rows'
+    Student *rows;    // Bulk operations: before-images (owned by the entry)
+    Student *afters;  // Bulk UPDATE: after-images, rows[i] -> afters[i] (owned)
 } UndoEntry;
 
-// Undo history stack and count
-UndoEntry g_undo[1000];
-int g_undo_count = 0;
+/* ---------- TABLE CONTEXT ---------- */
+// Text of the lines one OPEN parsed. Pages of that load point into it
+// until the name and programme of each of their rows are split out.
+typedef struct {
+    int             refs;    // pages using it (writer-owned)
+    pthread_mutex_t lock;    // one thread decodes a row at a time
+    char           *data;    // name + programme text of every row
+    size_t          len, cap;
+} LazyBuf;
+
+// Rows of a page whose name and programme are still only text in a
+// LazyBuf. Their ID and mark are parsed; the rest on first read.
+typedef struct LazyPage {
+    LazyBuf       *buf;
+    unsigned       off[PAGE_ROWS];    // text of row k: buf->data + off[k]
+    unsigned short len[PAGE_ROWS];
+    atomic_uchar   done[PAGE_ROWS];   // 0 = name and programme not set yet
+} LazyPage;
+
+// A fixed-size block of records. Versions share pages; a writer copies a
+// page only when it first changes a record on it (copy-on-write).
+typedef struct {
+    int       refs;                      // versions using this page (writer-owned)
+    LazyPage *lazy;                      // rows still to decode (NULL = none)
+    Student   rows[PAGE_ROWS];
+} RecordPage;
+
+// refs of a page inside a snapshot file's mapping. Such pages are never
+// written; references to them are counted on their SnapMap instead.
+#define PAGE_MAPPED (-1)
+
+// The pages of one loaded snapshot file: a read-only mapping (or, with
+// no mmap, one block read from the file), released with its last page
+typedef struct SnapMap {
+    char           *base;
+    size_t          len;
+    long            refs;      // references to its pages (writer-owned)
+    int             mapped;    // 1 = mmap, 0 = malloc
+    struct SnapMap *next;
+} SnapMap;
+
+// Snapshot blocks still referenced by some version (writers only)
+SnapMap *g_snap_maps;
+
+// Rows of one intake (partition) of a table version. The records stay in
+// the version's pages; a partition lists which rows belong to it.
+typedef struct {
+    int    key;              // first two digits of the IDs (25 = 25xxxxx)
+    int    count;
+    int   *rows;             // row indices in table order
+    int   *by_id;            // the same rows sorted by ID (partition index)
+    int    min_id, max_id;
+    double sum;              // sum of the marks
+    float  min_mark, max_mark;
+} Partition;
+
+// At most one partition per two-digit ID prefix
+#define MAX_PARTS 100
+
+// Partition directory of a published version (built on first read)
+typedef struct PartDir {
+    int         nparts;
+    signed char slot[MAX_PARTS];   // key -> index into parts (-1 = none)
+    Partition   parts[MAX_PARTS];  // ascending key
+    int        *storage;           // backs every rows / by_id array
+} PartDir;
+
+// One published state of the table (MVCC). Readers pin the current version
+// for the length of a command, or across commands with SNAPSHOT, and never
+// take a lock; a writer builds the next version and publishes it when its
+// command finishes. Unchanged pages are shared between versions.
+typedef struct TableVersion {
+    int      count;                      // number of records
+    char     filename[260];              // currently opened file ("" if none)
+    unsigned long number;                // version number (1, 2, ...)
+    atomic_int pins;                     // SNAPSHOTs holding this version
+    unsigned long retired_at;            // epoch at which it was replaced
+    struct TableVersion *next_retired;   // reclamation list link
+    RecordPage *pages[MAX_PAGES];        // the records, PAGE_ROWS per page
+    _Atomic(PartDir *) parts;            // intake partitions (NULL = not built)
+    _Atomic(struct RankIndex *) ranks;   // mark order statistics (NULL = not built)
+} TableVersion;
+
+// Maximum number of threads that can read the table at once
+#define MAX_READERS 256
+
+// The table: current version, writer lock, epoch-based reclamation state
+// and the undo history (which only writers touch)
+typedef struct {
+    _Atomic(TableVersion *) current;          // latest published version
+    pthread_mutex_t writer;                   // one writer at a time
+    atomic_ulong    epoch;                    // global epoch counter
+    atomic_ulong    reader_epoch[MAX_READERS];// per-reader pinned epoch (0 = idle)
+    atomic_int      nreaders;                 // reader slots handed out
+    TableVersion   *retired;                  // replaced versions not yet freed
+    UndoEntry       undo[1000];               // undo history stack
+    int             undo_count;
+} Table;
 
 /* ---------- Globals ---------- */
-// In-memory "database" of students
-Student g_students[MAX_STUDENTS];
-// Current number of loaded students
-int     g_count = 0;
-// Name of the currently opened file (empty if none)
-char    g_open_filename[260] = "";
-// Login role: 0 - student (read-only), 1 - admin (full access)
-int     g_is_admin = 0; // 0 - student, 1 - admin
+// The in-memory "database" of students
+Table g_table = { .writer = PTHREAD_MUTEX_INITIALIZER, .epoch = 1 };
+// Version the current command works on (pinned snapshot or writer's copy)
+_Thread_local TableVersion *t_tab = NULL;
+// Version held by this session's SNAPSHOT command (NULL = follow latest)
+_Thread_local TableVersion *t_snapshot = NULL;
+// This thread's reader slot in g_table.reader_epoch (-1 = none yet)
+_Thread_local int t_reader_slot = -1;
+// Set while this thread builds a new version (its rows may still change)
+_Thread_local int t_writing = 0;
+// Login role: 0 - student (read-only), 1 - admin (full access); per session
+_Thread_local int g_is_admin = 0; // 0 - student, 1 - admin
+
+/* ---------- Console I/O ---------- */
+// Every command prints through cms_printf and reads prompts through
+// cms_fgets. On the console these are stdout/stdin; in server mode each
+// command is pointed at its own connection's buffers instead.
+_Thread_local FILE *t_out = NULL;   // NULL = stdout
+_Thread_local FILE *t_in  = NULL;   // NULL = stdin
+
+// printf() to the current command's output stream
+int cms_printf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int r = vfprintf(t_out ? t_out : stdout, fmt, ap);
+    va_end(ap);
+    return r;
+}
+
+// fgets() from the current command's input stream (NULL at end of input)
+char *cms_fgets(char *buf, size_t size) {
+    FILE *in = t_in ? t_in : stdin;
+    if (!t_out) fflush(stdout);   // make sure the prompt is visible first
+    return fgets(buf, (int)size, in);
+}
+
+/* ---------- TABLE VERSIONS (MVCC, epoch-based reclamation) ---------- */
+// Claim a reader slot for this thread on first use
+int table_reader_slot(void) {
+    if (t_reader_slot < 0) {
+        int slot = atomic_fetch_add(&g_table.nreaders, 1);
+        if (slot >= MAX_READERS) {
+            fprintf(stderr, "CMS: Too many reader threads.\n");
+            abort();
+        }
+        t_reader_slot = slot;
+    }
+    return t_reader_slot;
+}
+
+// Create the first (empty) version; call once before any command runs
+void table_init(void) {
+    TableVersion *v = calloc(1, sizeof(TableVersion));
+    if (!v) {
+        fprintf(stderr, "CMS: Out of memory.\n");
+        exit(1);
+    }
+    v->number = 1;
+    atomic_store(&g_table.current, v);
+}
+
+void parse_record_text(const char *mid, int midlen, Student *out);
+
+// Split out the name and programme of row k of a page if OPEN left them
+// as text. Any reader may do it; each row is decoded once.
+void lazy_row_ready(RecordPage *pg, int k) {
+    LazyPage *lz = pg->lazy;
+    if (atomic_load_explicit(&lz->done[k], memory_order_acquire)) return;
+    pthread_mutex_lock(&lz->buf->lock);
+    if (!atomic_load_explicit(&lz->done[k], memory_order_relaxed)) {
+        parse_record_text(lz->buf->data + lz->off[k], lz->len[k], &pg->rows[k]);
+        atomic_store_explicit(&lz->done[k], 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&lz->buf->lock);
+}
+
+// Decode every row of a page still waiting for its text
+void lazy_page_ready(RecordPage *pg) {
+    if (!pg || !pg->lazy) return;
+    for (int k = 0; k < PAGE_ROWS; k++) lazy_row_ready(pg, k);
+}
+
+void lazy_page_free(LazyPage *lz) {
+    if (!lz) return;
+    if (--lz->buf->refs == 0) {
+        pthread_mutex_destroy(&lz->buf->lock);
+        free(lz->buf->data);
+        free(lz->buf);
+    }
+    free(lz);
+}
+
+// Decode a page this writer alone holds and make it a plain page
+void lazy_page_drop(RecordPage *pg) {
+    lazy_page_ready(pg);
+    lazy_page_free(pg->lazy);
+    pg->lazy = NULL;
+}
+
+// Snapshot block holding a mapped page
+SnapMap *snap_map_of(const RecordPage *pg) {
+    SnapMap *m = g_snap_maps;
+    while (m && !((const char *)pg >= m->base && (const char *)pg < m->base + m->len))
+        m = m->next;
+    return m;
+}
+
+// Unlink and release a snapshot block no page reference uses any more
+void snap_map_free(SnapMap *m) {
+    SnapMap **pp = &g_snap_maps;
+    while (*pp != m) pp = &(*pp)->next;
+    *pp = m->next;
+#ifndef _WIN32
+    if (m->mapped) munmap(m->base, m->len);
+    else
+#endif
+        free(m->base);
+    free(m);
+}
+
+// Add one reference to a page (writers only)
+void page_ref(RecordPage *pg) {
+    if (!pg) return;
+    if (pg->refs == PAGE_MAPPED) snap_map_of(pg)->refs++;
+    else pg->refs++;
+}
+
+// Drop one reference to a page, freeing it with the last (writers only)
+void page_release(RecordPage *pg) {
+    if (!pg) return;
+    if (pg->refs == PAGE_MAPPED) {
+        SnapMap *m = snap_map_of(pg);
+        if (--m->refs == 0) snap_map_free(m);
+    } else if (--pg->refs == 0) {
+        lazy_page_free(pg->lazy);
+        free(pg);
+    }
+}
+
+// Read-only access to record i of the version the command works on
+const Student *row_at(int i) {
+    RecordPage *pg = t_tab->pages[i / PAGE_ROWS];
+    if (pg->lazy) lazy_row_ready(pg, i % PAGE_ROWS);
+    return &pg->rows[i % PAGE_ROWS];
+}
+
+// Record i for reading its ID and mark only; its name and programme may
+// not be decoded yet
+const Student *row_key(int i) {
+    return &t_tab->pages[i / PAGE_ROWS]->rows[i % PAGE_ROWS];
+}
+
+// Page holding record i, writable (writers only). The page is copied
+// first if another version still shares it, so readers never see the
+// change. Rows it holds may still be waiting for their text.
+RecordPage *page_mut(int i) {
+    RecordPage **pp = &t_tab->pages[i / PAGE_ROWS];
+    if (!*pp || (*pp)->refs > 1 || (*pp)->refs == PAGE_MAPPED) {
+        RecordPage *np = malloc(sizeof(RecordPage));
+        if (!np) {
+            fprintf(stderr, "CMS: Out of memory.\n");
+            exit(1);
+        }
+        if (*pp) {
+            lazy_page_ready(*pp);
+            memcpy(np->rows, (*pp)->rows, sizeof(np->rows));
+            page_release(*pp);   // shared, so it is not freed
+        }
+        np->refs = 1;
+        np->lazy = NULL;
+        *pp = np;
+    }
+    return *pp;
+}
+
+// Writable access to record i (writers only)
+Student *row_mut(int i) {
+    RecordPage *pg = page_mut(i);
+    if (pg->lazy) lazy_page_drop(pg);
+    return &pg->rows[i % PAGE_ROWS];
+}
+
+// Pin a version for a read-only command (never blocks). A session with
+// an active SNAPSHOT keeps reading that version.
+void table_read_begin(void) {
+    int slot = table_reader_slot();
+    atomic_store(&g_table.reader_epoch[slot], atomic_load(&g_table.epoch));
+    t_tab = t_snapshot ? t_snapshot : atomic_load(&g_table.current);
+}
+
+// Unpin the version taken by table_read_begin
+void table_read_end(void) {
+    atomic_store(&g_table.reader_epoch[t_reader_slot], 0);
+    t_tab = NULL;
+}
+
+struct RankIndex *rank_index_next(const TableVersion *old, const TableVersion *nv);
+void rank_index_free(struct RankIndex *r);
+void cdc_record(char op, const Student *before, const Student *after, int undo);
+void cdc_commit(unsigned long version);
+void cdc_discard(void);
+void cdc_record_open(void);
+
+// Free a version and every page no other version uses (writer lock held)
+void table_free_version(TableVersion *v) {
+    rank_index_free(atomic_load(&v->ranks));
+    for (int p = 0; p < MAX_PAGES; p++) page_release(v->pages[p]);
+    PartDir *d = atomic_load(&v->parts);
+    if (d) {
+        free(d->storage);
+        free(d);
+    }
+    free(v);
+}
+
+// Free replaced versions that no reader or SNAPSHOT can still see
+void table_reclaim(void) {
+    unsigned long oldest = 0;   // oldest pinned epoch (0 = no readers)
+    int n = atomic_load(&g_table.nreaders);
+    if (n > MAX_READERS) n = MAX_READERS;
+    for (int i = 0; i < n; i++) {
+        unsigned long e = atomic_load(&g_table.reader_epoch[i]);
+        if (e && (!oldest || e < oldest)) oldest = e;
+    }
+
+    TableVersion **pp = &g_table.retired;
+    while (*pp) {
+        TableVersion *v = *pp;
+        if ((!oldest || v->retired_at < oldest) && atomic_load(&v->pins) == 0) {
+            *pp = v->next_retired;
+            table_free_version(v);
+        } else {
+            pp = &v->next_retired;
+        }
+    }
+}
+
+// Start a writing command: take the writer lock and start the next
+// version, sharing every page with the current one until it is changed.
+// Returns 0 if the new version cannot be allocated.
+int table_write_begin(void) {
+    pthread_mutex_lock(&g_table.writer);
+    TableVersion *cur = atomic_load(&g_table.current);
+    TableVersion *nv = malloc(sizeof(TableVersion));
+    if (!nv) {
+        pthread_mutex_unlock(&g_table.writer);
+        cms_printf("CMS: Out of memory.\n");
+        return 0;
+    }
+    nv->count = cur->count;
+    memcpy(nv->filename, cur->filename, sizeof(nv->filename));
+    nv->number = cur->number + 1;
+    atomic_init(&nv->pins, 0);
+    nv->retired_at = 0;
+    nv->next_retired = NULL;
+    atomic_init(&nv->parts, NULL);
+    atomic_init(&nv->ranks, NULL);
+    for (int p = 0; p < MAX_PAGES; p++) {
+        nv->pages[p] = cur->pages[p];
+        page_ref(nv->pages[p]);
+    }
+    t_tab = nv;
+    t_writing = 1;
+    return 1;
+}
+
+// Finish a writing command: publish the new version, retire the old one.
+// A rank index the old version has is carried over to the new one.
+void table_write_end(void) {
+    atomic_store(&t_tab->ranks, rank_index_next(atomic_load(&g_table.current), t_tab));
+    cdc_commit(t_tab->number);   // before the next writer can publish
+    TableVersion *old = atomic_exchange(&g_table.current, t_tab);
+    old->retired_at = atomic_fetch_add(&g_table.epoch, 1);
+    old->next_retired = g_table.retired;
+    g_table.retired = old;
+    table_reclaim();
+
+    t_tab = NULL;
+    t_writing = 0;
+    pthread_mutex_unlock(&g_table.writer);
+}
+
+// Abandon a writing command: drop the new version without publishing it
+void table_write_abort(void) {
+    cdc_discard();
+    table_free_version(t_tab);
+    t_tab = NULL;
+    t_writing = 0;
+    pthread_mutex_unlock(&g_table.writer);
+}
+
+/* ---------- PARALLEL TASKS ---------- */
+// A small pool of compute threads for work that splits into independent
+// tasks (intake partitions, chunks of a sort or of a scan). Idle threads
+// pull the next task from a shared counter, so a thread that finishes
+// early takes over work the others have not started. The calling thread
+// runs tasks too, and every task sees the caller's table version.
+#define PAR_MAX_THREADS 64
+
+// Threads per job, caller included (SET THREADS; 0 = one per online CPU)
+atomic_int g_par_threads = 0;
+
+typedef void (*ParTask)(void *arg, int task);
+
+// One job: tasks [0, ntasks) of fn(arg, task)
+typedef struct {
+    ParTask       fn;
+    void         *arg;
+    int           ntasks;
+    atomic_int    next;      // next task to hand out
+    int           pending;   // tasks not finished yet (pool lock)
+    int           users;     // workers inside this job (pool lock)
+    int           helpers;   // workers allowed to join
+    TableVersion *tab;       // the caller's t_tab
+} ParJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  work;      // a job was posted
+    pthread_cond_t  done;      // a job's last task finished
+    pthread_mutex_t busy;      // one job at a time; others run inline
+    int             nthreads;  // workers started so far
+    unsigned long   seq;       // job sequence number
+    ParJob         *job;       // current job (NULL = none)
+} ParPool;
+
+ParPool g_par = { .lock = PTHREAD_MUTEX_INITIALIZER, .work = PTHREAD_COND_INITIALIZER,
+                  .done = PTHREAD_COND_INITIALIZER, .busy = PTHREAD_MUTEX_INITIALIZER };
+
+// Run tasks of a job until none are left
+void par_drain(ParJob *j) {
+    int t;
+    while ((t = atomic_fetch_add(&j->next, 1)) < j->ntasks) {
+        j->fn(j->arg, t);
+        pthread_mutex_lock(&g_par.lock);
+        if (--j->pending == 0) pthread_cond_broadcast(&g_par.done);
+        pthread_mutex_unlock(&g_par.lock);
+    }
+}
+
+// Compute thread: help with each posted job
+void *par_worker(void *arg) {
+    (void)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&g_par.lock);
+    for (;;) {
+        while (!g_par.job || g_par.seq == seen) pthread_cond_wait(&g_par.work, &g_par.lock);
+        seen = g_par.seq;
+        ParJob *j = g_par.job;
+        if (j->users >= j->helpers) continue;   // fewer threads requested
+        j->users++;
+        pthread_mutex_unlock(&g_par.lock);
+
+        t_tab = j->tab;
+        par_drain(j);
+        t_tab = NULL;
+
+        pthread_mutex_lock(&g_par.lock);
+        if (--j->users == 0 && j->pending == 0) pthread_cond_broadcast(&g_par.done);
+    }
+    return NULL;
+}
+
+// Threads a job may use, the caller included
+int par_width(void) {
+    int n = atomic_load(&g_par_threads);
+    if (n <= 0) {
+#ifdef _WIN32
+        n = 1;
+#else
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n = ncpu < 1 ? 1 : ncpu > PAR_MAX_THREADS ? PAR_MAX_THREADS : (int)ncpu;
+#endif
+    }
+    return n;
+}
+
+// Start workers until there are at least n (pool busy lock held)
+void par_grow(int n) {
+    while (g_par.nthreads < n) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, par_worker, NULL) != 0) break;
+        pthread_detach(th);
+        g_par.nthreads++;
+    }
+}
+
+// Run fn(arg, 0..ntasks-1), spread over the pool when parallel is set.
+// Returns when every task has finished. If another job is using the pool
+// (e.g. another server session), the tasks run on this thread instead.
+void par_run(int ntasks, ParTask fn, void *arg, int parallel) {
+    if (!parallel || ntasks < 2 || pthread_mutex_trylock(&g_par.busy) != 0) {
+        for (int t = 0; t < ntasks; t++) fn(arg, t);
+        return;
+    }
+    int helpers = par_width() - 1;
+    par_grow(helpers);
+    if (helpers > g_par.nthreads) helpers = g_par.nthreads;
+    if (helpers == 0) {
+        pthread_mutex_unlock(&g_par.busy);
+        for (int t = 0; t < ntasks; t++) fn(arg, t);
+        return;
+    }
+
+    ParJob j = { .fn = fn, .arg = arg, .ntasks = ntasks, .pending = ntasks,
+                 .helpers = helpers, .tab = t_tab };
+    atomic_init(&j.next, 0);
+    pthread_mutex_lock(&g_par.lock);
+    g_par.job = &j;
+    g_par.seq++;
+    pthread_cond_broadcast(&g_par.work);
+    pthread_mutex_unlock(&g_par.lock);
+
+    par_drain(&j);
+
+    pthread_mutex_lock(&g_par.lock);
+    while (j.pending > 0 || j.users > 0) pthread_cond_wait(&g_par.done, &g_par.lock);
+    g_par.job = NULL;
+    pthread_mutex_unlock(&g_par.lock);
+    pthread_mutex_unlock(&g_par.busy);
+}
 
 /* ---------- Helper functions ---------- */
 int equals_ic(const char *a, const char *b);
+PartDir *part_dir(void);
+int part_lookup(const PartDir *d, int id);
 
 
 // Check if the user wants to quit current operation (by typing QUIT)
@@ -87,10 +712,12 @@ int equals_ic(const char *a, const char *b) {
     }
     return *a == '\0' && *b == '\0';
 }
-// Find index of a student in g_students by ID (returns -1 if not found)
+// Find index of a student in the table by ID (returns -1 if not found)
 int find_index_by_id(int id) {
-    for (int i = 0; i < g_count; ++i)
-        if (g_students[i].id == id) return i;
+    PartDir *d = part_dir();
+    if (d) return part_lookup(d, id);
+    for (int i = 0; i < t_tab->count; ++i)
+        if (row_key(i)->id == id) return i;
     return -1;
 }
 
@@ -101,52 +728,52 @@ int login() {
     int attempts = 5;  // Max attempts: 5 total attempts (for password only)
 
     while (attempts > 0) {
-        printf("Enter username: ");
-        fgets(username, sizeof(username), stdin);
+        cms_printf("Enter username: ");
+        if (!cms_fgets(username, sizeof(username))) return 0;  // end of input
         rstrip(username);
 
         // Check for invalid username (we only allow admin/student)
         if (!equals_ic(username, ADMIN_USERNAME) && !equals_ic(username, STUDENT_USERNAME)) {
-            printf("Invalid username. Please enter a valid username.\n");
+            cms_printf("Invalid username. Please enter a valid username.\n");
             // Username error does NOT consume an attempt
             continue; // Skip password check and allow retry without decrementing attempts
         }
 
         // Admin login flow
         if (equals_ic(username, ADMIN_USERNAME)) {
-            printf("Enter password: ");
-            fgets(password, sizeof(password), stdin);
+            cms_printf("Enter password: ");
+            if (!cms_fgets(password, sizeof(password))) return 0;
             rstrip(password);
 
             if (equals_ic(password, ADMIN_PASSWORD)) {
                 g_is_admin = 1;  // Admin login
                 return 1;        // Success
             } else {
-                printf("Invalid admin password. Try again.\n");
+                cms_printf("Invalid admin password. Try again.\n");
             }
         }
 
         // Student login flow
         else if (equals_ic(username, STUDENT_USERNAME)) {
-            printf("Enter password: ");
-            fgets(password, sizeof(password), stdin);
+            cms_printf("Enter password: ");
+            if (!cms_fgets(password, sizeof(password))) return 0;
             rstrip(password);
 
             if (equals_ic(password, STUDENT_PASSWORD)) {
                 g_is_admin = 0;  // Student login
                 return 1;        // Success
             } else {
-                printf("Invalid student password. Try again.\n");
+                cms_printf("Invalid student password. Try again.\n");
             }
         }      
 
         // If password is invalid, decrease the attempts
-        printf("You have %d attempt(s) left.\n", attempts - 1);
+        cms_printf("You have %d attempt(s) left.\n", attempts - 1);
         attempts--;  // Decrease the remaining attempts
 
         // Exit after 0 attempts left with a more professional message
         if (attempts == 0) {
-            printf("Maximum login attempts reached. Access to the system has been temporarily locked. Please try again later or contact support.\n");
+            cms_printf("Maximum login attempts reached. Access to the system has been temporarily locked. Please try again later or contact support.\n");
             return 0;  // Exit the program after exceeding max attempts
         }
     }
@@ -157,1256 +784,8141 @@ int login() {
 /* ---------- UNDO helper ---------- */
 // Store one undo action into the undo stack
 void push_undo(char op, Student before, Student after) {
-    if (g_undo_count >= 1000) return; // prevent overflow of undo array
-    g_undo[g_undo_count].op = op;
-    g_undo[g_undo_count].before = before;
-    g_undo[g_undo_count].after = after;
-    g_undo_count++;
-}
-
-/* ---------- Sorting (Bubble Sort) ---------- */
-// Sort array by student ID using bubble sort (asc=1 ascending, asc=0 descending)
-void sort_by_id(int asc){
-    for(int i=0;i<g_count-1;i++){
-        for(int j=0;j<g_count-1-i;j++){
-            int cond = asc ? (g_students[j].id > g_students[j+1].id)
-                           : (g_students[j].id < g_students[j+1].id);
-            if(cond){
-                Student t = g_students[j];
-                g_students[j] = g_students[j+1];
-                g_students[j+1] = t;
-            }
-        }
-    }
-}
-// Sort array by mark using bubble sort (asc=1 ascending, asc=0 descending)
-void sort_by_mark(int asc){
-    for(int i=0;i<g_count-1;i++){
-        for(int j=0;j<g_count-1-i;j++){
-            int cond = asc ? (g_students[j].mark > g_students[j+1].mark)
-                           : (g_students[j].mark < g_students[j+1].mark);
-            if(cond){
-                Student t = g_students[j];
-                g_students[j] = g_students[j+1];
-                g_students[j+1] = t;
-            }
-        }
-    }
+    cdc_record(op, op == 'I' ? NULL : &before, op == 'D' ? NULL : &after, 0);
+    if (g_table.undo_count >= 1000) return; // prevent overflow of undo array
+    g_table.undo[g_table.undo_count].op = op;
+    g_table.undo[g_table.undo_count].before = before;
+    g_table.undo[g_table.undo_count].after = after;
+    g_table.undo[g_table.undo_count].nrows = 0;
+    g_table.undo[g_table.undo_count].rows = NULL;
+    g_table.undo[g_table.undo_count].afters = NULL;
+    g_table.undo_count++;
 }
 
-// Parse the "SORT BY ..." part after SHOW ALL and call the correct sort function
-void handle_sort(const char *args){
-    if(!args || !*args) return;
-
-    char buf[128];
-    strncpy(buf, args, sizeof(buf)-1);
-    buf[sizeof(buf)-1] = '\0';
-    trim(buf);
+// Store one grouped undo action for a bulk UPDATE/DELETE.
+// Takes ownership of 'rows' (the before-images of every affected record)
+// and, for a bulk UPDATE, 'afters' (what each of them became; NULL for
+// DELETE). A bulk UPDATE records its row changes itself.
+void push_undo_bulk(char op, Student *rows, Student *afters, int nrows) {
+    if (op == 'X')
+        for (int i = 0; i < nrows; i++) cdc_record('D', &rows[i], NULL, 0);
+    if (g_table.undo_count >= 1000) { free(rows); free(afters); return; }
+    memset(&g_table.undo[g_table.undo_count], 0, sizeof(UndoEntry));
+    g_table.undo[g_table.undo_count].op = op;
+    g_table.undo[g_table.undo_count].nrows = nrows;
+    g_table.undo[g_table.undo_count].rows = rows;
+    g_table.undo[g_table.undo_count].afters = afters;
+    g_table.undo_count++;
+}
 
-    // Expect tokens like: SORT BY ID ASC
-    char *tok1 = strtok(buf, " \t");
-    char *tok2 = strtok(NULL, " \t");
-    char *tok3 = strtok(NULL, " \t");
-    char *tok4 = strtok(NULL, " \t");
+/* ---------- Sorting (table order) ---------- */
+void sort_selection_par(int *sel, int n, int field, int asc);
+
+// Reorder the table itself by a sort column (COL_*, not text). The sort is
+// stable, so rows with equal keys keep their relative order.
+void sort_table(int field, int asc){
+    int n = t_tab->count;
+    int *sel = malloc((size_t)n * sizeof(int));
+    Student *rows = malloc((size_t)n * sizeof(Student));
+    if(!sel || !rows){
+        cms_printf("CMS: Out of memory.\n");
+        free(sel);
+        free(rows);
+        return;
+    }
+    for(int i=0;i<n;i++) sel[i]=i;
+    sort_selection_par(sel, n, field, asc);
+    for(int i=0;i<n;i++) rows[i] = *row_at(sel[i]);
+    for(int i=0;i<n;i++)
+        if(sel[i]!=i) *row_mut(i) = rows[i];   // unmoved pages stay shared
+    free(sel);
+    free(rows);
+}
 
-    int field = 0;   // 1=id, 2=mark
-    int asc   = 1;   // default ASC
+/* ---------- WHERE filter engine ---------- */
+// Comparison operators
+#define CMP_EQ     0
+#define CMP_NE     1
+#define CMP_LT     2
+#define CMP_LE     3
+#define CMP_GT     4
+#define CMP_GE     5
+#define CMP_STARTS 6
+
+// Bytecode instructions (postfix order)
+#define PI_CMP 0   // push result of one comparison
+#define PI_AND 1   // pop two, push AND
+#define PI_OR  2   // pop two, push OR
+#define PI_NOT 3   // negate top
+
+// Limits for one clause
+#define MAX_TOKENS      64
+#define PRED_MAX_NODES  64
+#define PRED_MAX_DEPTH  16
+// Rows evaluated per batch (one record page; one mask per stack slot)
+#define FILTER_BATCH    PAGE_ROWS
+
+// Token kinds produced by tokenize_clause
+#define TK_END   0
+#define TK_WORD  1   // keyword / column name / bare text
+#define TK_NUM   2   // 70, 70.5
+#define TK_STR   3   // "Digital Supply Chain"
+#define TK_OP    4   // = != <> < <= > >=
+#define TK_PUNCT 5   // ( ) , + - * /
 
-    if(tok1 && equals_ic(tok1, "SORT") &&
-       tok2 && equals_ic(tok2, "BY") &&
-       tok3)
-    {
-        if(equals_ic(tok3,"ID"))   field=1;
-        if(equals_ic(tok3,"MARK")) field=2;
+typedef struct {
+    int  kind;
+    char text[PROG_MAX_LEN];
+} Token;
+
+// One node of the predicate AST
+typedef struct PredNode {
+    int op;                  // PI_CMP, PI_AND, PI_OR, PI_NOT
+    int col, cmp;            // for PI_CMP
+    const Token *lit;        // literal token for PI_CMP
+    struct PredNode *l, *r;  // children (NOT uses l only)
+} PredNode;
+
+// One compiled instruction
+typedef struct {
+    unsigned char op;         // PI_*
+    unsigned char col;        // COL_*
+    unsigned char cmp;        // CMP_*
+    int   ival;               // ID literal, or ID prefix for STARTS
+    int   ilim;               // 10^digits of the ID prefix (STARTS only)
+    float fval;               // mark literal
+    char  sval[PROG_MAX_LEN]; // text literal
+} PredInsn;
+
+// Compiled WHERE clause plus the requested ordering
+typedef struct {
+    PredInsn code[PRED_MAX_NODES];
+    int      len;         // 0 = no WHERE clause (every row matches)
+    int      sort_field;  // 0 none, else COL_ID or COL_MARK
+    int      sort_asc;
+} Filter;
 
-        if(tok4){
-            if(equals_ic(tok4,"DESC")) asc=0;
-            else asc=1;
+// Recursive-descent parser state
+typedef struct {
+    const Token *t;
+    int pos, n;
+    PredNode nodes[PRED_MAX_NODES];
+    int nn;
+} PredParser;
+
+// Split a clause into tokens; returns token count, or -1 on bad input
+int tokenize_clause(const char *s, Token *toks, int max) {
+    int n = 0;
+    while (*s) {
+        if (isspace((unsigned char)*s)) { s++; continue; }
+        if (n >= max - 1) return -1;
+
+        Token *t = &toks[n];
+        size_t k = 0;
+        if (*s == '"' || *s == '\'') {
+            char q = *s++;
+            while (*s && *s != q && k < sizeof(t->text) - 1) t->text[k++] = *s++;
+            if (*s != q) return -1;          // unterminated string
+            s++;
+            t->kind = TK_STR;
+        } else if (isdigit((unsigned char)*s)) {
+            while ((isdigit((unsigned char)*s) || *s == '.') && k < sizeof(t->text) - 1)
+                t->text[k++] = *s++;
+            t->kind = TK_NUM;
+        } else if (isalpha((unsigned char)*s) || *s == '_') {
+            while ((isalnum((unsigned char)*s) || *s == '_') && k < sizeof(t->text) - 1)
+                t->text[k++] = *s++;
+            t->kind = TK_WORD;
+        } else if (strchr("=!<>", *s)) {
+            t->text[k++] = *s++;
+            if (*s == '=' || (t->text[0] == '<' && *s == '>')) t->text[k++] = *s++;
+            if (equals_ic(t->text, "!")) return -1;
+            t->kind = TK_OP;
+        } else if (strchr("(),+-*/", *s)) {
+            t->text[k++] = *s++;
+            t->kind = TK_PUNCT;
+        } else {
+            return -1;
         }
+        t->text[k] = '\0';
+        n++;
     }
-
-    if(field==1) sort_by_id(asc);
-    else if(field==2) sort_by_mark(asc);
+    toks[n].kind = TK_END;
+    toks[n].text[0] = '\0';
+    return n;
 }
 
-/* ---------- load_from_file (robust parsing) ---------- */
-// Load student records from text file into g_students
-int load_from_file(const char *filename){
-    FILE *fp = fopen(filename, "r");
-    if(!fp) return 0;
-
-    g_count = 0;
-    char line[LINE_MAX_LEN];
-    int table_started = 0;   // 0 until we see the header row
+// Map a column name to COL_* (0 if unknown)
+int column_from_name(const char *s) {
+    for (int c = 1; c < COL_COUNT; c++)
+        if (equals_ic(s, g_columns[c].head) || (g_columns[c].alias && equals_ic(s, g_columns[c].alias)))
+            return c;
+    return 0;
+}
 
-    while(fgets(line, sizeof(line), fp)){
-        rstrip(line);
+PredNode *parse_or(PredParser *p);
 
-        char raw[LINE_MAX_LEN];
-        strncpy(raw, line, sizeof(raw)-1);
-        raw[sizeof(raw)-1] = 0;
-        trim(raw);
-
-        if(raw[0]=='\0') continue;  // skip empty lines
-
-        /* Detect header row: look for "ID" and "MARK" */
-        if(!table_started){
-            char up[LINE_MAX_LEN];
-            strncpy(up, raw, sizeof(up)-1);
-            up[sizeof(up)-1] = 0;
-            for(char *u=up; *u; ++u) *u = toupper((unsigned char)*u);
-            if(strstr(up,"ID") && strstr(up,"MARK")){
-                table_started = 1;
-            }
-            continue;
-        }
+// Allocate one AST node from the parser's pool
+PredNode *pred_node(PredParser *p, int op) {
+    if (p->nn >= PRED_MAX_NODES) return NULL;
+    PredNode *nd = &p->nodes[p->nn++];
+    memset(nd, 0, sizeof(*nd));
+    nd->op = op;
+    return nd;
+}
 
-        // Data rows must start with a digit (student ID)
-        if(!isdigit((unsigned char)raw[0])) continue;
-
-        /* ----- Parse ID ----- */
-        int len = strlen(raw);
-        int i=0;
-        // Skip leading spaces
-        while(i<len && isspace((unsigned char)raw[i])) i++;
-        int id_start=i;
-        // Read digits for ID
-        while(i<len && isdigit((unsigned char)raw[i])) i++;
-        int id_end=i;
-
-        char idbuf[16];
-        int idlen=id_end-id_start;
-        if(idlen>=15) idlen=15;
-        memcpy(idbuf, raw+id_start, idlen);
-        idbuf[idlen]='\0';
-        int id = atoi(idbuf);
-
-        // Mid section begins after ID (where name+programme sit)
-        while(i<len && isspace((unsigned char)raw[i])) i++;
-        int mid_start=i;
-
-        /* ----- Parse mark from right ----- */
-        int j=len-1;
-        // Move left, skipping spaces
-        while(j>=0 && isspace((unsigned char)raw[j])) j--;
-        int mark_end=j+1;
-
-        int mark_start=j;
-        // Move left until we go past digits and optional decimal point
-        while(mark_start>=0 &&
-              (isdigit((unsigned char)raw[mark_start]) || raw[mark_start]=='.'))
-            mark_start--;
-        mark_start++;
-
-        char markbuf[16];
-        int marklen = mark_end - mark_start;
-        if(marklen>=15) marklen=15;
-        memcpy(markbuf, raw+mark_start, marklen);
-        markbuf[marklen]='\0';
-        float mark = atof(markbuf);  // convert substring to float
-
-        /* ----- Middle (Name + Programme) ----- */
-        int mid_end = mark_start;
-        char middle[LINE_MAX_LEN];
-        int midlen = mid_end-mid_start;
-        if(midlen>=LINE_MAX_LEN) midlen=LINE_MAX_LEN-1;
-        memcpy(middle, raw+mid_start, midlen);
-        middle[midlen]='\0';
-        trim(middle);
-
-        char name[NAME_MAX_LEN]="";
-        char prog[PROG_MAX_LEN]="";
-
-        /* Look for 2+ spaces as separator between name and programme */
-        int sep=-1;
-        for(int k=0; middle[k] && middle[k+1]; ++k){
-            if(middle[k]==' ' && middle[k+1]==' '){
-                sep=k;
-                break;
-            }
-        }
+// comparison := column op literal
+PredNode *parse_compare(PredParser *p) {
+    const Token *c = &p->t[p->pos];
+    int col = c->kind == TK_WORD ? column_from_name(c->text) : 0;
+    if (!col) return NULL;
+    p->pos++;
+
+    const Token *o = &p->t[p->pos];
+    int cmp;
+    if (o->kind == TK_OP) {
+        if (equals_ic(o->text, "=") || equals_ic(o->text, "==")) cmp = CMP_EQ;
+        else if (equals_ic(o->text, "!=") || equals_ic(o->text, "<>")) cmp = CMP_NE;
+        else if (equals_ic(o->text, "<")) cmp = CMP_LT;
+        else if (equals_ic(o->text, "<=")) cmp = CMP_LE;
+        else if (equals_ic(o->text, ">")) cmp = CMP_GT;
+        else cmp = CMP_GE;
+    } else if (o->kind == TK_WORD && equals_ic(o->text, "STARTS")) {
+        cmp = CMP_STARTS;
+    } else {
+        return NULL;
+    }
+    p->pos++;
 
-        if(sep>=0){
-            // Split on the first "double space" region
-            int nlen=sep;
-            while(nlen>0 && isspace((unsigned char)middle[nlen-1])) nlen--;
-            memcpy(name, middle, nlen);
-            name[nlen]='\0';
+    const Token *v = &p->t[p->pos];
+    if (g_columns[col].kind != KIND_TEXT) {
+        // Numeric columns need a number (an ID prefix may also be quoted)
+        if (v->kind != TK_NUM && !(cmp == CMP_STARTS && v->kind == TK_STR)) return NULL;
+        if (cmp == CMP_STARTS && g_columns[col].kind != KIND_ID) return NULL;
+    } else {
+        // Text columns support =, != and STARTS only
+        if (v->kind != TK_STR && v->kind != TK_WORD && v->kind != TK_NUM) return NULL;
+        if (cmp != CMP_EQ && cmp != CMP_NE && cmp != CMP_STARTS) return NULL;
+    }
+    p->pos++;
+
+    PredNode *nd = pred_node(p, PI_CMP);
+    if (!nd) return NULL;
+    nd->col = col;
+    nd->cmp = cmp;
+    nd->lit = v;
+    return nd;
+}
 
-            int pstart=sep;
-            while(middle[pstart] && isspace((unsigned char)middle[pstart])) pstart++;
-            strncpy(prog, middle+pstart, PROG_MAX_LEN-1);
-            prog[PROG_MAX_LEN-1] = '\0';
-        } else {
-            /* Fallback: assume first two words = name, rest = programme */
-            char tmp[LINE_MAX_LEN];
-            strncpy(tmp, middle, sizeof(tmp)-1);
-            tmp[sizeof(tmp)-1] = 0;
+// unary := NOT unary | '(' or ')' | comparison
+PredNode *parse_unary(PredParser *p) {
+    const Token *t = &p->t[p->pos];
+    if (t->kind == TK_WORD && equals_ic(t->text, "NOT")) {
+        p->pos++;
+        PredNode *inner = parse_unary(p);
+        if (!inner) return NULL;
+        PredNode *nd = pred_node(p, PI_NOT);
+        if (!nd) return NULL;
+        nd->l = inner;
+        return nd;
+    }
+    if (t->kind == TK_PUNCT && t->text[0] == '(') {
+        p->pos++;
+        PredNode *inner = parse_or(p);
+        if (!inner || p->t[p->pos].kind != TK_PUNCT || p->t[p->pos].text[0] != ')') return NULL;
+        p->pos++;
+        return inner;
+    }
+    return parse_compare(p);
+}
 
-            char *p=tmp;
-            while(*p && isspace((unsigned char)*p)) p++;
-            char *w1=p;                         // first word of name
-            while(*p && !isspace((unsigned char)*p)) p++;
-            if(*p) *p++='\0';
+// Parse "lhs (KEYWORD rhs)*" for AND / OR
+PredNode *parse_chain(PredParser *p, const char *kw, int op, PredNode *(*sub)(PredParser *)) {
+    PredNode *lhs = sub(p);
+    while (lhs && p->t[p->pos].kind == TK_WORD && equals_ic(p->t[p->pos].text, kw)) {
+        p->pos++;
+        PredNode *rhs = sub(p);
+        PredNode *nd = rhs ? pred_node(p, op) : NULL;
+        if (!nd) return NULL;
+        nd->l = lhs;
+        nd->r = rhs;
+        lhs = nd;
+    }
+    return lhs;
+}
 
-            while(*p && isspace((unsigned char)*p)) p++;
-            char *w2=p;                         // second word of name
-            while(*p && !isspace((unsigned char)*p)) p++;
-            if(*p) *p++='\0';
+PredNode *parse_and(PredParser *p) { return parse_chain(p, "AND", PI_AND, parse_unary); }
+PredNode *parse_or(PredParser *p)  { return parse_chain(p, "OR", PI_OR, parse_and); }
 
-            snprintf(name, sizeof(name), "%s %s", w1, w2);
+// Flatten the AST into postfix bytecode; returns max stack depth or -1
+int compile_pred(const PredNode *nd, Filter *f, int depth) {
+    if (!nd) return -1;
+    int d1 = depth, d2 = depth;
 
-            // Remaining string treated as programme
-            while(*p && isspace((unsigned char)*p)) p++;
-            strncpy(prog, p, PROG_MAX_LEN-1);
-            prog[PROG_MAX_LEN-1]='\0';
+    if (nd->op == PI_CMP) {
+        d1 = depth + 1;
+    } else {
+        d1 = compile_pred(nd->l, f, depth);
+        if (d1 < 0) return -1;
+        if (nd->op != PI_NOT) {
+            d2 = compile_pred(nd->r, f, depth + 1);
+            if (d2 < 0) return -1;
         }
-
-        trim(name);
-        trim(prog);
-
-        // Only store if we still have space in the array
-        if(g_count < MAX_STUDENTS){
-            Student s;
-            s.id=id;
-            strncpy(s.name,name,NAME_MAX_LEN-1);
-            s.name[NAME_MAX_LEN-1]=0;
-            strncpy(s.programme,prog,PROG_MAX_LEN-1);
-            s.programme[PROG_MAX_LEN-1]=0;
-            s.mark=mark;
-            g_students[g_count++] = s;
+    }
+    if (f->len >= PRED_MAX_NODES) return -1;
+
+    PredInsn *in = &f->code[f->len++];
+    memset(in, 0, sizeof(*in));
+    in->op = (unsigned char)nd->op;
+    if (nd->op == PI_CMP) {
+        in->col = (unsigned char)nd->col;
+        in->cmp = (unsigned char)nd->cmp;
+        memcpy(in->sval, nd->lit->text, sizeof(in->sval));
+        in->ival = atoi(nd->lit->text);
+        in->fval = strtof(nd->lit->text, NULL);
+        if (g_columns[nd->col].kind == KIND_ID && nd->cmp == CMP_STARTS) {
+            if (in->sval[0] == '\0' || strspn(in->sval, "0123456789") != strlen(in->sval) ||
+                strlen(in->sval) > 9) return -1;
+            in->ilim = 1;
+            for (size_t k = 0; k < strlen(in->sval); k++) in->ilim *= 10;
         }
     }
+    return d1 > d2 ? d1 : d2;
+}
 
-    fclose(fp);
+// Parse a WHERE expression starting at toks[*pos] into f; returns 1 on success
+int parse_where(const Token *toks, int ntok, int *pos, Filter *f) {
+    PredParser p;
+    p.t = toks;
+    p.n = ntok;
+    p.pos = *pos;
+    p.nn = 0;
+
+    f->len = 0;
+    PredNode *root = parse_or(&p);
+    int depth = root ? compile_pred(root, f, 0) : -1;
+    *pos = p.pos;   // on failure this points at the offending token
+    if (depth < 0 || depth > PRED_MAX_DEPTH) {
+        f->len = 0;
+        return 0;
+    }
     return 1;
 }
 
-/* ---------- SAVE ---------- */
-// Write all current in-memory records into the given file
-int save_to_file(const char *filename){
-    FILE *fp = fopen(filename,"w");
-    if(!fp) return 0;
+// Case-insensitive prefix test
+int starts_with_ic(const char *s, const char *prefix) {
+    while (*prefix) {
+        if (toupper((unsigned char)*s) != toupper((unsigned char)*prefix)) return 0;
+        s++; prefix++;
+    }
+    return 1;
+}
 
-    fprintf(fp,"Database Name: StudentRecords\nAuthors: Team\n\n");
-    fprintf(fp,"Table Name: StudentRecords\n");
-    fprintf(fp,"ID\tName\tProgramme\tMark\n");
+// Comparison kernels, one loop per operator, specialised per column
+#define EVAL_ID(f) {                                                                  \
+        int v = in->ival;                                                             \
+        switch (in->cmp) {                                                            \
+        case CMP_EQ: for (k = 0; k < cnt; k++) m[k] = rows[k].f == v; break;          \
+        case CMP_NE: for (k = 0; k < cnt; k++) m[k] = rows[k].f != v; break;          \
+        case CMP_LT: for (k = 0; k < cnt; k++) m[k] = rows[k].f <  v; break;          \
+        case CMP_LE: for (k = 0; k < cnt; k++) m[k] = rows[k].f <= v; break;          \
+        case CMP_GT: for (k = 0; k < cnt; k++) m[k] = rows[k].f >  v; break;          \
+        case CMP_GE: for (k = 0; k < cnt; k++) m[k] = rows[k].f >= v; break;          \
+        default:                                                                      \
+            /* Strip trailing digits until the ID is as short as the prefix */       \
+            for (k = 0; k < cnt; k++) {                                               \
+                int x = rows[k].f;                                                    \
+                while (x >= in->ilim) x /= 10;                                        \
+                m[k] = x == v;                                                        \
+            }                                                                         \
+        }                                                                             \
+    }
+#define EVAL_MARK(f) {                                                                \
+        float v = in->fval;                                                           \
+        switch (in->cmp) {                                                            \
+        case CMP_EQ: for (k = 0; k < cnt; k++) m[k] = rows[k].f == v; break;          \
+        case CMP_NE: for (k = 0; k < cnt; k++) m[k] = rows[k].f != v; break;          \
+        case CMP_LT: for (k = 0; k < cnt; k++) m[k] = rows[k].f <  v; break;          \
+        case CMP_LE: for (k = 0; k < cnt; k++) m[k] = rows[k].f <= v; break;          \
+        case CMP_GT: for (k = 0; k < cnt; k++) m[k] = rows[k].f >  v; break;          \
+        default:     for (k = 0; k < cnt; k++) m[k] = rows[k].f >= v; break;          \
+        }                                                                             \
+    }
+#define EVAL_TEXT(f) {                                                                \
+        for (k = 0; k < cnt; k++) {                                                   \
+            if (in->cmp == CMP_STARTS) m[k] = (unsigned char)starts_with_ic(rows[k].f, in->sval); \
+            else m[k] = (unsigned char)(equals_ic(rows[k].f, in->sval) == (in->cmp == CMP_EQ));   \
+        }                                                                             \
+    }
+#define EVAL_CASE(kind, field, tag, head, key, alias, width, size) \
+    case COL_##tag: EVAL_##kind(field) break;
+
+// Evaluate one comparison over rows[0..cnt) into mask m
+void eval_compare(const PredInsn *in, const Student *rows, int cnt, unsigned char *m) {
+    int k;
+    switch (in->col) {
+    STUDENT_COLUMNS(EVAL_CASE)
+    }
+}
 
-    for(int i=0;i<g_count;i++){
-        fprintf(fp,"%d\t%s\t%s\t%.1f\n",
-            g_students[i].id,
-            g_students[i].name,
-            g_students[i].programme,
-            g_students[i].mark
-        );
+// Run the compiled filter over one batch; the result mask ends up in stack[0]
+void filter_eval(const Filter *f, const Student *rows, int cnt,
+                 unsigned char stack[][FILTER_BATCH]) {
+    int sp = 0;
+    for (int pc = 0; pc < f->len; pc++) {
+        const PredInsn *in = &f->code[pc];
+        if (in->op == PI_CMP) {
+            eval_compare(in, rows, cnt, stack[sp++]);
+        } else if (in->op == PI_NOT) {
+            for (int k = 0; k < cnt; k++) stack[sp - 1][k] ^= 1;
+        } else {
+            sp--;
+            if (in->op == PI_AND)
+                for (int k = 0; k < cnt; k++) stack[sp - 1][k] &= stack[sp][k];
+            else
+                for (int k = 0; k < cnt; k++) stack[sp - 1][k] |= stack[sp][k];
+        }
     }
+}
 
-    fclose(fp);
-    return 1;
+// Does the filter test names or programmes? Rows must then have their
+// text decoded before a batch is evaluated.
+int filter_needs_text(const Filter *f) {
+    for (int pc = 0; pc < f->len; pc++)
+        if (f->code[pc].op == PI_CMP && g_columns[f->code[pc].col].kind == KIND_TEXT)
+            return 1;
+    return 0;
 }
 
-/* ===================== COMMANDS ===================== */
-// Print full help menu for admin users
-void show_help(void){
-    printf("\n--------------------------------------------------------------------------------");
-    printf("\nAvailable Commands:\n");
-    printf("\n                 ---File Operations---                           \n");
-    printf("  OPEN <filename>              -> open the database file and read in all records\n");
-    printf("\n                 ---Display Operations---                    \n");
-    printf("  SHOW ALL                     -> display all current records in memory\n");
-    printf("  SHOW ALL SORT BY ID ASC      -> sort by student ID (ascending)\n");
-    printf("  SHOW ALL SORT BY ID DESC     -> sort by student ID (descending)\n");
-    printf("  SHOW ALL SORT BY MARK ASC    -> sort by mark (ascending)\n");
-    printf("  SHOW ALL SORT BY MARK DESC   -> sort by mark (descending)\n");
-    printf("  SHOW SUMMARY                 -> show total, average mark, highest & lowest\n");
-    printf("\n                 ---Record Operations---                    \n");
-    printf("  INSERT                       -> insert a new record (prompts every column)\n");
-    printf("  QUERY ID=<n>                 -> search for a record with a given student ID\n");
-    printf("  UPDATE ID=<n>                -> update the data (prompts every column; Enter keeps)\n");
-    printf("  DELETE ID=<n>                -> delete the record (double confirm)\n");
-    printf("  SAVE                         -> save all current records into the database file\n");
-    printf("  UNDO                         -> undo the last INSERT, UPDATE, or DELETE\n");   
-    printf("\n                      ---General---                           \n");
-    printf("  HELP                         -> show this help menu\n");
-    printf("  EXIT                         -> quit the program\n");
-    printf("--------------------------------------------------------------------------------\n");
+/* ---------- INTAKE PARTITIONS ---------- */
+// Student IDs start with the intake year (25xxxxx = 2025 intake), so the
+// table is partitioned by the first two digits of the ID. Each published
+// version gets a partition directory on first read: per intake, its rows
+// in table order, an ID index (the same rows sorted by ID) and summary
+// stats. The records themselves stay in the shared copy-on-write pages,
+// so table order and MVCC are unchanged. WHERE clauses skip partitions
+// whose ID range cannot match, and full-table work (SHOW SUMMARY, sorted
+// views) runs on partitions in parallel. Writers never use the directory
+// of the version they are changing.
+
+// Below this many rows the threads cost more than they save
+#define PAR_MIN_ROWS 512
+
+// Three-valued answer to "can rows of this partition match?"
+#define TV_FALSE 0   // no row matches
+#define TV_TRUE  1   // every row matches
+#define TV_MAYBE 2   // rows must be tested
+
+// Partition key of an ID: its first two digits
+int part_key(int id) {
+    if (id < 0) return 0;
+    while (id >= 100) id /= 10;
+    return id;
 }
 
-// Shorter help menu for student users (read-only view)
-void show_help_student(void){
-    printf("\n--------------------------------------------------------------------------------");
-    printf("\nAvailable Commands (Student Access Only):\n");   
-    printf("\n                 ---Display Operations---                    \n");
-    printf("  SHOW ALL                     -> display all current records in memory\n");
-    printf("  SHOW ALL SORT BY ID ASC      -> sort by student ID (ascending)\n");
-    printf("  SHOW ALL SORT BY ID DESC     -> sort by student ID (descending)\n");
-    printf("  SHOW ALL SORT BY MARK ASC    -> sort by mark (ascending)\n");
-    printf("  SHOW ALL SORT BY MARK DESC   -> sort by mark (descending)\n");
-    printf("  SHOW SUMMARY                 -> show total, average, highest & lowest marks\n");
-    printf("\n                     ---Search---                           \n");
-    printf("  QUERY ID=<n>                 -> search for a specific student record\n");   
-    printf("\n                     ---General---                           \n");
-    printf("  HELP                         -> show this help menu\n");
-    printf("  EXIT                         -> quit the program\n");
-    printf("--------------------------------------------------------------------------------\n");
+// Order row indices by ID (ties keep table order)
+int cmp_row_id(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    int ix = row_key(x)->id, iy = row_key(y)->id;
+    if (ix != iy) return (ix > iy) - (ix < iy);
+    return (x > y) - (x < y);
 }
 
-/* ---------- OPEN ---------- */
-// Handle OPEN <filename> command (admin only)
-void cmd_open(const char *args){
-    char fname[260]="";
+// Fill in the stats and ID index of one partition
+void part_build_task(void *arg, int p) {
+    Partition *pt = &((PartDir *)arg)->parts[p];
+    pt->min_id = INT_MAX;
+    pt->max_id = INT_MIN;
+    pt->sum = 0;
+    pt->min_mark = pt->max_mark = row_key(pt->rows[0])->mark;
+    for (int k = 0; k < pt->count; k++) {
+        const Student *s = row_key(pt->rows[k]);
+        if (s->id < pt->min_id) pt->min_id = s->id;
+        if (s->id > pt->max_id) pt->max_id = s->id;
+        pt->sum += s->mark;
+        if (s->mark < pt->min_mark) pt->min_mark = s->mark;
+        if (s->mark > pt->max_mark) pt->max_mark = s->mark;
+    }
+    memcpy(pt->by_id, pt->rows, (size_t)pt->count * sizeof(int));
+    qsort(pt->by_id, (size_t)pt->count, sizeof(int), cmp_row_id);
+}
 
-    // Skip spaces before filename
-    while(*args && isspace((unsigned char)*args)) args++;
+// Partition directory of the version this command reads (built on first
+// use and kept with the version). NULL while writing, for an empty table,
+// or if memory runs out; callers then scan the table as a whole.
+PartDir *part_dir(void) {
+    if (t_writing || !t_tab || t_tab->count == 0) return NULL;
+    PartDir *d = atomic_load(&t_tab->parts);
+    if (d) return d;
+
+    int n = t_tab->count;
+    d = calloc(1, sizeof(PartDir));
+    int *storage = malloc(2 * (size_t)n * sizeof(int));
+    if (!d || !storage) {
+        free(d);
+        free(storage);
+        return NULL;
+    }
+    d->storage = storage;
+
+    // Size each partition, then hand out its slice of storage
+    int counts[MAX_PARTS] = {0};
+    for (int i = 0; i < n; i++) counts[part_key(row_key(i)->id)]++;
+    int off = 0;
+    for (int key = 0; key < MAX_PARTS; key++) {
+        d->slot[key] = -1;
+        if (!counts[key]) continue;
+        Partition *pt = &d->parts[d->nparts];
+        d->slot[key] = (signed char)d->nparts++;
+        pt->key = key;
+        pt->rows = storage + off;
+        pt->by_id = storage + n + off;
+        off += counts[key];
+    }
+    for (int i = 0; i < n; i++) {
+        Partition *pt = &d->parts[d->slot[part_key(row_key(i)->id)]];
+        pt->rows[pt->count++] = i;
+    }
+    par_run(d->nparts, part_build_task, d, n >= PAR_MIN_ROWS);
+
+    // Another reader of the same version may have been faster
+    PartDir *expected = NULL;
+    if (!atomic_compare_exchange_strong(&t_tab->parts, &expected, d)) {
+        free(d->storage);
+        free(d);
+        d = expected;
+    }
+    return d;
+}
 
-    // Read filename until next space / end-of-line
-    size_t i=0;
-    while(*args && !isspace((unsigned char)*args) && i<sizeof(fname)-1)
-        fname[i++]=*args++;
-    fname[i]='\0';
-    
-    if(fname[0]=='\0'){
-        printf("CMS: Please provide a filename.\n");
-        return;
+// Row index of an ID via its partition's index (-1 if not found)
+int part_lookup(const PartDir *d, int id) {
+    int key = part_key(id);
+    if (d->slot[key] < 0) return -1;
+    const Partition *pt = &d->parts[d->slot[key]];
+    int lo = 0, hi = pt->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (row_key(pt->by_id[mid])->id < id) lo = mid + 1;
+        else hi = mid;
     }
+    return lo < pt->count && row_key(pt->by_id[lo])->id == id ? pt->by_id[lo] : -1;
+}
 
-    // Try to load file; if fail, remember filename and create new file on SAVE
-    if(!load_from_file(fname)){
-        strncpy(g_open_filename,fname,sizeof(g_open_filename)-1);
-        g_open_filename[sizeof(g_open_filename)-1]='\0';
-        printf("CMS: File not found — will create new on SAVE.\n"); 
-        return;
+// Can rows of a partition satisfy one comparison? Decided from the
+// partition's ID range; other columns always need testing.
+int part_test(const PredInsn *in, const Partition *pt) {
+    if (in->col != COL_ID) return TV_MAYBE;
+    int v = in->ival, lo = pt->min_id, hi = pt->max_id;
+    switch (in->cmp) {
+    case CMP_EQ: return v < lo || v > hi ? TV_FALSE : lo == hi ? TV_TRUE : TV_MAYBE;
+    case CMP_NE: return v < lo || v > hi ? TV_TRUE : lo == hi ? TV_FALSE : TV_MAYBE;
+    case CMP_LT: return hi < v ? TV_TRUE : lo >= v ? TV_FALSE : TV_MAYBE;
+    case CMP_LE: return hi <= v ? TV_TRUE : lo > v ? TV_FALSE : TV_MAYBE;
+    case CMP_GT: return lo > v ? TV_TRUE : hi <= v ? TV_FALSE : TV_MAYBE;
+    case CMP_GE: return lo >= v ? TV_TRUE : hi < v ? TV_FALSE : TV_MAYBE;
+    default:
+        // An ID prefix of two or more digits fixes the partition key; a
+        // one-digit prefix fixes its first digit
+        if (v >= 10) return part_key(v) == pt->key ? TV_MAYBE : TV_FALSE;
+        if (v > 0) return (pt->key >= 10 ? pt->key / 10 : pt->key) == v ? TV_MAYBE : TV_FALSE;
+        return TV_MAYBE;
     }
+}
 
-    strncpy(g_open_filename,fname,sizeof(g_open_filename)-1);
-    g_open_filename[sizeof(g_open_filename)-1]='\0';
-    printf("CMS: The database file \"%s\" is successfully opened. (%d records loaded)\n",
-           fname, g_count);
+// Evaluate the whole filter on a partition's ID range (three-valued logic)
+int part_verdict(const Filter *f, const Partition *pt) {
+    unsigned char st[PRED_MAX_DEPTH];
+    int sp = 0;
+    for (int pc = 0; pc < f->len; pc++) {
+        const PredInsn *in = &f->code[pc];
+        if (in->op == PI_CMP) {
+            st[sp++] = (unsigned char)part_test(in, pt);
+        } else if (in->op == PI_NOT) {
+            if (st[sp - 1] != TV_MAYBE) st[sp - 1] ^= 1;
+        } else {
+            unsigned char a = st[sp - 2], b = st[--sp];
+            if (in->op == PI_AND)
+                st[sp - 1] = a == TV_FALSE || b == TV_FALSE ? TV_FALSE
+                           : a == TV_TRUE && b == TV_TRUE ? TV_TRUE : TV_MAYBE;
+            else
+                st[sp - 1] = a == TV_TRUE || b == TV_TRUE ? TV_TRUE
+                           : a == TV_FALSE && b == TV_FALSE ? TV_FALSE : TV_MAYBE;
+        }
+    }
+    return st[0];
 }
 
-/* ---------- SHOW ALL ---------- */
-// Handle SHOW ALL (with optional SORT BY ...) for displaying records
-void cmd_show_all(const char *args){
-    if(g_count==0){
-        printf("CMS: No records loaded.\n");
+// A filtered scan over partitions: each task flags its matching rows
+typedef struct {
+    const Filter  *f;
+    const PartDir *d;
+    unsigned char *hit;   // one flag per table row
+} PartScan;
+
+// Scan one partition: skip it, take it whole, or test its rows in batches
+void part_scan_task(void *arg, int p) {
+    PartScan *job = arg;
+    const Partition *pt = &job->d->parts[p];
+    int verdict = part_verdict(job->f, pt);
+    if (verdict == TV_FALSE) return;
+    if (verdict == TV_TRUE) {
+        for (int k = 0; k < pt->count; k++) job->hit[pt->rows[k]] = 1;
         return;
     }
 
-    // If user added "SORT BY ..." after SHOW ALL, handle it
-    handle_sort(args);
-
-    printf("CMS: Here are all the records.\n");
-    printf("%-10s %-20s %-25s %-6s\n", "ID","Name","Programme","Mark");
-    
-    for(int i=0;i<g_count;i++){
-        printf("%-10d %-20s %-25s %-6.1f\n",
-               g_students[i].id,
-               g_students[i].name,
-               g_students[i].programme,
-               g_students[i].mark);
+    Student batch[FILTER_BATCH];
+    unsigned char stack[PRED_MAX_DEPTH][FILTER_BATCH];
+    int text = filter_needs_text(job->f);
+    for (int base = 0; base < pt->count; base += FILTER_BATCH) {
+        int cnt = pt->count - base < FILTER_BATCH ? pt->count - base : FILTER_BATCH;
+        for (int k = 0; k < cnt; k++) {
+            if (text) {
+                batch[k] = *row_at(pt->rows[base + k]);
+            } else {
+                batch[k].id = row_key(pt->rows[base + k])->id;
+                batch[k].mark = row_key(pt->rows[base + k])->mark;
+            }
+        }
+        filter_eval(job->f, batch, cnt, stack);
+        for (int k = 0; k < cnt; k++) job->hit[pt->rows[base + k]] = stack[0][k];
     }
 }
 
-/* ---------- INSERT ---------- */
-// Prompt non-empty string from user
-void prompt_string(const char *label,char*out,size_t outsz){
-    while(1){
-        printf("%s", label);
-        if(!fgets(out,outsz,stdin)) { out[0]=0; return; }
-        rstrip(out); 
-        trim(out);
-        if(out[0]) return;   // not empty => ok
-        printf("Please enter something.\n");
+// filter_select over partitions; returns -1 if it could not run
+int part_select(const Filter *f, const PartDir *d, int *sel) {
+    unsigned char *hit = calloc((size_t)t_tab->count, 1);
+    if (!hit) return -1;
+    PartScan job = { f, d, hit };
+    par_run(d->nparts, part_scan_task, &job, t_tab->count >= PAR_MIN_ROWS);
+
+    // Back to table order
+    int n = 0;
+    for (int i = 0; i < t_tab->count; i++) {
+        sel[n] = i;
+        n += hit[i];
     }
+    free(hit);
+    return n;
 }
-// Prompt for integer input with basic validation (supports QUIT)
-int prompt_int(const char *label) {
-    char buf[64];
-    while (1) {
-        printf("%s", label);
-        if (!fgets(buf, sizeof(buf), stdin)) return 0;
-        rstrip(buf);
-        trim(buf);
-
-        // Check if user wants to exit this operation
-        if (check_exit(buf)) {
-            printf("Exiting operation.\n");
-            return 0;  // Exit the current operation
-        }
 
-        char *e;
-        long v = strtol(buf, &e, 10);
-        if (*e == '\0') return (int)v;
-        printf("Invalid integer.\n");
+/* ---------- WHERE filter engine: scans and sorting ---------- */
+// Run the compiled filter over the table page by page; writes matching
+// indices into sel (caller provides t_tab->count slots) and returns the count
+int filter_select(const Filter *f, int *sel) {
+    // With a WHERE clause, go by partition so whole intakes can be skipped
+    PartDir *d = f->len ? part_dir() : NULL;
+    if (d) {
+        int n = part_select(f, d, sel);
+        if (n >= 0) return n;
     }
-}
-// Prompt for float input with basic validation (supports QUIT)
-float prompt_float(const char *label) {
-    char buf[64];
-    while (1) {
-        printf("%s", label);
-        if (!fgets(buf, sizeof(buf), stdin)) continue;
-        rstrip(buf);
-        trim(buf);
 
-        // Check if user wants to exit
-        if (check_exit(buf)) {
-            printf("Exiting operation.\n");
-            return 0;  // Exit the current operation
+    unsigned char stack[PRED_MAX_DEPTH][FILTER_BATCH];
+    int n = 0;
+    int text = filter_needs_text(f);
+
+    for (int base = 0; base < t_tab->count; base += FILTER_BATCH) {
+        int cnt = t_tab->count - base < FILTER_BATCH ? t_tab->count - base : FILTER_BATCH;
+        const Student *rows = row_key(base);   // one batch = one record page
+        if (text) lazy_page_ready(t_tab->pages[base / PAGE_ROWS]);
+
+        if (f->len == 0) {
+            for (int k = 0; k < cnt; k++) sel[n++] = base + k;
+            continue;
         }
+        filter_eval(f, rows, cnt, stack);
 
-        char *e;
-        float v = strtof(buf, &e);
+        // Branch-free append of matching row indices
+        for (int k = 0; k < cnt; k++) {
+            sel[n] = base + k;
+            n += stack[0][k];
+        }
+    }
+    return n;
+}
 
-        if (*e == '\0') return v;
-        printf("Invalid number.\n");
+// Sort keys: row_key() decodes only the ID and mark, so text columns
+// cannot be sort fields
+#define COMPARE_KEY(f) return (row_key(a)->f > row_key(b)->f) - (row_key(a)->f < row_key(b)->f);
+#define COMPARE_ID(f)   COMPARE_KEY(f)
+#define COMPARE_MARK(f) COMPARE_KEY(f)
+#define COMPARE_TEXT(f) break;
+#define COMPARE_CASE(kind, field, tag, head, key, alias, width, size) \
+    case COL_##tag: COMPARE_##kind(field)
+
+// Compare two rows by the given sort column (COL_*)
+int compare_rows(int a, int b, int field) {
+    switch (field) {
+    STUDENT_COLUMNS(COMPARE_CASE)
     }
+    return 0;
 }
-// ================== NEW VALIDATION FUNCTIONS ==================
 
-// Check string contains only letters and spaces (no digits/symbols)
-int is_alpha_space(const char *s){
-    if (s[0] == '\0') return 0; // empty not allowed
-
-    for (int i = 0; s[i] != '\0'; i++){
-        unsigned char c = (unsigned char)s[i];
-        if (!isalpha(c) && !isspace(c)) {
-            return 0;
+// Stable merge sort of a selection vector (rows themselves are not moved)
+void sort_selection(int *sel, int n, int field, int asc) {
+    if (n < 2 || field == 0) return;
+    int *tmp = malloc((size_t)n * sizeof(int));
+    if (!tmp) return;
+
+    for (int width = 1; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = lo + width < n ? lo + width : n;
+            int hi  = lo + 2 * width < n ? lo + 2 * width : n;
+            int i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                int c = compare_rows(sel[i], sel[j], field);
+                if (!asc) c = -c;
+                tmp[k++] = c <= 0 ? sel[i++] : sel[j++];
+            }
+            while (i < mid) tmp[k++] = sel[i++];
+            while (j < hi)  tmp[k++] = sel[j++];
         }
+        memcpy(sel, tmp, (size_t)n * sizeof(int));
     }
-    return 1;
+    free(tmp);
 }
 
-// Ask for a valid Name (letters + spaces only)
-void prompt_name(char *out, size_t outsz) {
-    while (1) {
-        prompt_string("Enter Name: ", out, outsz);
-        if (!is_alpha_space(out)) {
-            printf("Error: Name must only contain letters and spaces.\n");
-            continue;
-        }
-        break;
+// Rows per task for parallel sorts and scans: about two tasks per thread,
+// so a thread that finishes early can take over another chunk
+int par_chunk(int n) {
+    int w = par_width();
+    int c = (n + 2 * w - 1) / (2 * w);
+    return c < 64 ? 64 : c;
+}
+
+// A parallel sort of a selection, as runs of 'width' sorted entries
+typedef struct {
+    int *src, *dst;
+    int  n, width;
+    int  field, asc;
+} ParSort;
+
+// Sort one chunk of the selection in place
+void par_sort_chunk(void *arg, int t) {
+    ParSort *job = arg;
+    int lo = t * job->width;
+    int len = job->n - lo < job->width ? job->n - lo : job->width;
+    sort_selection(job->src + lo, len, job->field, job->asc);
+}
+
+// Merge one pair of neighbouring runs from src into dst (ties: left first)
+void par_merge_pair(void *arg, int t) {
+    ParSort *job = arg;
+    int lo  = 2 * t * job->width;
+    int mid = lo + job->width < job->n ? lo + job->width : job->n;
+    int hi  = mid + job->width < job->n ? mid + job->width : job->n;
+    int i = lo, j = mid, k = lo;
+    while (i < mid && j < hi) {
+        int c = compare_rows(job->src[i], job->src[j], job->field);
+        if (!job->asc) c = -c;
+        job->dst[k++] = c <= 0 ? job->src[i++] : job->src[j++];
     }
+    while (i < mid) job->dst[k++] = job->src[i++];
+    while (j < hi)  job->dst[k++] = job->src[j++];
 }
 
-// Ask for a valid Programme (letters + spaces only)
-void prompt_programme(char *out, size_t outsz) {
-    while (1) {
-        prompt_string("Enter Programme: ", out, outsz);
-        if (!is_alpha_space(out)) {
-            printf("Error: Programme must only contain letters and spaces.\n");
-            continue;
-        }
-        break;
+// sort_selection on the thread pool: chunks are sorted in parallel, then
+// neighbouring runs are merged pairwise, each round in parallel. Every
+// step is stable, so the result is exactly sort_selection's.
+void sort_selection_par(int *sel, int n, int field, int asc) {
+    int *tmp = n >= PAR_MIN_ROWS && field ? malloc((size_t)n * sizeof(int)) : NULL;
+    if (!tmp) {
+        sort_selection(sel, n, field, asc);
+        return;
     }
+
+    ParSort job = { sel, tmp, n, par_chunk(n), field, asc };
+    par_run((n + job.width - 1) / job.width, par_sort_chunk, &job, 1);
+    for (; job.width < n; job.width *= 2) {
+        par_run((n + 2 * job.width - 1) / (2 * job.width), par_merge_pair, &job, 1);
+        int *t = job.src;
+        job.src = job.dst;
+        job.dst = t;
+    }
+    if (job.src != sel) memcpy(sel, job.src, (size_t)n * sizeof(int));
+    free(tmp);
 }
-// NEW: validate student ID (must start with 2 + 7 digits, supports QUIT)
-int prompt_student_id(void){
-    char buf[64];
 
-    while(1){
-        printf("Enter student ID: ");
-        if(!fgets(buf,sizeof(buf),stdin)) return 0;
-        rstrip(buf);
-        trim(buf);
+// Parse a "[WHERE ...] [SORT BY ...]" clause into *f; 'after' names the
+// command in error messages. Returns 0 if the clause could not be parsed.
+int parse_view_clause(const char *args, Filter *f, const char *after){
+    f->len = 0;
+    f->sort_field = 0;
+    f->sort_asc = 1;
+    if(!args || !*args) return 1;
+
+    Token toks[MAX_TOKENS];
+    int ntok = tokenize_clause(args, toks, MAX_TOKENS);
+    if(ntok < 0){
+        cms_printf("CMS: Invalid clause \"%s\".\n", args);
+        return 0;
+    }
 
-        // allow user to type QUIT to cancel this input
-        if (check_exit(buf)) {
-            return -1;   // special value = user cancelled
-        }
+    int pos = 0;
 
-        int len = (int)strlen(buf);
-        int ok = 1;
+    // Optional: WHERE <condition>
+    if(toks[pos].kind == TK_WORD && equals_ic(toks[pos].text, "WHERE")){
+        pos++;
+        if(!parse_where(toks, ntok, &pos, f)){
+            cms_printf("CMS: Invalid WHERE condition near \"%s\".\n",
+                   pos < ntok ? toks[pos].text : "end of line");
+            return 0;
+        }
+    }
 
-        // Rule: exactly 7 digits and must start with '2'
-        if(len != 7 || buf[0] != '2'){
-            ok = 0;
-        } else {
-            for(int i=0;i<len;i++){
-                if(!isdigit((unsigned char)buf[i])){
-                    ok = 0;
-                    break;
-                }
-            }
+    // Optional: SORT BY ID|MARK [ASC|DESC] (only number columns sort)
+    if(toks[pos].kind == TK_WORD && equals_ic(toks[pos].text, "SORT") &&
+       toks[pos+1].kind == TK_WORD && equals_ic(toks[pos+1].text, "BY"))
+    {
+        pos += 2;
+        int col = toks[pos].kind == TK_WORD ? column_from_name(toks[pos].text) : 0;
+        if(!col || g_columns[col].kind == KIND_TEXT){
+            cms_printf("CMS: Unexpected \"%s\" after SORT BY (use ID or MARK).\n",
+                   pos < ntok ? toks[pos].text : "end of line");
+            return 0;
         }
+        f->sort_field = col;
+        pos++;
 
-        if(!ok){
-            printf("Error: Student ID must start with 2 and have exactly 7 digits.\n");
-            continue;
+        if(toks[pos].kind == TK_WORD &&
+           (equals_ic(toks[pos].text,"ASC") || equals_ic(toks[pos].text,"DESC"))){
+            f->sort_asc = equals_ic(toks[pos].text,"ASC");
+            pos++;
         }
+    }
 
-        return (int)strtol(buf,NULL,10);
+    if(pos < ntok){
+        cms_printf("CMS: Unexpected \"%s\" after %s.\n", toks[pos].text, after);
+        return 0;
     }
+    return 1;
 }
 
-// NEW: validate and round mark to 1 decimal place
-float prompt_mark(const char *label) {
-    char buf[64];
-    while (1) {
-        printf("%s", label);
-        if (!fgets(buf, sizeof(buf), stdin)) continue;
-        rstrip(buf);
-        trim(buf);
+// Parse the "[WHERE ...] [SORT BY ...]" part after SHOW ALL.
+// An admin's plain SORT BY sorts the table itself (as before); otherwise
+// the compiled filter and ordering are left in *f for the caller to apply
+// to a selection vector. Returns 0 if the clause could not be parsed.
+int handle_sort(const char *args, Filter *f){
+    if(!parse_view_clause(args, f, "SHOW ALL")) return 0;
+
+    // An admin's plain SORT BY keeps the old behaviour of reordering the
+    // table; students only get a sorted view of their snapshot
+    if(f->len == 0 && g_is_admin){
+        if(f->sort_field) sort_table(f->sort_field, f->sort_asc);
+        f->sort_field = 0;
+    }
+    return 1;
+}
 
-        // Check empty input
-        if (buf[0] == '\0') {
-            printf("Mark cannot be empty.\n");
-            continue;
-        }
+/* ---------- FILE I/O (stdio, or io_uring on Linux) ---------- */
+// Database files are read and written through FileReader / FileWriter.
+// On Linux they use io_uring with two large buffers: while one block is
+// parsed (or formatted) the other is being read (or written) by the
+// kernel. Everywhere else, or if io_uring is unavailable or switched off
+// with SET IO STDIO, they fall back to buffered stdio.
+#define IO_BLOCK (256 * 1024)   // bytes per io_uring read/write
 
-        // Convert string to float
-        char *end;
-        float v = strtof(buf, &end);
+// Use io_uring for database files where available (SET IO URING | STDIO)
+atomic_int g_io_uring = 1;
 
-        // Reject invalid text (e.g. "abc")
-        if (*end != '\0') {
-            printf("Invalid number.\n");
-            continue;
-        }
+#ifdef __linux__
+// A minimal io_uring (raw system calls; no liburing needed)
+typedef struct {
+    int       fd;                         // ring descriptor
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void     *sq_map, *cq_map;
+    size_t    sq_len, cq_len, sqes_len;
+} Uring;
+
+// Release a ring set up (fully or partly) by uring_init
+void uring_exit(Uring *r) {
+    if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map != MAP_FAILED) munmap(r->cq_map, r->cq_len);
+    if (r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_len);
+    if (r->fd >= 0) close(r->fd);
+}
 
-        // Range check 0–100
-        if (v < 0 || v > 100) {
-            printf("Mark must be between 0 and 100.\n");
-            continue;
+// Create a ring with room for 'entries' requests; 0 if the kernel refuses
+int uring_init(Uring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->sq_map = r->cq_map = MAP_FAILED;
+    r->sqes = MAP_FAILED;
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return 0;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sq_map = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        uring_exit(r);
+        return 0;
+    }
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 1;
+}
+
+// Submit one read or write (IORING_OP_READ / IORING_OP_WRITE)
+int uring_submit(Uring *r, int op, int fd, void *buf, unsigned len,
+                 long long off, unsigned long long tag) {
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = (unsigned long long)off;
+    sqe->user_data = tag;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0) == 1;
+}
+
+// Wait for the next completion; returns its result, tag in *tag
+int uring_wait(Uring *r, unsigned long long *tag) {
+    while (1) {
+        unsigned head = *r->cq_head;
+        if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *c = &r->cqes[head & *r->cq_mask];
+            *tag = c->user_data;
+            int res = c->res;
+            __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+            return res;
         }
+        if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR)
+            return -errno;
+    }
+}
+#endif
 
-        // Round to 1 decimal place
-        v = roundf(v * 10.0f) / 10.0f;
-        return v;
+// Sequential reader of a database file
+typedef struct {
+    FILE      *fp;          // stdio path (NULL when io_uring is used)
+    long long  size;        // file size when opened (-1 = unknown)
+#ifdef __linux__
+    int        fd;
+    Uring      ring;
+    char      *buf[2];      // double buffer: one being parsed, one being read
+    int        len[2];      // bytes in each buffer (-1 = read in flight, 0 = none)
+    long long  off[2];      // file offset of each buffer
+    int        cur;         // buffer being consumed
+    int        pos;         // next byte in buf[cur]
+    long long  next_off;    // next block to request
+#endif
+} FileReader;
+
+#ifdef __linux__
+// Ask the kernel for the next block into buffer b (if any is left)
+void reader_request(FileReader *r, int b) {
+    r->len[b] = 0;
+    if (r->next_off >= r->size) return;
+    r->off[b] = r->next_off;
+    r->next_off += IO_BLOCK;
+    long long want = r->size - r->off[b] < IO_BLOCK ? r->size - r->off[b] : IO_BLOCK;
+    if (uring_submit(&r->ring, IORING_OP_READ, r->fd, r->buf[b], (unsigned)want, r->off[b], b)) {
+        r->len[b] = -1;
+    } else {
+        ssize_t got = pread(r->fd, r->buf[b], (size_t)want, r->off[b]);   // ring full/failed
+        r->len[b] = got > 0 ? (int)got : 0;
     }
 }
 
-/* ---------- INSERT ---------- */
-// INSERT command: add a new student after validation
-void cmd_insert(const char *args) {
-    // Quick escape: if user typed QUIT after INSERT
-    if (check_exit(args)) {
-        printf("Exiting insert operation.\n");
-        return;  // Exit the insert operation
+// Wait until buffer b holds its block. Short or failed reads are
+// completed with pread, so a block is always whole.
+void reader_settle(FileReader *r, int b) {
+    while (r->len[b] == -1) {
+        unsigned long long tag;
+        int res = uring_wait(&r->ring, &tag);
+        int t = (int)tag;
+        long long want = r->size - r->off[t] < IO_BLOCK ? r->size - r->off[t] : IO_BLOCK;
+        long long have = res > 0 ? res : 0;
+        while (have < want) {
+            ssize_t got = pread(r->fd, r->buf[t] + have, (size_t)(want - have), r->off[t] + have);
+            if (got <= 0) break;
+            have += got;
+        }
+        r->len[t] = (int)have;
+    }
+}
+#endif
+
+// Open a database file for reading; 0 if it cannot be opened
+int reader_open(FileReader *r, const char *filename) {
+    memset(r, 0, sizeof(*r));
+    r->size = -1;
+#ifdef __linux__
+    r->fd = -1;
+    if (g_io_uring) {
+        struct stat st;
+        r->fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (r->fd < 0) return 0;
+        if (fstat(r->fd, &st) == 0 && uring_init(&r->ring, 4)) {
+            if (posix_memalign((void **)&r->buf[0], 4096, IO_BLOCK) == 0 &&
+                posix_memalign((void **)&r->buf[1], 4096, IO_BLOCK) == 0) {
+                r->size = (long long)st.st_size;
+                reader_request(r, 0);
+                reader_request(r, 1);
+                reader_settle(r, 0);
+                return 1;
+            }
+            free(r->buf[0]);
+            uring_exit(&r->ring);
+        }
+        close(r->fd);   // no io_uring here: use stdio
+        r->fd = -1;
     }
+#endif
+    r->fp = fopen(filename, "r");
+    if (!r->fp) return 0;
+    struct stat st;
+    if (fstat(fileno(r->fp), &st) == 0) r->size = (long long)st.st_size;
+    return 1;
+}
 
-    if (g_open_filename[0] == '\0') {
-        printf("CMS: No file opened.\n");
-        return;
+#ifdef __linux__
+// Make sure buf[cur] has unread bytes; 0 at end of file
+int reader_more(FileReader *r) {
+    while (r->pos >= r->len[r->cur]) {
+        if (r->len[r->cur] == 0) return 0;            // nothing left to read
+        int done = r->cur;
+        r->cur ^= 1;
+        r->pos = 0;
+        reader_request(r, done);                      // refill behind us
+        reader_settle(r, r->cur);
+    }
+    return 1;
+}
+#endif
+
+// fgets() on a reader
+char *reader_gets(FileReader *r, char *line, size_t size) {
+    if (r->fp) return fgets(line, (int)size, r->fp);
+#ifdef __linux__
+    size_t n = 0;
+    while (n + 1 < size && reader_more(r)) {
+        char *src = r->buf[r->cur] + r->pos;
+        size_t avail = (size_t)(r->len[r->cur] - r->pos);
+        if (avail > size - 1 - n) avail = size - 1 - n;
+        char *nl = memchr(src, '\n', avail);
+        size_t take = nl ? (size_t)(nl - src) + 1 : avail;
+        memcpy(line + n, src, take);
+        n += take;
+        r->pos += (int)take;
+        if (nl) break;
+    }
+    if (n == 0) return NULL;
+    line[n] = '\0';
+    return line;
+#else
+    return NULL;
+#endif
+}
+
+// fread() on a reader
+size_t reader_read(FileReader *r, void *dst, size_t n) {
+    if (r->fp) return fread(dst, 1, n, r->fp);
+#ifdef __linux__
+    size_t done = 0;
+    while (done < n && reader_more(r)) {
+        size_t avail = (size_t)(r->len[r->cur] - r->pos);
+        if (avail > n - done) avail = n - done;
+        memcpy((char *)dst + done, r->buf[r->cur] + r->pos, avail);
+        done += avail;
+        r->pos += (int)avail;
     }
+    return done;
+#else
+    return 0;
+#endif
+}
 
-    if (g_count >= MAX_STUDENTS) {
-        printf("CMS: Storage full.\n");
+// Close a reader (waits for reads still in flight)
+void reader_close(FileReader *r) {
+    if (r->fp) {
+        fclose(r->fp);
         return;
     }
+#ifdef __linux__
+    reader_settle(r, 0);
+    reader_settle(r, 1);
+    uring_exit(&r->ring);
+    free(r->buf[0]);
+    free(r->buf[1]);
+    close(r->fd);
+#endif
+}
 
-    int id;
+// Flush a file's data to disk before it replaces the original
+int sync_file(FILE *fp){
+    if(fflush(fp) != 0) return 0;
+#ifdef _WIN32
+    return _commit(_fileno(fp)) == 0;
+#else
+    return fsync(fileno(fp)) == 0;
+#endif
+}
 
-    // Validate ID format + check duplicate, using prompt_student_id
-    while (1) {
-        id = prompt_student_id();   // uses our validation
+// Move a finished temp file over 'path'. On POSIX rename() replaces the
+// target atomically, and the directory is synced so the rename survives
+// a crash; Windows has to remove the target first.
+int replace_file(const char *tmp, const char *path){
+#ifdef _WIN32
+    remove(path);
+    return rename(tmp, path) == 0;
+#else
+    if(rename(tmp, path) != 0) return 0;
+    char dir[300];
+    const char *slash = strrchr(path, '/');
+    if(slash) snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path) + 1, path);
+    else strcpy(dir, ".");
+    int fd = open(dir, O_RDONLY);
+    if(fd >= 0){
+        fsync(fd);
+        close(fd);
+    }
+    return 1;
+#endif
+}
 
-        if (id < 0) {               // user typed QUIT
-            printf("Exiting insert operation.\n");
-            return;
+// Sequential writer of a database file
+typedef struct {
+    FILE      *fp;          // stdio path (NULL when io_uring is used)
+    int        failed;
+#ifdef __linux__
+    int        fd;
+    Uring      ring;
+    char      *buf[2];      // double buffer: one being filled, one being written
+    int        len[2];      // bytes in each buffer
+    int        busy[2];     // write in flight
+    long long  off[2];      // file offset each buffer is written at
+    int        cur;
+    long long  next_off;
+#endif
+} FileWriter;
+
+// Create (truncate) a file for writing; 0 if it cannot be created
+int writer_open(FileWriter *w, const char *filename) {
+    memset(w, 0, sizeof(*w));
+#ifdef __linux__
+    w->fd = -1;
+    if (g_io_uring) {
+        w->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (w->fd < 0) return 0;
+        if (uring_init(&w->ring, 4)) {
+            if (posix_memalign((void **)&w->buf[0], 4096, IO_BLOCK) == 0 &&
+                posix_memalign((void **)&w->buf[1], 4096, IO_BLOCK) == 0)
+                return 1;
+            free(w->buf[0]);
+            uring_exit(&w->ring);
         }
+        close(w->fd);
+        w->fd = -1;
+    }
+#endif
+    w->fp = fopen(filename, "w");
+    if (!w->fp) return 0;
+    setvbuf(w->fp, NULL, _IOFBF, 1 << 20);
+    return 1;
+}
 
-        if (find_index_by_id(id) >= 0) {
-            printf("Error: This ID exists.\n");
-        } else {
-            break;  // valid and unique
+#ifdef __linux__
+// Wait for the write of buffer b; short or failed writes finish with pwrite
+void writer_settle(FileWriter *w, int b) {
+    while (w->busy[b]) {
+        unsigned long long tag;
+        int res = uring_wait(&w->ring, &tag);
+        int t = (int)tag;
+        long long have = res > 0 ? res : 0;
+        while (have < w->len[t]) {
+            ssize_t put = pwrite(w->fd, w->buf[t] + have, (size_t)(w->len[t] - have), w->off[t] + have);
+            if (put <= 0) {
+                w->failed = 1;
+                break;
+            }
+            have += put;
         }
+        w->busy[t] = 0;
+        w->len[t] = 0;
     }
+}
 
-    char name[NAME_MAX_LEN];
-    char prog[PROG_MAX_LEN];
-    float mark;
-
-    // VALIDATED INPUTS FOR NAME
-    while (1) {
-        prompt_string("Enter Name: ", name, sizeof(name));
-
-        // Allow user to cancel by typing QUIT
-        if (check_exit(name)) {
-            printf("Exiting insert operation.\n");
-            return;
+// Hand the current buffer to the kernel and switch to the other one
+void writer_flush(FileWriter *w) {
+    int b = w->cur;
+    if (w->len[b] == 0) return;
+    w->off[b] = w->next_off;
+    w->next_off += w->len[b];
+    if (uring_submit(&w->ring, IORING_OP_WRITE, w->fd, w->buf[b], (unsigned)w->len[b], w->off[b], b)) {
+        w->busy[b] = 1;
+    } else {
+        if (pwrite(w->fd, w->buf[b], (size_t)w->len[b], w->off[b]) != w->len[b]) w->failed = 1;
+        w->len[b] = 0;
+    }
+    w->cur ^= 1;
+    writer_settle(w, w->cur);   // the other buffer must be free to fill
+}
+#endif
+
+// fprintf() on a writer
+void writer_printf(FileWriter *w, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    if (w->fp) {
+        if (vfprintf(w->fp, fmt, ap) < 0) w->failed = 1;
+        va_end(ap);
+        return;
+    }
+#ifdef __linux__
+    for (int tries = 0; tries < 2; tries++) {
+        int room = IO_BLOCK - w->len[w->cur];
+        va_list aq;
+        va_copy(aq, ap);
+        int n = vsnprintf(w->buf[w->cur] + w->len[w->cur], (size_t)room, fmt, aq);
+        va_end(aq);
+        if (n >= 0 && n < room) {
+            w->len[w->cur] += n;
+            break;
         }
+        if (n < 0 || tries) w->failed = 1;   // longer than a whole block
+        else writer_flush(w);
+    }
+#endif
+    va_end(ap);
+}
 
-        if (!is_alpha_space(name)) {
-            printf("Error: Name must only contain letters and spaces.\n");
+// fwrite() on a writer: bytes are copied into the current block as is
+void writer_write(FileWriter *w, const void *data, size_t n) {
+    if (w->fp) {
+        if (fwrite(data, 1, n, w->fp) != n) w->failed = 1;
+        return;
+    }
+#ifdef __linux__
+    const char *p = data;
+    while (n > 0) {
+        int room = IO_BLOCK - w->len[w->cur];
+        if (room == 0) {
+            writer_flush(w);
             continue;
         }
+        size_t k = n < (size_t)room ? n : (size_t)room;
+        memcpy(w->buf[w->cur] + w->len[w->cur], p, k);
+        w->len[w->cur] += (int)k;
+        p += k;
+        n -= k;
+    }
+#endif
+}
 
-        break;
+// Flush everything, sync it to disk and close. Returns 1 if every byte
+// reached the file.
+int writer_close(FileWriter *w) {
+    int ok = !w->failed;
+    if (w->fp) {
+        if (!sync_file(w->fp)) ok = 0;
+        if (fclose(w->fp) != 0) ok = 0;
+        return ok;
     }
+#ifdef __linux__
+    writer_flush(w);
+    writer_settle(w, 0);
+    writer_settle(w, 1);
+    if (w->failed || fsync(w->fd) != 0) ok = 0;
+    if (close(w->fd) != 0) ok = 0;
+    uring_exit(&w->ring);
+    free(w->buf[0]);
+    free(w->buf[1]);
+#endif
+    return ok;
+}
 
-    // VALIDATED INPUTS FOR PROGRAMME
-    while (1) {
-        prompt_string("Enter Programme: ", prog, sizeof(prog));
+/* ---------- COLUMNAR FILES (compressed binary tables) ---------- */
+// A database file whose name ends in ".cmsc" (or that already holds this
+// format) is stored by column instead of as text, about a third of the
+// text size:
+//   IDs        rows sorted by ID; the first ID, then the gaps bit-packed
+//              with the width of the largest gap
+//   programmes a dictionary of the distinct names, then one bit-packed
+//              code per row
+//   marks      10 bits per row in tenths (0-1022); 1023 means the mark is
+//              not a whole tenth in range and follows as a float
+//   names      front-coded: bytes shared with the previous name, then
+//              the rest
+// OPEN and SAVE read and write it like a text file, MERGE and DIFF read
+// it; the rows come back in ID order. The header uses the host's layout, like the
+// .snap files.
+#define COL_MAGIC      "CMSCOL1\n"
+#define COL_EXT        ".cmsc"
+#define COL_MARK_BITS  10
+#define COL_MARK_EXC   1023     // mark stored in the exception list
 
-        // Allow user to cancel by typing QUIT
-        if (check_exit(prog)) {
-            printf("Exiting insert operation.\n");
+typedef struct {
+    char magic[8];       // COL_MAGIC
+    int  count;          // rows
+    int  ndict;          // distinct programmes
+    int  id_bits;        // width of one ID gap
+    int  prog_bits;      // width of one programme code
+    int  nexcept;        // marks stored as floats
+    int  first_id;
+    int  name_bytes;     // size of the front-coded names
+} ColHeader;
+
+// Growable byte buffer with a bit cursor
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+    unsigned long long acc;   // bits not yet stored
+    int nacc;
+    int failed;
+} ColBuf;
+
+void col_put_bytes(ColBuf *b, const void *src, size_t n) {
+    if (n == 0) return;
+    if (b->len + n > b->cap) {
+        size_t ncap = b->cap ? b->cap : 4096;
+        while (ncap < b->len + n) ncap *= 2;
+        unsigned char *nd = realloc(b->data, ncap);
+        if (!nd) {
+            b->failed = 1;
             return;
         }
-
-        if (!is_alpha_space(prog)) {
-            printf("Error: Programme must only contain letters and spaces.\n");
-            continue;
-        }
-
-        break;
+        b->data = nd;
+        b->cap = ncap;
     }
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+}
 
-    // Validated mark (0–100, rounded to 1 dp)
-    mark = prompt_mark("Enter Mark: ");  // assuming this is validated already
+void col_put_bits(ColBuf *b, unsigned v, int bits) {
+    b->acc |= (unsigned long long)v << b->nacc;
+    b->nacc += bits;
+    while (b->nacc >= 8) {
+        unsigned char c = (unsigned char)b->acc;
+        col_put_bytes(b, &c, 1);
+        b->acc >>= 8;
+        b->nacc -= 8;
+    }
+}
 
-    // Build new student record
-    Student s;
-    s.id = id;
-    strncpy(s.name, name, NAME_MAX_LEN - 1);
-    s.name[NAME_MAX_LEN - 1] = '\0';
-    strncpy(s.programme, prog, PROG_MAX_LEN - 1);
-    s.programme[PROG_MAX_LEN - 1] = '\0';
-    s.mark = mark;
+// Pad the bit stream to a whole byte (each column starts on one)
+void col_align(ColBuf *b) {
+    if (b->nacc) col_put_bits(b, 0, 8 - b->nacc);
+}
 
-    // Add to array and record undo info
-    g_students[g_count++] = s;
-    push_undo('I', s, s);
+// Bits needed for values up to v
+int col_width(unsigned v) {
+    int w = 0;
+    while (v >> w) w++;
+    return w;
+}
 
-    printf("CMS: Record inserted.\n");
-    printf("Remember to type SAVE to save your changes.\n");
+// Does the file hold a columnar table?
+int col_detect(const char *filename) {
+    char magic[8];
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return 0;
+    int yes = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, COL_MAGIC, 8) == 0;
+    fclose(fp);
+    return yes;
 }
 
+// Should SAVE write this file in columns? (its name, or what it holds now)
+int col_wanted(const char *filename) {
+    size_t n = strlen(filename), e = strlen(COL_EXT);
+    return (n > e && equals_ic(filename + n - e, COL_EXT)) || col_detect(filename);
+}
 
-/* ---------- QUERY ---------- */
-// QUERY command: search by ID and display matching record
-void cmd_query(const char *args){
-    // block if no file open
-    if (g_open_filename[0] == '\0') {
-        printf("CMS: No file opened.\n");
-        return;
-    }
+int cmp_student_id(const void *a, const void *b);
 
-    int id = prompt_int("Enter student ID to search: ");
-    int idx = find_index_by_id(id);
+// Encode rows[0..n) (sorted here by ID) as one columnar file image
+int col_encode(Student *rows, int n, ColBuf *out) {
+    qsort(rows, (size_t)n, sizeof(Student), cmp_student_id);
 
-    if(idx<0){
-        printf("CMS: No record found.\n");
-        return;
+    // Programme dictionary (a handful of names: a linear search is enough)
+    const char **dict = malloc((size_t)(n ? n : 1) * sizeof(char *));
+    unsigned *code = malloc((size_t)(n ? n : 1) * sizeof(unsigned));
+    if (!dict || !code) {
+        free(dict);
+        free(code);
+        return 0;
+    }
+    int ndict = 0;
+    unsigned max_gap = 0;
+    for (int i = 0; i < n; i++) {
+        int d = 0;
+        while (d < ndict && strcmp(dict[d], rows[i].programme) != 0) d++;
+        if (d == ndict) dict[ndict++] = rows[i].programme;
+        code[i] = (unsigned)d;
+        if (i && (unsigned)(rows[i].id - rows[i - 1].id) > max_gap)
+            max_gap = (unsigned)(rows[i].id - rows[i - 1].id);
     }
 
-    Student *s=&g_students[idx];
-    printf("Record found:\n");
-    printf("ID\tName\tProgramme\tMark\n");
-    printf("%d\t%s\t%s\t%.1f\n",s->id,s->name,s->programme,s->mark);
-}
-
-/* ---------- UPDATE ---------- */
-/* ---------- YES/NO VALIDATOR ---------- */
-// Ask a Y/N or YES/NO question; returns 1 for yes, 0 for no
-int prompt_yes_no(const char *msg) {
-    char buf[16];
-    
-    while (1) {
-        printf("%s (Y/N): ", msg);  
-        if (!fgets(buf, sizeof(buf), stdin)) continue;  // Get user input
-        rstrip(buf);  // Remove trailing newline characters
-        trim(buf);    // Remove leading/trailing spaces
-
-        // Check if the input is valid: "Y", "YES", "N", or "NO"
-        if (equals_ic(buf, "Y") || equals_ic(buf, "YES")) {
-            return 1;  // Yes response
-        } else if (equals_ic(buf, "N") || equals_ic(buf, "NO")) {
-            return 0;  // No response
+    ColHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, COL_MAGIC, sizeof(h.magic));
+    h.count = n;
+    h.ndict = ndict;
+    h.id_bits = col_width(max_gap);
+    h.prog_bits = col_width(ndict ? (unsigned)ndict - 1 : 0);
+    h.first_id = n ? rows[0].id : 0;
+
+    ColBuf body = { 0 }, names = { 0 }, exc = { 0 };
+    for (int d = 0; d < ndict; d++) {
+        unsigned char len = (unsigned char)strlen(dict[d]);
+        col_put_bytes(&body, &len, 1);
+        col_put_bytes(&body, dict[d], len);
+    }
+    for (int i = 1; i < n; i++) col_put_bits(&body, (unsigned)(rows[i].id - rows[i - 1].id), h.id_bits);
+    col_align(&body);
+    for (int i = 0; i < n; i++) col_put_bits(&body, code[i], h.prog_bits);
+    col_align(&body);
+    for (int i = 0; i < n; i++) {
+        long t = lroundf(rows[i].mark * 10);
+        if (t >= 0 && t < COL_MARK_EXC && (float)(t / 10.0) == rows[i].mark) {
+            col_put_bits(&body, (unsigned)t, COL_MARK_BITS);
         } else {
-            printf("Invalid choice. Please enter Y (Yes) or N (No).\n");
+            col_put_bits(&body, COL_MARK_EXC, COL_MARK_BITS);
+            col_put_bytes(&exc, &rows[i].mark, sizeof(float));
+            h.nexcept++;
         }
     }
+    col_align(&body);
+    for (int i = 0; i < n; i++) {
+        const char *prev = i ? rows[i - 1].name : "";
+        unsigned char shared = 0, rest;
+        while (prev[shared] && prev[shared] == rows[i].name[shared] && shared < 255) shared++;
+        rest = (unsigned char)strlen(rows[i].name + shared);
+        col_put_bytes(&names, &shared, 1);
+        col_put_bytes(&names, &rest, 1);
+        col_put_bytes(&names, rows[i].name + shared, rest);
+    }
+    h.name_bytes = (int)names.len;
+
+    col_put_bytes(out, &h, sizeof(h));
+    col_put_bytes(out, body.data, body.len);
+    col_put_bytes(out, exc.data, exc.len);
+    col_put_bytes(out, names.data, names.len);
+    int ok = !body.failed && !exc.failed && !names.failed && !out->failed;
+    free(body.data);
+    free(exc.data);
+    free(names.data);
+    free(dict);
+    free(code);
+    return ok;
 }
 
-/* ---------- UPDATE (fully rewritten) ---------- */
-// UPDATE command: let admin selectively change ID, Name, Programme, Mark
-void cmd_update(const char *args) {
-    // Check if user wants to exit at the start of the function
-    if (check_exit(args)) {
-        printf("Exiting update operation.\n");
-        return;  // Exit the update operation
+// Bit reader over one column
+typedef struct {
+    const unsigned char *p, *end;
+    unsigned long long acc;
+    int nacc;
+    int failed;
+} ColBits;
+
+unsigned col_get_bits(ColBits *b, int bits) {
+    while (b->nacc < bits) {
+        if (b->p >= b->end) {
+            b->failed = 1;
+            return 0;
+        }
+        b->acc |= (unsigned long long)*b->p++ << b->nacc;
+        b->nacc += 8;
     }
+    unsigned v = (unsigned)(b->acc & ((1ULL << bits) - 1));
+    b->acc >>= bits;
+    b->nacc -= bits;
+    return v;
+}
 
-    // block if no file open
-    if (g_open_filename[0] == '\0') {
-        printf("CMS: No file opened.\n");
-        return;
-    }
+// Read a columnar file. Returns a malloc'd array of *n rows (ID order),
+// or NULL if the file cannot be read or is damaged.
+Student *col_read_file(const char *filename, int *n) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return NULL;
+    struct stat st;
+    size_t cap = fstat(fileno(fp), &st) == 0 ? (size_t)st.st_size : 0, len = 0;
+    unsigned char *data = malloc(cap ? cap : 1);
+    if (data) len = fread(data, 1, cap, fp);
+    fclose(fp);
 
-    // Prompt user for student ID to update
-    int id = prompt_student_id();
-    if (id < 0) {
-        printf("Exiting update operation.\n");
-        return;
+    ColHeader h;
+    Student *rows = NULL;
+    const char **dict = NULL;
+    unsigned char *dlen = NULL;
+    if (!data || len < sizeof(h)) goto bad;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, COL_MAGIC, 8) != 0 || h.count < 0 || h.ndict < 0 || h.ndict > h.count + 1 ||
+        h.id_bits < 0 || h.id_bits > 31 || h.prog_bits < 0 || h.prog_bits > 31 ||
+        h.nexcept < 0 || h.nexcept > h.count || h.name_bytes < 0)
+        goto bad;
+
+    rows = calloc((size_t)(h.count ? h.count : 1), sizeof(Student));
+    dict = malloc((size_t)(h.ndict ? h.ndict : 1) * sizeof(char *));
+    dlen = malloc((size_t)(h.ndict ? h.ndict : 1));
+    if (!rows || !dict || !dlen) goto bad;
+
+    const unsigned char *p = data + sizeof(h), *end = data + len;
+    for (int d = 0; d < h.ndict; d++) {
+        if (p >= end || p + 1 + *p > end) goto bad;
+        dlen[d] = *p;
+        dict[d] = (const char *)p + 1;
+        p += 1 + *p;
     }
 
-    
-    // If the user enters "quit" in some earlier input, eventually exit
-    if (check_exit(args)) {
-        printf("Exiting update operation.\n");
-        return;  // Exit the update operation immediately
+    ColBits bits = { p, end, 0, 0, 0 };
+    int id = h.first_id;
+    for (int i = 0; i < h.count; i++) {
+        if (i) id += (int)col_get_bits(&bits, h.id_bits);
+        rows[i].id = id;
+    }
+    bits.acc = 0;
+    bits.nacc = 0;
+    for (int i = 0; i < h.count; i++) {
+        unsigned c = col_get_bits(&bits, h.prog_bits);
+        if (c >= (unsigned)h.ndict) goto bad;
+        memcpy(rows[i].programme, dict[c], dlen[c] < PROG_MAX_LEN ? dlen[c] : PROG_MAX_LEN - 1);
+    }
+    // Marks; the exception floats follow the column
+    bits.acc = 0;
+    bits.nacc = 0;
+    const unsigned char *exc = bits.p + ((size_t)h.count * COL_MARK_BITS + 7) / 8;
+    if (exc + (size_t)h.nexcept * sizeof(float) > end) goto bad;
+    for (int i = 0, e = 0; i < h.count; i++) {
+        unsigned t = col_get_bits(&bits, COL_MARK_BITS);
+        if (t != COL_MARK_EXC)
+            rows[i].mark = (float)(t / 10.0);
+        else if (e < h.nexcept)
+            memcpy(&rows[i].mark, exc + (size_t)e++ * sizeof(float), sizeof(float));
+        else
+            goto bad;
+    }
+    p = exc + (size_t)h.nexcept * sizeof(float);
+    if (bits.failed || p + h.name_bytes > end) goto bad;
+
+    const char *prev = "";
+    for (int i = 0; i < h.count; i++) {
+        if (p + 2 > end) goto bad;
+        int shared = p[0], rest = p[1];
+        p += 2;
+        if (shared > (int)strlen(prev) || shared + rest >= NAME_MAX_LEN || p + rest > end) goto bad;
+        memcpy(rows[i].name, prev, (size_t)shared);
+        memcpy(rows[i].name + shared, p, (size_t)rest);
+        rows[i].name[shared + rest] = '\0';
+        p += rest;
+        prev = rows[i].name;
     }
 
-    // Find the record by ID
-    int idx = find_index_by_id(id);
+    free(dict);
+    free(dlen);
+    free(data);
+    *n = h.count;
+    return rows;
+bad:
+    free(rows);
+    free(dict);
+    free(dlen);
+    free(data);
+    return NULL;
+}
 
-    if (idx < 0) {
-        printf("CMS: No record found.\n");
-        return;  // Exit the function early if no record is found
+// Write rows[0..n) (reordered by ID) as a columnar file: "<file>.tmp",
+// synced, then renamed over the file
+int col_write(const char *filename, Student *rows, int n) {
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+    ColBuf img = { 0 };
+    int ok = col_encode(rows, n, &img);
+    FILE *fp = ok ? fopen(tmp, "wb") : NULL;
+    if (fp) {
+        ok = fwrite(img.data, 1, img.len, fp) == img.len && sync_file(fp);
+        if (fclose(fp) != 0) ok = 0;
+        if (ok) ok = replace_file(tmp, filename);
+        if (!ok) remove(tmp);
+    } else {
+        ok = 0;
     }
+    free(img.data);
+    return ok;
+}
 
-    Student *s = &g_students[idx];
+// Write t_tab as a columnar file
+int col_save(const char *filename) {
+    Student *rows = malloc((size_t)(t_tab->count ? t_tab->count : 1) * sizeof(Student));
+    if (!rows) return 0;
+    for (int i = 0; i < t_tab->count; i++) rows[i] = *row_at(i);
+    int ok = col_write(filename, rows, t_tab->count);
+    free(rows);
+    return ok;
+}
 
-    /* ----- Show record BEFORE update ----- */
-    printf("\nRecord found:\n");
-    printf("ID      : %d\n", s->id);
-    printf("Name    : %s\n", s->name);
-    printf("Programme: %s\n", s->programme);
-    printf("Mark    : %.1f\n\n", s->mark);
+// Replace t_tab's rows with a columnar file's; 0 if it cannot be read
+int col_load(const char *filename) {
+    int n = 0;
+    Student *rows = col_read_file(filename, &n);
+    if (!rows) return 0;
+    if (n > MAX_STUDENTS) n = MAX_STUDENTS;
+    for (int i = 0; i < n; i++) *row_mut(i) = rows[i];
+    t_tab->count = n;
+    free(rows);
+    return 1;
+}
 
-    Student old = *s;     // backup for undo
-    Student updated = *s; // temp copy for editing
+/* ---------- load_from_file (robust parsing) ---------- */
+// Parse the ID and mark of one line of a database file. Returns 1 for a
+// data row and points *mid / *midlen at its name and programme text,
+// which stays in 'line'; header detection is tracked in *table_started.
+int parse_record_key(char *line, Student *out, int *table_started,
+                     const char **mid, int *midlen){
+    rstrip(line);
+
+    char *raw = line;
+    trim(raw);
+
+    if(raw[0]=='\0') return 0;  // skip empty lines
+
+    /* Detect header row: look for "ID" and "MARK" */
+    if(!*table_started){
+        char up[LINE_MAX_LEN];
+        strncpy(up, raw, sizeof(up)-1);
+        up[sizeof(up)-1] = 0;
+        for(char *u=up; *u; ++u) *u = toupper((unsigned char)*u);
+        if(strstr(up,"ID") && strstr(up,"MARK")){
+            *table_started = 1;
+        }
+        return 0;
+    }
 
-    int changed = 0;      // track if anything changed
+    // Data rows must start with a digit (student ID)
+    if(!isdigit((unsigned char)raw[0])) return 0;
+
+    /* ----- Parse ID ----- */
+    int len = strlen(raw);
+    int i=0;
+    // Skip leading spaces
+    while(i<len && isspace((unsigned char)raw[i])) i++;
+    int id_start=i;
+    // Read digits for ID
+    while(i<len && isdigit((unsigned char)raw[i])) i++;
+    int id_end=i;
+
+    char idbuf[16];
+    int idlen=id_end-id_start;
+    if(idlen>=15) idlen=15;
+    memcpy(idbuf, raw+id_start, idlen);
+    idbuf[idlen]='\0';
+    int id = atoi(idbuf);
+
+    // Mid section begins after ID (where name+programme sit)
+    while(i<len && isspace((unsigned char)raw[i])) i++;
+    int mid_start=i;
+
+    /* ----- Parse mark from right ----- */
+    int j=len-1;
+    // Move left, skipping spaces
+    while(j>=0 && isspace((unsigned char)raw[j])) j--;
+    int mark_end=j+1;
+
+    int mark_start=j;
+    // Move left until we go past digits and optional decimal point
+    while(mark_start>=0 &&
+          (isdigit((unsigned char)raw[mark_start]) || raw[mark_start]=='.'))
+        mark_start--;
+    mark_start++;
+
+    char markbuf[16];
+    int marklen = mark_end - mark_start;
+    if(marklen>=15) marklen=15;
+    memcpy(markbuf, raw+mark_start, marklen);
+    markbuf[marklen]='\0';
+    float mark = atof(markbuf);  // convert substring to float
+
+    out->id=id;
+    out->mark=mark;
+    *mid = raw+mid_start;
+    *midlen = mark_start > mid_start ? mark_start-mid_start : 0;
+    return 1;
+}
 
-    /* ===========================
-       UPDATE STUDENT ID
-       =========================== */
-    if (prompt_yes_no("Do you want to update the student ID?")) {
+// Copy the name + programme text of a line into 'middle', trimmed
+void record_middle(const char *mid, int midlen, char *middle){
+    if(midlen>=LINE_MAX_LEN) midlen=LINE_MAX_LEN-1;
+    memcpy(middle, mid, midlen);
+    middle[midlen]='\0';
+    trim(middle);
+}
 
-        int newID;
+// Where the programme starts in a trimmed name + programme text. *sep
+// is set to the first run of 2+ spaces, which ends the name, or to -1
+// if there is none (then the name is the first two words).
+int record_prog_start(const char *middle, int *sep){
+    *sep=-1;
+    for(int k=0; middle[k] && middle[k+1]; ++k){
+        if(middle[k]==' ' && middle[k+1]==' '){
+            *sep=k;
+            break;
+        }
+    }
+    int p = *sep>=0 ? *sep : 0;
+    for(int w=0; *sep<0 && w<2; w++){   // skip the two name words
+        while(middle[p] && isspace((unsigned char)middle[p])) p++;
+        while(middle[p] && !isspace((unsigned char)middle[p])) p++;
+    }
+    while(middle[p] && isspace((unsigned char)middle[p])) p++;
+    return p;
+}
+
+// Only the programme of a line's name + programme text (for callers that
+// need no name, so a lazily loaded row can stay undecoded)
+void parse_record_programme(const char *mid, int midlen, char *prog){
+    char middle[LINE_MAX_LEN];
+    record_middle(mid, midlen, middle);
+    int sep;
+    strncpy(prog, middle + record_prog_start(middle, &sep), PROG_MAX_LEN-1);
+    prog[PROG_MAX_LEN-1]='\0';
+    trim(prog);
+}
+
+// Split the name and programme text of a line (from parse_record_key)
+// into 'out'
+void parse_record_text(const char *mid, int midlen, Student *out){
+    /* ----- Middle (Name + Programme) ----- */
+    char middle[LINE_MAX_LEN];
+    record_middle(mid, midlen, middle);
+
+    char name[NAME_MAX_LEN]="";
+    char prog[PROG_MAX_LEN]="";
+
+    /* Programme: after the first 2+ spaces, or else after two words */
+    int sep;
+    int pstart=record_prog_start(middle, &sep);
+    strncpy(prog, middle+pstart, PROG_MAX_LEN-1);
+    prog[PROG_MAX_LEN-1] = '\0';
+
+    if(sep>=0){
+        // Split on the first "double space" region
+        int nlen=sep;
+        while(nlen>0 && isspace((unsigned char)middle[nlen-1])) nlen--;
+        if(nlen>NAME_MAX_LEN-1) nlen=NAME_MAX_LEN-1;
+        memcpy(name, middle, nlen);
+        name[nlen]='\0';
+    } else {
+        /* Fallback: assume first two words = name, rest = programme */
+        char tmp[LINE_MAX_LEN];
+        strncpy(tmp, middle, sizeof(tmp)-1);
+        tmp[sizeof(tmp)-1] = 0;
+
+        char *p=tmp;
+        while(*p && isspace((unsigned char)*p)) p++;
+        char *w1=p;                         // first word of name
+        while(*p && !isspace((unsigned char)*p)) p++;
+        if(*p) *p++='\0';
+
+        while(*p && isspace((unsigned char)*p)) p++;
+        char *w2=p;                         // second word of name
+        while(*p && !isspace((unsigned char)*p)) p++;
+        if(*p) *p++='\0';
+
+        snprintf(name, sizeof(name), "%s %s", w1, w2);
+    }
+
+    trim(name);
+    trim(prog);
+
+    strncpy(out->name,name,NAME_MAX_LEN-1);
+    out->name[NAME_MAX_LEN-1]=0;
+    strncpy(out->programme,prog,PROG_MAX_LEN-1);
+    out->programme[PROG_MAX_LEN-1]=0;
+}
+
+// Parse one line of a database file. Returns 1 and fills 'out' for a data
+// row; header detection is tracked in *table_started.
+int parse_record_line(char *line, Student *out, int *table_started){
+    const char *mid;
+    int midlen;
+    if(!parse_record_key(line, out, table_started, &mid, &midlen)) return 0;
+    parse_record_text(mid, midlen, out);
+    return 1;
+}
+
+// Text buffer for the rows one OPEN loads (NULL if out of memory)
+LazyBuf *lazy_buf_new(void){
+    LazyBuf *b = calloc(1, sizeof(LazyBuf));
+    if(b) pthread_mutex_init(&b->lock, NULL);
+    return b;
+}
+
+// Store record i of t_tab with only its ID and mark parsed; its name and
+// programme text is kept in 'b' until a command reads it. Returns 0 if
+// out of memory (the caller then stores the row decoded).
+int load_row_lazy(int i, const Student *s, LazyBuf *b, const char *mid, int midlen){
+    if(b->len + (size_t)midlen > b->cap){
+        size_t ncap = b->cap ? b->cap : 4096;
+        while(ncap < b->len + (size_t)midlen) ncap *= 2;
+        char *nd = realloc(b->data, ncap);
+        if(!nd) return 0;
+        b->data = nd;
+        b->cap = ncap;
+    }
+
+    RecordPage *pg = page_mut(i);
+    if(pg->lazy && pg->lazy->buf != b) lazy_page_drop(pg);
+    if(!pg->lazy){
+        LazyPage *lz = malloc(sizeof(LazyPage));
+        if(!lz) return 0;
+        lz->buf = b;
+        for(int k=0; k<PAGE_ROWS; k++) atomic_init(&lz->done[k], 1);
+        b->refs++;
+        pg->lazy = lz;
+    }
+
+    int k = i % PAGE_ROWS;
+    Student *row = &pg->rows[k];
+    row->id = s->id;
+    row->mark = s->mark;
+    row->name[0] = row->programme[0] = '\0';
+    pg->lazy->off[k] = (unsigned)b->len;
+    pg->lazy->len[k] = (unsigned short)midlen;
+    atomic_store_explicit(&pg->lazy->done[k], 0, memory_order_relaxed);
+    memcpy(b->data + b->len, mid, (size_t)midlen);
+    b->len += (size_t)midlen;
+    return 1;
+}
+
+void table_clear(void);
+
+/* ---------- OPEN cache (change detection) ---------- */
+// Fingerprint and parsed rows of the last file loaded. Loading the same
+// file again only re-hashes the part already parsed: if it is unchanged
+// the cached rows are reused and only lines appended since are parsed.
+// Writers only (the pages' refs are writer-owned).
+typedef struct {
+    char               filename[260];
+    long long          size;            // file size at the last load
+    unsigned long long hash;            // FNV-1a of bytes [0, parsed_to)
+    long               parsed_to;       // offset just past the last full line
+    int                count;           // rows parsed from [0, parsed_to)
+    int                table_started;   // header row seen before parsed_to
+    RecordPage        *pages[MAX_PAGES];
+} LoadCache;
+
+LoadCache g_load_cache;
+
+#define FNV_OFFSET 1469598103934665603ULL
+#define FNV_PRIME  1099511628211ULL
+
+// FNV-1a over a block of bytes, continuing from 'h'
+unsigned long long fnv1a(unsigned long long h, const void *data, size_t n){
+    const unsigned char *p = data;
+    for(size_t i=0; i<n; i++){
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+// Point the working version at the cached pages (sharing them)
+void load_cache_restore(void){
+    for(int p=0; p<MAX_PAGES; p++){
+        page_release(t_tab->pages[p]);
+        t_tab->pages[p] = g_load_cache.pages[p];
+        page_ref(t_tab->pages[p]);
+    }
+    t_tab->count = g_load_cache.count;
+}
+
+// Remember the working version's pages as the parse of 'filename'
+void load_cache_store(const char *filename, long long size, unsigned long long hash,
+                      long parsed_to, int count, int table_started){
+    for(int p=0; p<MAX_PAGES; p++){
+        RecordPage *old = g_load_cache.pages[p];
+        g_load_cache.pages[p] = t_tab->pages[p];
+        page_ref(g_load_cache.pages[p]);
+        page_release(old);
+    }
+    strncpy(g_load_cache.filename, filename, sizeof(g_load_cache.filename)-1);
+    g_load_cache.filename[sizeof(g_load_cache.filename)-1] = '\0';
+    g_load_cache.size = size;
+    g_load_cache.hash = hash;
+    g_load_cache.parsed_to = parsed_to;
+    g_load_cache.count = count;
+    g_load_cache.table_started = table_started;
+}
+
+// Can the cached parse be reused for 'r'? Hashes the cached prefix of
+// the file; on success 'r' is left positioned just after it.
+int load_cache_matches(FileReader *r, const char *filename, long long size){
+    if(strcmp(g_load_cache.filename, filename) != 0) return 0;
+    if(size < g_load_cache.parsed_to) return 0;   // shrank: rewritten
+
+    unsigned char buf[8192];
+    unsigned long long h = FNV_OFFSET;
+    long left = g_load_cache.parsed_to;
+    while(left > 0){
+        size_t want = left < (long)sizeof(buf) ? (size_t)left : sizeof(buf);
+        size_t got = reader_read(r, buf, want);
+        if(got != want) return 0;
+        h = fnv1a(h, buf, got);
+        left -= (long)got;
+    }
+    return h == g_load_cache.hash;
+}
+
+// Load student records from text file into the table. An unchanged file
+// reuses the previous parse; a file that was only appended to has just
+// its new lines parsed.
+int load_from_file(const char *filename){
+    if(col_detect(filename)) return col_load(filename);
+    FileReader r;
+    if(!reader_open(&r, filename)) return 0;
+    long long size = r.size;
+
+    unsigned long long hash = FNV_OFFSET;
+    long parsed_to = 0;
+    int table_started = 0;   // 0 until we see the header row
+
+    if(size >= 0 && load_cache_matches(&r, filename, size)){
+        load_cache_restore();
+        hash = g_load_cache.hash;
+        parsed_to = g_load_cache.parsed_to;
+        table_started = g_load_cache.table_started;
+        if(size == g_load_cache.size && size == parsed_to){
+            reader_close(&r);   // unchanged: nothing to parse
+            return 1;
+        }
+    } else {
+        reader_close(&r);   // start over from the top
+        if(!reader_open(&r, filename)) return 0;
+        table_clear();
+    }
+
+    // State at the last complete line, where a later append resumes
+    char line[LINE_MAX_LEN];
+    long offset = parsed_to;
+    unsigned long long boundary_hash = hash;
+    int boundary_count = t_tab->count;
+    int boundary_started = table_started;
+
+    // Names and programmes are split out when first read, not here
+    LazyBuf *text = lazy_buf_new();
+
+    while(reader_gets(&r, line, sizeof(line))){
+        size_t n = strlen(line);
+        int complete = n > 0 && line[n-1] == '\n';
+        hash = fnv1a(hash, line, n);
+        offset += (long)n;
+
+        Student s;
+        const char *mid;
+        int midlen;
+        // Only store if we still have space in the array
+        if(parse_record_key(line, &s, &table_started, &mid, &midlen) && t_tab->count < MAX_STUDENTS){
+            if(!text || !load_row_lazy(t_tab->count, &s, text, mid, midlen)){
+                parse_record_text(mid, midlen, &s);
+                *row_mut(t_tab->count) = s;
+            }
+            t_tab->count++;
+        }
+
+        if(complete){
+            parsed_to = offset;
+            boundary_hash = hash;
+            boundary_count = t_tab->count;
+            boundary_started = table_started;
+        }
+    }
+
+    reader_close(&r);
+    if(text && text->refs == 0){
+        pthread_mutex_destroy(&text->lock);
+        free(text->data);
+        free(text);
+    } else if(text && text->len < text->cap){
+        char *nd = realloc(text->data, text->len ? text->len : 1);
+        if(nd) text->data = nd;
+        text->cap = text->len;
+    }
+    if(size >= 0)
+        load_cache_store(filename, size, boundary_hash, parsed_to, boundary_count, boundary_started);
+    return 1;
+}
+
+/* ---------- SAVE ---------- */
+// Rows written so far by the save in progress (for SAVE STATUS)
+atomic_int g_save_rows_done;
+
+// Header lines every database file starts with
+void write_db_header(FileWriter *w){
+    writer_printf(w,"Database Name: StudentRecords\nAuthors: Team\n\n");
+    writer_printf(w,"Table Name: StudentRecords\n");
+    writer_printf(w,"%s",TSV_HEAD);
+}
+
+// One record line of a database file
+void write_db_row(FileWriter *w, const Student *s){
+    writer_printf(w,TSV_ROW_FMT STUDENT_COLUMNS(COLUMN_ARG));
+}
+
+// Write all records of t_tab into the given file. The rows go to
+// "<file>.tmp" in large buffered writes, are synced to disk, and only then
+// renamed over the file, so a crash never leaves a half-written database.
+int save_to_file(const char *filename){
+    if(col_wanted(filename)){
+        int ok = col_save(filename);
+        atomic_store(&g_save_rows_done, t_tab->count);
+        return ok;
+    }
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+    FileWriter w;
+    if(!writer_open(&w, tmp)) return 0;
+
+    write_db_header(&w);
+
+    atomic_store(&g_save_rows_done, 0);
+    for(int i=0;i<t_tab->count && !w.failed;i++){
+        write_db_row(&w, row_at(i));
+        if((i & 255) == 255) atomic_store(&g_save_rows_done, i + 1);
+    }
+    atomic_store(&g_save_rows_done, t_tab->count);
+
+    int ok = writer_close(&w);
+    if(ok) ok = replace_file(tmp, filename);
+    if(!ok) remove(tmp);
+    return ok;
+}
+
+/* ---------- SHARED BINARY SNAPSHOT ---------- */
+// SAVE also writes "<file>.snap": the records laid out exactly as in-memory
+// RecordPages. Student sessions map it read-only instead of parsing the
+// text file, so every session shares one set of physical pages.
+#define SNAP_MAGIC       "CMSSNAP2"
+#define SNAP_HEADER_SIZE 64            // pages start here
+
+typedef struct {
+    char      magic[8];       // SNAP_MAGIC
+    int       student_size;   // sizeof(Student), guards against layout changes
+    int       page_size;      // sizeof(RecordPage)
+    int       count;          // number of records
+    int       npages;         // number of pages that follow the header
+    long long src_size;       // size of the text file it was built from
+    unsigned long long src_hash;   // FNV-1a of that text file's bytes
+} SnapHeader;
+
+// Build the snapshot file name for a database file
+void snapshot_path(const char *filename, char *out, size_t outsz) {
+    snprintf(out, outsz, "%s.snap", filename);
+}
+
+// Size and FNV-1a content hash of a file; returns 0 if it cannot be read.
+// The hash, not the mtime (whole seconds), tells whether a file changed.
+int file_fingerprint(const char *filename, long long *size, unsigned long long *hash) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return 0;
+    unsigned char buf[65536];
+    unsigned long long h = FNV_OFFSET;
+    long long n = 0;
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        h = fnv1a(h, buf, got);
+        n += (long long)got;
+    }
+    int ok = !ferror(fp);
+    fclose(fp);
+    *size = n;
+    *hash = h;
+    return ok;
+}
+
+// Write the snapshot of t_tab for a text file that was just saved.
+// Written to a temporary file and renamed, so readers never see half of it.
+int save_snapshot(const char *filename) {
+    long long size;
+    unsigned long long hash;
+    if (!file_fingerprint(filename, &size, &hash)) return 0;
+
+    char path[300], tmp[310];
+    snapshot_path(filename, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+
+    char head[SNAP_HEADER_SIZE];
+    SnapHeader h;
+    memset(head, 0, sizeof(head));
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, sizeof(h.magic));
+    h.student_size = (int)sizeof(Student);
+    h.page_size = (int)sizeof(RecordPage);
+    h.count = t_tab->count;
+    h.npages = (t_tab->count + PAGE_ROWS - 1) / PAGE_ROWS;
+    h.src_size = size;
+    h.src_hash = hash;
+    memcpy(head, &h, sizeof(h));
+    int ok = fwrite(head, sizeof(head), 1, fp) == 1;
+
+    RecordPage *page = calloc(1, sizeof(RecordPage));
+    if (!page) ok = 0;
+    for (int p = 0; ok && p < h.npages; p++) {
+        int n = t_tab->count - p * PAGE_ROWS;
+        if (n > PAGE_ROWS) n = PAGE_ROWS;
+        memset(page, 0, sizeof(RecordPage));
+        page->refs = PAGE_MAPPED;
+        lazy_page_ready(t_tab->pages[p]);
+        memcpy(page->rows, t_tab->pages[p]->rows, (size_t)n * sizeof(Student));
+        ok = fwrite(page, sizeof(RecordPage), 1, fp) == 1;
+    }
+    free(page);
+
+    if (fclose(fp) != 0) ok = 0;
+    if (ok) ok = replace_file(tmp, path);
+    if (!ok) remove(tmp);
+    return ok;
+}
+
+// Use the snapshot of a text file as t_tab's records, if it is up to date.
+// Returns 1 on success, 0 if the caller should parse the text file.
+int load_snapshot(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) return 0;
+
+    char path[300];
+    snapshot_path(filename, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    SnapHeader h;
+    int ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+             memcmp(h.magic, SNAP_MAGIC, sizeof(h.magic)) == 0 &&
+             h.student_size == (int)sizeof(Student) &&
+             h.page_size == (int)sizeof(RecordPage) &&
+             h.count >= 0 && h.npages == (h.count + PAGE_ROWS - 1) / PAGE_ROWS &&
+             h.npages <= MAX_PAGES &&
+             h.src_size == (long long)st.st_size;   // cheap check before hashing
+    long long size;
+    unsigned long long hash;
+    if (ok) ok = file_fingerprint(filename, &size, &hash) &&   // text changed since SAVE?
+                 size == h.src_size && hash == h.src_hash;
+    if (!ok) {
+        fclose(fp);
+        return 0;
+    }
+
+    SnapMap *m = calloc(1, sizeof(SnapMap));
+    if (!m) {
+        fclose(fp);
+        return 0;
+    }
+    size_t bytes = (size_t)h.npages * sizeof(RecordPage);
+    RecordPage *pages = NULL;
+#ifndef _WIN32
+    // Read-only mapping: the pages stay shared with every other session.
+    // Nothing writes to them; page_mut copies a page before a change.
+    // A truncated .snap is not mapped (its missing pages would fault on
+    // first use); the fread below then finds it short and we parse.
+    struct stat ss;
+    if (bytes && fstat(fileno(fp), &ss) == 0 &&
+        (unsigned long long)ss.st_size >= SNAP_HEADER_SIZE + bytes) {
+        void *map = mmap(NULL, SNAP_HEADER_SIZE + bytes, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        if (map != MAP_FAILED) {
+            m->base = map;
+            m->len = SNAP_HEADER_SIZE + bytes;
+            m->mapped = 1;
+            pages = (RecordPage *)((char *)map + SNAP_HEADER_SIZE);
+        }
+    }
+#endif
+    if (bytes && !pages) {
+        // No mmap: read the pages in one go (still no parsing)
+        pages = malloc(bytes);
+        if (!pages || fseek(fp, SNAP_HEADER_SIZE, SEEK_SET) != 0 ||
+            fread(pages, sizeof(RecordPage), (size_t)h.npages, fp) != (size_t)h.npages) {
+            free(pages);
+            free(m);
+            fclose(fp);
+            return 0;
+        }
+        m->base = (char *)pages;
+        m->len = bytes;
+    }
+    fclose(fp);
+
+    // Every page must carry the mapped marker; anything else is not ours
+    for (int p = 0; p < h.npages; p++)
+        if (pages[p].refs != PAGE_MAPPED || pages[p].lazy) ok = 0;
+    if (!ok) {
+#ifndef _WIN32
+        if (m->mapped) munmap(m->base, m->len);
+        else
+#endif
+            free(m->base);
+        free(m);
+        return 0;
+    }
+
+    if (bytes) {
+        m->next = g_snap_maps;
+        g_snap_maps = m;
+    } else {
+        free(m);
+    }
+    for (int p = 0; p < MAX_PAGES; p++) {
+        page_release(t_tab->pages[p]);
+        t_tab->pages[p] = p < h.npages ? &pages[p] : NULL;
+        page_ref(t_tab->pages[p]);
+    }
+    t_tab->count = h.count;
+    return 1;
+}
+
+/* ---------- BACKGROUND PREFETCH (console student sessions) ---------- */
+// The default DB is loaded on a background thread while the user types
+// their username and password. The thread keeps the writer lock and its
+// unpublished version until login decides the role: a student gets the
+// loaded table, an admin starts empty as before. Anything the load prints
+// is held back and shown once the first command needs the data.
+typedef struct {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             started;   // prefetch thread running
+    int             role;      // -1 = login pending, 0 = student, 1 = admin
+    int             done;      // table published (or dropped)
+    int             reported;  // held-back output already shown
+    FILE           *out;       // output of the load, shown later
+} Prefetch;
+
+Prefetch g_prefetch = { .lock = PTHREAD_MUTEX_INITIALIZER,
+                        .cond = PTHREAD_COND_INITIALIZER, .role = -1 };
+
+// Prefetch thread: load the default DB, then publish or drop it by role
+void *prefetch_main(void *arg) {
+    (void)arg;
+    t_out = g_prefetch.out;
+    int have = table_write_begin();
+    if (have) {
+        if (load_snapshot(DEFAULT_STUDENT_DB)) {
+            // Shared snapshot written by the last admin SAVE: no parsing
+            cms_printf("CMS: P10_6-CMS loaded successfully (%d records).\n", t_tab->count);
+        } else if (!load_from_file(DEFAULT_STUDENT_DB)) {
+            cms_printf("CMS: Auto-load failed. Creating new DB on SAVE.\n");
+        } else {
+            cms_printf("CMS: P10_6-CMS loaded successfully (%d records).\n", t_tab->count);
+        }
+        strncpy(t_tab->filename, DEFAULT_STUDENT_DB, sizeof(t_tab->filename)-1);
+        t_tab->filename[sizeof(t_tab->filename)-1] = '\0';
+    }
+
+    pthread_mutex_lock(&g_prefetch.lock);
+    while (g_prefetch.role < 0) pthread_cond_wait(&g_prefetch.cond, &g_prefetch.lock);
+    int admin = g_prefetch.role == 1;
+    pthread_mutex_unlock(&g_prefetch.lock);
+
+    if (have) {
+        if (admin) table_write_abort();   // admins start with no file open
+        else table_write_end();
+    }
+
+    pthread_mutex_lock(&g_prefetch.lock);
+    g_prefetch.done = 1;
+    pthread_cond_broadcast(&g_prefetch.cond);
+    pthread_mutex_unlock(&g_prefetch.lock);
+    return NULL;
+}
+
+// Start loading the default DB in the background (call after table_init)
+void prefetch_start(void) {
+    g_prefetch.out = tmpfile();
+    if (!g_prefetch.out) return;   // no place for its output: load after login
+    if (pthread_create(&g_prefetch.thread, NULL, prefetch_main, NULL) != 0) {
+        fclose(g_prefetch.out);
+        g_prefetch.out = NULL;
+        return;
+    }
+    g_prefetch.started = 1;
+}
+
+// Tell the prefetch thread who logged in. Returns 0 if no prefetch is
+// running (the caller loads the table itself).
+int prefetch_set_role(int is_admin) {
+    if (!g_prefetch.started) return 0;
+    pthread_mutex_lock(&g_prefetch.lock);
+    g_prefetch.role = is_admin ? 1 : 0;
+    pthread_cond_broadcast(&g_prefetch.cond);
+    pthread_mutex_unlock(&g_prefetch.lock);
+    return 1;
+}
+
+// Finish the prefetch: wait for it if 'block', then show what the load
+// printed (students only, if 'show'). Returns 0 if it is still running.
+int prefetch_finish(int block, int show) {
+    if (!g_prefetch.started || g_prefetch.reported) return 1;
+    pthread_mutex_lock(&g_prefetch.lock);
+    while (block && !g_prefetch.done) pthread_cond_wait(&g_prefetch.cond, &g_prefetch.lock);
+    int done = g_prefetch.done;
+    pthread_mutex_unlock(&g_prefetch.lock);
+    if (!done) return 0;
+
+    pthread_join(g_prefetch.thread, NULL);
+    if (show && g_prefetch.role == 0) {
+        char buf[512];
+        size_t n;
+        rewind(g_prefetch.out);
+        while ((n = fread(buf, 1, sizeof(buf), g_prefetch.out)) > 0)
+            fwrite(buf, 1, n, stdout);
+    }
+    fclose(g_prefetch.out);
+    g_prefetch.out = NULL;
+    g_prefetch.reported = 1;
+    return 1;
+}
+
+/* ===================== COMMANDS ===================== */
+// Print full help menu for admin users
+void show_help(void){
+    cms_printf("\n--------------------------------------------------------------------------------");
+    cms_printf("\nAvailable Commands:\n");
+    cms_printf("\n                 ---File Operations---                           \n");
+    cms_printf("  OPEN <filename>              -> open the database file and read in all records\n");
+    cms_printf("  OPEN <filename> AS <name>    -> open it as a named table (others stay open)\n");
+    cms_printf("  USE <name>                   -> switch to another open table\n");
+    cms_printf("  SHOW TABLES                  -> list the open tables\n");
+    cms_printf("  SET CACHE <KB>               -> memory for tables not in use (least recent go to disk)\n");
+    cms_printf("  MERGE <file> ... INTO <out> [KEEP FIRST|LAST|HIGHEST|LOWEST]\n");
+    cms_printf("                               -> merge database files by ID (duplicates: KEEP rule);\n");
+    cms_printf("                                  <out> is text; rename it to .cmsc, OPEN and SAVE to compress\n");
+    cms_printf("  DIFF <a> [<b>] [INTO <script>]\n");
+    cms_printf("                               -> records inserted/deleted/modified from file a to b\n");
+    cms_printf("                                  (or to the table); INTO writes them as commands\n");
+    cms_printf("  EXPORT <file> FORMAT CSV|JSONL|FIXED [WHERE <condition>] [SORT BY ...]\n");
+    cms_printf("                               -> write the (matching) records for other tools\n");
+    cms_printf("\n                 ---Display Operations---                    \n");
+    cms_printf("  SHOW ALL                     -> display all current records in memory\n");
+    cms_printf("  SHOW ALL SORT BY ID ASC      -> sort by student ID (ascending)\n");
+    cms_printf("  SHOW ALL SORT BY ID DESC     -> sort by student ID (descending)\n");
+    cms_printf("  SHOW ALL SORT BY MARK ASC    -> sort by mark (ascending)\n");
+    cms_printf("  SHOW ALL SORT BY MARK DESC   -> sort by mark (descending)\n");
+    cms_printf("  SHOW ALL WHERE <condition>   -> show matching records (optionally add SORT BY)\n");
+    cms_printf("      e.g. SHOW ALL WHERE mark >= 70 AND programme = \"Nursing\" SORT BY MARK DESC\n");
+    cms_printf("      (columns: ID NAME PROGRAMME MARK; = != < <= > >= STARTS; AND OR NOT ( ))\n");
+    cms_printf("  SHOW SUMMARY                 -> show total, average mark, highest & lowest\n");
+    cms_printf("\n                 ---Record Operations---                    \n");
+    cms_printf("  INSERT                       -> insert a new record (prompts every column)\n");
+    cms_printf("  QUERY ID=<n>                 -> search for a record with a given student ID (and its rank)\n");
+    cms_printf("  QUERY RANK <k>               -> show the student ranked k-th by mark\n");
+    cms_printf("  FIND DUPLICATES [THRESHOLD x]\n");
+    cms_printf("                               -> pairs of records whose names look alike (x: 0-1)\n");
+    cms_printf("  UPDATE ID=<n>                -> update the data (prompts every column; Enter keeps)\n");
+    cms_printf("  DELETE ID=<n>                -> delete the record (double confirm)\n");
+    cms_printf("  UPDATE SET <col>=<value>[, ...] WHERE <condition>\n");
+    cms_printf("                               -> update all matching records at once\n");
+    cms_printf("      e.g. UPDATE SET mark = min(mark+5,100) WHERE programme = \"Digital Supply Chain\"\n");
+    cms_printf("  DELETE WHERE <condition>     -> delete all matching records at once\n");
+    cms_printf("      e.g. DELETE WHERE id STARTS 2201\n");
+    cms_printf("  SAVE                         -> save all records to the file (in the background)\n");
+    cms_printf("  SAVE STATUS                  -> show save progress and whether changes are unsaved\n");
+    cms_printf("  AUTOSAVE <seconds> | OFF     -> save unsaved changes every few seconds\n");
+    cms_printf("  SET IO URING | STDIO         -> read/write files with io_uring (Linux) or stdio\n");
+    cms_printf("  SET THREADS <n> | AUTO       -> threads for parallel sorts and summaries\n");
+    cms_printf("\n                 ---Archive (on-disk, any size)---                \n");
+    cms_printf("  ARCHIVE OPEN <file>          -> open or create an archive file\n");
+    cms_printf("  ARCHIVE LOAD <textfile>      -> stream a database file into the archive\n");
+    cms_printf("  ARCHIVE QUERY ID=<n>         -> look up one archived record\n");
+    cms_printf("  ARCHIVE SHOW ALL             -> list the archive in ID order\n");
+    cms_printf("  ARCHIVE INSERT | UPDATE ID=<n> | DELETE ID=<n>\n");
+    cms_printf("  ARCHIVE STATS | CLOSE        -> archive size and buffer pool use / close it\n");
+    cms_printf("  SET POOL <pages>             -> archive buffer pool size (4 KB pages)\n");
+    cms_printf("  UNDO                         -> undo the last INSERT, UPDATE, or DELETE (bulk: whole batch)\n");
+    cms_printf("  SNAPSHOT                     -> keep reading the current table version\n");
+    cms_printf("  RELEASE                      -> release the snapshot and read the latest data\n");   
+    cms_printf("  WATCH ON | WATCH OFF         -> pick up changes other programs make to the file\n");
+    cms_printf("  CDC ON <log> | OFF           -> append every committed change to a log (NDJSON)\n");
+    cms_printf("  CDC SERVE <socket> | STATUS  -> stream the log to consumers (they send FROM <seq>)\n");
+    cms_printf("  STATS                        -> table version, change log and replication lag\n");
+    cms_printf("\n                      ---General---                           \n");
+    cms_printf("  HELP                         -> show this help menu\n");
+    cms_printf("  EXIT                         -> quit the program\n");
+    cms_printf("--------------------------------------------------------------------------------\n");
+}
+
+// Shorter help menu for student users (read-only view)
+void show_help_student(void){
+    cms_printf("\n--------------------------------------------------------------------------------");
+    cms_printf("\nAvailable Commands (Student Access Only):\n");   
+    cms_printf("\n                 ---Display Operations---                    \n");
+    cms_printf("  SHOW ALL                     -> display all current records in memory\n");
+    cms_printf("  SHOW ALL SORT BY ID ASC      -> sort by student ID (ascending)\n");
+    cms_printf("  SHOW ALL SORT BY ID DESC     -> sort by student ID (descending)\n");
+    cms_printf("  SHOW ALL SORT BY MARK ASC    -> sort by mark (ascending)\n");
+    cms_printf("  SHOW ALL SORT BY MARK DESC   -> sort by mark (descending)\n");
+    cms_printf("  SHOW ALL WHERE <condition>   -> show matching records (optionally add SORT BY)\n");
+    cms_printf("      e.g. SHOW ALL WHERE mark >= 70 AND programme = \"Nursing\" SORT BY MARK DESC\n");
+    cms_printf("  SHOW SUMMARY                 -> show total, average, highest & lowest marks\n");
+    cms_printf("\n                     ---Search---                           \n");
+    cms_printf("  QUERY ID=<n>                 -> search for a specific student record (and its rank)\n");
+    cms_printf("  QUERY RANK <k>               -> show the student ranked k-th by mark\n");
+    cms_printf("  FIND DUPLICATES [THRESHOLD x]\n");
+    cms_printf("                               -> pairs of records whose names look alike (x: 0-1)\n");
+    cms_printf("  SNAPSHOT                     -> keep a consistent view for a multi-command report\n");
+    cms_printf("  RELEASE                      -> release the snapshot and read the latest data\n");   
+    cms_printf("  ARCHIVE QUERY ID=<n>         -> look up a record in the open archive\n");
+    cms_printf("  ARCHIVE SHOW ALL | STATS     -> list the archive / show its size\n");
+    cms_printf("  STATS                        -> table version and, on a replica, replication lag\n");
+    cms_printf("\n                     ---General---                           \n");
+    cms_printf("  HELP                         -> show this help menu\n");
+    cms_printf("  EXIT                         -> quit the program\n");
+    cms_printf("--------------------------------------------------------------------------------\n");
+}
+
+/* ---------- OPEN ---------- */
+// The table matches its file again (defined with WATCH / SAVE below)
+void watch_rebase(void);
+void watch_switch(void);
+void saver_mark_clean(unsigned long version);
+// Catalog of open tables (defined below)
+#define CATALOG_NAME_LEN 32
+void catalog_default_name(const char *filename, char *out, size_t outsz);
+int catalog_switch_to(const char *name, const char *filename);
+
+// Handle OPEN <filename> command (admin only)
+void cmd_open(const char *args){
+    char fname[260]="";
+
+    // Skip spaces before filename
+    while(*args && isspace((unsigned char)*args)) args++;
+
+    // Read filename until next space / end-of-line
+    size_t i=0;
+    while(*args && !isspace((unsigned char)*args) && i<sizeof(fname)-1)
+        fname[i++]=*args++;
+    fname[i]='\0';
+    
+    if(fname[0]=='\0'){
+        cms_printf("CMS: Please provide a filename.\n");
+        return;
+    }
+
+    // Optional: AS <name> (default: the file name without its extension)
+    char name[CATALOG_NAME_LEN]="";
+    while(*args && isspace((unsigned char)*args)) args++;
+    if(starts_with_ic(args,"AS") && isspace((unsigned char)args[2])){
+        args+=2;
+        while(*args && isspace((unsigned char)*args)) args++;
+        i=0;
+        while(*args && !isspace((unsigned char)*args) && i<sizeof(name)-1)
+            name[i++]=*args++;
+        name[i]='\0';
+    } else if(*args=='\0'){
+        catalog_default_name(fname, name, sizeof(name));
+    }
+    if(name[0]=='\0'){
+        cms_printf("CMS: Use OPEN <filename> [AS <name>].\n");
+        return;
+    }
+
+    // A different table is open: keep it in the catalog, start this one empty
+    int switched = catalog_switch_to(name, fname);
+    if(switched < 0){
+        cms_printf("CMS: Too many open tables; cannot open \"%s\".\n", fname);
+        return;
+    }
+
+    // Try to load file; if fail, remember filename and create new file on SAVE
+    if(!load_from_file(fname)){
+        strncpy(t_tab->filename,fname,sizeof(t_tab->filename)-1);
+        t_tab->filename[sizeof(t_tab->filename)-1]='\0';
+        cdc_record_open();
+        cms_printf("CMS: File not found — will create new on SAVE.\n"); 
+        return;
+    }
+
+    strncpy(t_tab->filename,fname,sizeof(t_tab->filename)-1);
+    t_tab->filename[sizeof(t_tab->filename)-1]='\0';
+    cdc_record_open();
+    watch_rebase();
+    saver_mark_clean(t_tab->number);
+    cms_printf("CMS: The database file \"%s\" is successfully opened. (%d records loaded)\n",
+           fname, t_tab->count);
+    if(switched)
+        cms_printf("CMS: Opened as table \"%s\" (SHOW TABLES lists the open tables).\n", name);
+}
+
+/* ---------- SHOW ALL ---------- */
+// Print the SHOW ALL column headings
+void print_header(void){
+    cms_printf(SHOW_HEAD_FMT STUDENT_COLUMNS(COLUMN_HEAD));
+}
+
+// Print one row in the SHOW ALL table layout
+void print_row(const Student *s){
+    cms_printf(SHOW_ROW_FMT STUDENT_COLUMNS(COLUMN_ARG));
+}
+
+// Print one record as a heading line and a tab-separated line (QUERY)
+void print_record(const Student *s){
+    cms_printf("%s", TSV_HEAD);
+    cms_printf(TSV_ROW_FMT STUDENT_COLUMNS(COLUMN_ARG));
+}
+
+// Handle SHOW ALL (with optional WHERE ... and SORT BY ...) for displaying records
+void cmd_show_all(const char *args){
+    if(t_tab->count==0){
+        cms_printf("CMS: No records loaded.\n");
+        return;
+    }
+
+    // Parse WHERE / SORT BY (a plain SORT BY reorders the table here)
+    Filter f;
+    if(!handle_sort(args, &f)) return;
+
+    if(f.len == 0 && f.sort_field == 0){
+        cms_printf("CMS: Here are all the records.\n");
+        print_header();
+
+        for(int i=0;i<t_tab->count;i++)
+            print_row(row_at(i));
+        return;
+    }
+
+    // Filtered or sorted view: select row indices, sort them, print them
+    int *sel = malloc((size_t)t_tab->count * sizeof(int));
+    if(!sel){
+        cms_printf("CMS: Out of memory.\n");
+        return;
+    }
+    int n = filter_select(&f, sel);
+    sort_selection_par(sel, n, f.sort_field, f.sort_asc);
+
+    if(f.len == 0){
+        cms_printf("CMS: Here are all the records.\n");
+        print_header();
+        for(int i=0;i<n;i++)
+            print_row(row_at(sel[i]));
+    } else if(n == 0){
+        cms_printf("CMS: No records match.\n");
+    } else {
+        cms_printf("CMS: Here are the matching records.\n");
+        print_header();
+        for(int i=0;i<n;i++)
+            print_row(row_at(sel[i]));
+        cms_printf("CMS: %d of %d record(s) matched.\n", n, t_tab->count);
+    }
+    free(sel);
+}
+
+/* ---------- INSERT ---------- */
+// Prompt non-empty string from user (returns 0 at end of input)
+int prompt_string(const char *label,char*out,size_t outsz){
+    while(1){
+        cms_printf("%s", label);
+        if(!cms_fgets(out, outsz)) { out[0]=0; return 0; }
+        rstrip(out); 
+        trim(out);
+        if(out[0]) return 1;   // not empty => ok
+        cms_printf("Please enter something.\n");
+    }
+}
+// Prompt for integer input with basic validation (supports QUIT)
+int prompt_int(const char *label) {
+    char buf[64];
+    while (1) {
+        cms_printf("%s", label);
+        if (!cms_fgets(buf, sizeof(buf))) return 0;
+        rstrip(buf);
+        trim(buf);
+
+        // Check if user wants to exit this operation
+        if (check_exit(buf)) {
+            cms_printf("Exiting operation.\n");
+            return 0;  // Exit the current operation
+        }
+
+        char *e;
+        long v = strtol(buf, &e, 10);
+        if (*e == '\0') return (int)v;
+        cms_printf("Invalid integer.\n");
+    }
+}
+// Prompt for float input with basic validation (supports QUIT)
+float prompt_float(const char *label) {
+    char buf[64];
+    while (1) {
+        cms_printf("%s", label);
+        if (!cms_fgets(buf, sizeof(buf))) return 0;  // end of input
+        rstrip(buf);
+        trim(buf);
+
+        // Check if user wants to exit
+        if (check_exit(buf)) {
+            cms_printf("Exiting operation.\n");
+            return 0;  // Exit the current operation
+        }
+
+        char *e;
+        float v = strtof(buf, &e);
+
+        if (*e == '\0') return v;
+        cms_printf("Invalid number.\n");
+    }
+}
+// ================== NEW VALIDATION FUNCTIONS ==================
+
+// Check string contains only letters and spaces (no digits/symbols)
+int is_alpha_space(const char *s){
+    if (s[0] == '\0') return 0; // empty not allowed
+
+    for (int i = 0; s[i] != '\0'; i++){
+        unsigned char c = (unsigned char)s[i];
+        if (!isalpha(c) && !isspace(c)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Ask for a valid Name (letters + spaces only)
+void prompt_name(char *out, size_t outsz) {
+    while (1) {
+        if (!prompt_string("Enter Name: ", out, outsz)) return;
+        if (!is_alpha_space(out)) {
+            cms_printf("Error: Name must only contain letters and spaces.\n");
+            continue;
+        }
+        break;
+    }
+}
+
+// Ask for a valid Programme (letters + spaces only)
+void prompt_programme(char *out, size_t outsz) {
+    while (1) {
+        if (!prompt_string("Enter Programme: ", out, outsz)) return;
+        if (!is_alpha_space(out)) {
+            cms_printf("Error: Programme must only contain letters and spaces.\n");
+            continue;
+        }
+        break;
+    }
+}
+// Ask for letters-and-spaces text (Name / Programme). Returns 0 if the
+// user typed QUIT or input ended.
+int prompt_alpha(const char *label, const char *what, char *out, size_t outsz) {
+    while (1) {
+        if (!prompt_string(label, out, outsz) || check_exit(out)) return 0;
+        if (is_alpha_space(out)) return 1;
+        cms_printf("Error: %s must only contain letters and spaces.\n", what);
+    }
+}
+
+// NEW: validate student ID (must start with 2 + 7 digits, supports QUIT)
+int prompt_student_id(void){
+    char buf[64];
+
+    while(1){
+        cms_printf("Enter student ID: ");
+        if(!cms_fgets(buf, sizeof(buf))) return -1;  // end of input = cancel
+        rstrip(buf);
+        trim(buf);
+
+        // allow user to type QUIT to cancel this input
+        if (check_exit(buf)) {
+            return -1;   // special value = user cancelled
+        }
+
+        int len = (int)strlen(buf);
+        int ok = 1;
+
+        // Rule: exactly 7 digits and must start with '2'
+        if(len != 7 || buf[0] != '2'){
+            ok = 0;
+        } else {
+            for(int i=0;i<len;i++){
+                if(!isdigit((unsigned char)buf[i])){
+                    ok = 0;
+                    break;
+                }
+            }
+        }
+
+        if(!ok){
+            cms_printf("Error: Student ID must start with 2 and have exactly 7 digits.\n");
+            continue;
+        }
+
+        return (int)strtol(buf,NULL,10);
+    }
+}
+
+// NEW: validate and round mark to 1 decimal place (-1 at end of input)
+float prompt_mark(const char *label) {
+    char buf[64];
+    while (1) {
+        cms_printf("%s", label);
+        if (!cms_fgets(buf, sizeof(buf))) return -1.0f;
+        rstrip(buf);
+        trim(buf);
+
+        // Check empty input
+        if (buf[0] == '\0') {
+            cms_printf("Mark cannot be empty.\n");
+            continue;
+        }
+
+        // Convert string to float
+        char *end;
+        float v = strtof(buf, &end);
+
+        // Reject invalid text (e.g. "abc")
+        if (*end != '\0') {
+            cms_printf("Invalid number.\n");
+            continue;
+        }
+
+        // Range check 0–100
+        if (v < 0 || v > 100) {
+            cms_printf("Mark must be between 0 and 100.\n");
+            continue;
+        }
+
+        // Round to 1 decimal place
+        v = roundf(v * 10.0f) / 10.0f;
+        return v;
+    }
+}
+
+/* ---------- INSERT ---------- */
+// INSERT command: add a new student after validation
+// Ask for a new, unused student ID; returns 0 if the user typed QUIT
+int insert_ask_id(int *id) {
+    // Validate ID format + check duplicate, using prompt_student_id
+    while (1) {
+        *id = prompt_student_id();   // uses our validation
+        if (*id < 0) return 0;       // user typed QUIT
+
+        if (find_index_by_id(*id) >= 0) {
+            cms_printf("Error: This ID exists.\n");
+        } else {
+            return 1;  // valid and unique
+        }
+    }
+}
+
+// One validated prompt per schema column, in order; each is false if the
+// user typed QUIT (or input ended). Marks are 0-100, rounded to 1 dp.
+#define INSERT_ASK_ID(f, head)   && insert_ask_id(&s.f)
+#define INSERT_ASK_TEXT(f, head) && prompt_alpha("Enter " head ": ", head, s.f, sizeof(s.f))
+#define INSERT_ASK_MARK(f, head) && (s.f = prompt_mark("Enter " head ": ")) >= 0
+#define INSERT_ASK(kind, field, tag, head, key, alias, width, size) INSERT_ASK_##kind(field, head)
+
+void cmd_insert(const char *args) {
+    // Quick escape: if user typed QUIT after INSERT
+    if (check_exit(args)) {
+        cms_printf("Exiting insert operation.\n");
+        return;  // Exit the insert operation
+    }
+
+    if (t_tab->filename[0] == '\0') {
+        cms_printf("CMS: No file opened.\n");
+        return;
+    }
+
+    if (t_tab->count >= MAX_STUDENTS) {
+        cms_printf("CMS: Storage full.\n");
+        return;
+    }
+
+    // Build the new record from the validated inputs
+    Student s;
+    memset(&s, 0, sizeof(s));
+    if (!(1 STUDENT_COLUMNS(INSERT_ASK))) {
+        cms_printf("Exiting insert operation.\n");
+        return;
+    }
+
+    // Add to array and record undo info
+    *row_mut(t_tab->count++) = s;
+    push_undo('I', s, s);
+
+    cms_printf("CMS: Record inserted.\n");
+    cms_printf("Remember to type SAVE to save your changes.\n");
+}
+
+
+/* ---------- RANK INDEX (order statistics over marks) ---------- */
+// Two order-statistic trees (treaps whose nodes count their subtree)
+// answer rank questions in O(log n): one over every student, ordered by
+// mark (highest first) then ID, and one grouped by programme first. Like
+// the records, the index belongs to one table version. It is built the
+// first time a version is asked for a rank; after that each write
+// command carries it to the version it publishes by removing the keys
+// of the rows it changed and inserting their new ones.
+
+// Sort key of one student in a tree
+typedef struct {
+    unsigned long long group;   // programme hash (0 in the overall tree)
+    float mark;
+    int   id;
+} RankKey;
+
+typedef struct {
+    RankKey  key;
+    unsigned prio;              // heap priority (from the key)
+    int      l, r, size;        // children and subtree size (0 = none)
+} RankNode;
+
+// One treap in a node array; node 0 is the empty tree
+typedef struct {
+    RankNode *nodes;
+    int root, used, cap;
+    int free_list;              // recycled nodes, chained through l
+} RankTree;
+
+typedef struct RankIndex {
+    RankTree all;        // every student
+    RankTree by_prog;    // grouped by programme
+} RankIndex;
+
+// Order: group, then higher mark first, then lower ID first
+int rank_key_cmp(const RankKey *a, const RankKey *b) {
+    if (a->group != b->group) return a->group < b->group ? -1 : 1;
+    if (a->mark != b->mark) return a->mark > b->mark ? -1 : 1;
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+// Programme group of a record. Programmes are told apart by a 64-bit
+// hash of their name; 1 is added so no programme shares the overall
+// tree's group 0.
+unsigned long long rank_group(const char *programme) {
+    return fnv1a(1469598103934665603ULL, programme, strlen(programme)) | 1;
+}
+
+void rank_fix(RankTree *t, int n) {
+    t->nodes[n].size = 1 + t->nodes[t->nodes[n].l].size + t->nodes[t->nodes[n].r].size;
+}
+
+// Split tree n into keys < key (*a) and keys >= key (*b)
+void rank_split(RankTree *t, int n, const RankKey *key, int *a, int *b) {
+    if (!n) {
+        *a = *b = 0;
+        return;
+    }
+    if (rank_key_cmp(&t->nodes[n].key, key) < 0) {
+        rank_split(t, t->nodes[n].r, key, &t->nodes[n].r, b);
+        *a = n;
+    } else {
+        rank_split(t, t->nodes[n].l, key, a, &t->nodes[n].l);
+        *b = n;
+    }
+    rank_fix(t, n);
+}
+
+// Join two trees where every key of a is below every key of b
+int rank_merge(RankTree *t, int a, int b) {
+    if (!a || !b) return a ? a : b;
+    if (t->nodes[a].prio > t->nodes[b].prio) {
+        t->nodes[a].r = rank_merge(t, t->nodes[a].r, b);
+        rank_fix(t, a);
+        return a;
+    }
+    t->nodes[b].l = rank_merge(t, a, t->nodes[b].l);
+    rank_fix(t, b);
+    return b;
+}
+
+// Add a key; returns 0 if out of memory
+int rank_insert(RankTree *t, const RankKey *key) {
+    int n = t->free_list;
+    if (n) {
+        t->free_list = t->nodes[n].l;
+    } else {
+        if (t->used == t->cap) {
+            int cap = t->cap ? t->cap * 2 : 64;
+            RankNode *nodes = realloc(t->nodes, (size_t)cap * sizeof(RankNode));
+            if (!nodes) return 0;
+            t->nodes = nodes;
+            t->cap = cap;
+        }
+        n = t->used++;
+    }
+    RankNode *nd = &t->nodes[n];
+    nd->key = *key;
+    nd->prio = (unsigned)key->id * 2654435761u ^ (unsigned)(key->group >> 7);
+    nd->l = nd->r = 0;
+    nd->size = 1;
+
+    int a, b;
+    rank_split(t, t->root, key, &a, &b);
+    t->root = rank_merge(t, rank_merge(t, a, n), b);
+    return 1;
+}
+
+// Remove one copy of a key (if present)
+void rank_erase(RankTree *t, const RankKey *key) {
+    int a, b, m, c;
+    RankKey next = *key;        // the smallest key above it
+    if (next.id < INT_MAX) {
+        next.id++;
+    } else {
+        next.mark = nextafterf(next.mark, -INFINITY);
+        next.id = INT_MIN;
+    }
+    rank_split(t, t->root, key, &a, &b);
+    rank_split(t, b, &next, &m, &c);   // m = the copies of key
+    if (m) {
+        int rest = rank_merge(t, t->nodes[m].l, t->nodes[m].r);
+        t->nodes[m].l = t->free_list;
+        t->free_list = m;
+        m = rest;
+    }
+    t->root = rank_merge(t, rank_merge(t, a, m), c);
+}
+
+// Number of keys below key
+int rank_count_less(const RankTree *t, const RankKey *key) {
+    int n = t->root, below = 0;
+    while (n) {
+        if (rank_key_cmp(&t->nodes[n].key, key) < 0) {
+            below += t->nodes[t->nodes[n].l].size + 1;
+            n = t->nodes[n].r;
+        } else {
+            n = t->nodes[n].l;
+        }
+    }
+    return below;
+}
+
+// The k-th smallest key (k from 0; k < tree size)
+const RankKey *rank_select(const RankTree *t, int k) {
+    int n = t->root;
+    while (n) {
+        int left = t->nodes[t->nodes[n].l].size;
+        if (k < left) {
+            n = t->nodes[n].l;
+        } else if (k == left) {
+            return &t->nodes[n].key;
+        } else {
+            k -= left + 1;
+            n = t->nodes[n].r;
+        }
+    }
+    return NULL;
+}
+
+// Copy a tree (the new version's index starts as the old one's)
+int rank_tree_copy(RankTree *dst, const RankTree *src) {
+    *dst = *src;
+    dst->nodes = malloc((size_t)(src->cap ? src->cap : 1) * sizeof(RankNode));
+    if (!dst->nodes) return 0;
+    memcpy(dst->nodes, src->nodes, (size_t)src->used * sizeof(RankNode));
+    return 1;
+}
+
+void rank_index_free(RankIndex *r) {
+    if (!r) return;
+    free(r->all.nodes);
+    free(r->by_prog.nodes);
+    free(r);
+}
+
+// Add or remove one student's keys in both trees; returns 0 if out of memory
+int rank_index_keys(RankIndex *r, int id, float mark, unsigned long long group, int add) {
+    RankKey all = { 0, mark, id };
+    RankKey prog = { group, mark, id };
+    if (!add) {
+        rank_erase(&r->all, &all);
+        rank_erase(&r->by_prog, &prog);
+        return 1;
+    }
+    return rank_insert(&r->all, &all) && rank_insert(&r->by_prog, &prog);
+}
+
+int rank_index_apply(RankIndex *r, const Student *s, int add) {
+    return rank_index_keys(r, s->id, s->mark, rank_group(s->programme), add);
+}
+
+void parse_record_programme(const char *mid, int midlen, char *prog);
+
+// Programme group of record i of t_tab. A row OPEN has not decoded yet
+// stays that way: only its programme is split out, into a scratch copy.
+unsigned long long rank_row_group(int i) {
+    RecordPage *pg = t_tab->pages[i / PAGE_ROWS];
+    int k = i % PAGE_ROWS;
+    if (pg->lazy && !atomic_load_explicit(&pg->lazy->done[k], memory_order_acquire)) {
+        char prog[PROG_MAX_LEN];
+        parse_record_programme(pg->lazy->buf->data + pg->lazy->off[k], pg->lazy->len[k], prog);
+        return rank_group(prog);
+    }
+    return rank_group(pg->rows[k].programme);
+}
+
+// An empty index with node 0 (the empty tree) in place
+RankIndex *rank_index_new(void) {
+    RankIndex *r = calloc(1, sizeof(RankIndex));
+    if (!r) return NULL;
+    r->all.used = r->by_prog.used = 1;
+    r->all.cap = r->by_prog.cap = 64;
+    r->all.nodes = calloc(64, sizeof(RankNode));
+    r->by_prog.nodes = calloc(64, sizeof(RankNode));
+    if (!r->all.nodes || !r->by_prog.nodes) {
+        rank_index_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+// Record i of a version other than t_tab
+const Student *version_row(const TableVersion *v, int i) {
+    RecordPage *pg = v->pages[i / PAGE_ROWS];
+    if (pg->lazy) lazy_row_ready(pg, i % PAGE_ROWS);
+    return &pg->rows[i % PAGE_ROWS];
+}
+
+// The index for a version about to be published, derived from the
+// current version's (NULL if that has none). Only rows on pages the
+// writer copied, and rows past the end of the shorter table, changed.
+RankIndex *rank_index_next(const TableVersion *old, const TableVersion *nv) {
+    const RankIndex *from = atomic_load(&old->ranks);
+    if (!from) return NULL;
+    RankIndex *r = calloc(1, sizeof(RankIndex));
+    if (!r) return NULL;
+    if (!rank_tree_copy(&r->all, &from->all) || !rank_tree_copy(&r->by_prog, &from->by_prog)) {
+        rank_index_free(r);
+        return NULL;
+    }
+
+    int n = old->count > nv->count ? old->count : nv->count;
+    for (int i = 0; i < n; i++) {
+        int p = i / PAGE_ROWS;
+        int in_old = i < old->count, in_new = i < nv->count;
+        if (old->pages[p] == nv->pages[p] && in_old == in_new) {
+            i = (p + 1) * PAGE_ROWS - 1;   // page shared and fully kept
+            continue;
+        }
+        if (in_old && in_new && !memcmp(version_row(old, i), version_row(nv, i), sizeof(Student)))
+            continue;
+        if ((in_old && !rank_index_apply(r, version_row(old, i), 0)) ||
+            (in_new && !rank_index_apply(r, version_row(nv, i), 1))) {
+            rank_index_free(r);
+            return NULL;
+        }
+    }
+    return r;
+}
+
+// Rank index of the version this command reads (built on first use)
+RankIndex *rank_index(void) {
+    RankIndex *r = atomic_load(&t_tab->ranks);
+    if (r || t_writing) return r;
+    r = rank_index_new();
+    for (int i = 0; r && i < t_tab->count; i++) {
+        const Student *s = row_key(i);
+        if (!rank_index_keys(r, s->id, s->mark, rank_row_group(i), 1)) {
+            rank_index_free(r);
+            r = NULL;
+        }
+    }
+    if (!r) return NULL;
+
+    // Another reader of the same version may have been faster
+    RankIndex *expected = NULL;
+    if (!atomic_compare_exchange_strong(&t_tab->ranks, &expected, r)) {
+        rank_index_free(r);
+        r = expected;
+    }
+    return r;
+}
+
+// Print a student's rank overall and within their programme. Equal
+// marks share a rank; the percentile counts students with a lower mark
+// plus half of those with the same mark.
+void print_rank(const RankIndex *r, const Student *s) {
+    RankKey top = { 0, s->mark, INT_MIN };
+    RankKey low = { 0, nextafterf(s->mark, -INFINITY), INT_MIN };
+    int total = r->all.root ? r->all.nodes[r->all.root].size : 0;
+    int higher = rank_count_less(&r->all, &top);
+    int same = rank_count_less(&r->all, &low) - higher;
+    double pct = total ? 100.0 * (total - higher - same + same / 2.0) / total : 0;
+
+    unsigned long long g = rank_group(s->programme);
+    RankKey first = { g, INFINITY, INT_MIN };
+    RankKey ptop = { g, s->mark, INT_MIN };
+    RankKey end = { g, -INFINITY, INT_MIN };
+    int before = rank_count_less(&r->by_prog, &first);
+    int prog_higher = rank_count_less(&r->by_prog, &ptop) - before;
+    int prog_total = rank_count_less(&r->by_prog, &end) - before;
+
+    cms_printf("Rank: %d of %d (percentile %.1f)\n", higher + 1, total, pct);
+    cms_printf("Rank in %s: %d of %d\n", s->programme, prog_higher + 1, prog_total);
+}
+
+/* ---------- QUERY ---------- */
+// QUERY command: search by ID and display matching record
+// QUERY RANK k: show the k-th student by mark (1 = highest)
+void cmd_query(const char *args){
+    // block if no file open
+    if (t_tab->filename[0] == '\0') {
+        cms_printf("CMS: No file opened.\n");
+        return;
+    }
+
+    // The rank index is built on first use, so only when a rank is shown
+    RankIndex *r;
+    if (starts_with_ic(args, "RANK")) {
+        r = rank_index();
+        int k = atoi(args + 4);
+        const RankKey *key;
+        if (!r) {
+            cms_printf("CMS: Out of memory.\n");
+        } else if (k < 1 || !(key = rank_select(&r->all, k - 1))) {
+            cms_printf("CMS: Use QUERY RANK <k> with k from 1 to %d.\n", t_tab->count);
+        } else {
+            const Student *s = row_at(find_index_by_id(key->id));
+            cms_printf("Student ranked %d by mark:\n", k);
+            print_record(s);
+            print_rank(r, s);
+        }
+        return;
+    }
+
+    // Accept the one-line form QUERY ID=<n>; otherwise prompt for the ID
+    int id;
+    if (starts_with_ic(args, "ID=")) {
+        id = atoi(args + 3);
+    } else {
+        id = prompt_int("Enter student ID to search: ");
+    }
+    int idx = find_index_by_id(id);
+
+    if(idx<0){
+        cms_printf("CMS: No record found.\n");
+        return;
+    }
+
+    const Student *s=row_at(idx);
+    cms_printf("Record found:\n");
+    print_record(s);
+    if ((r = rank_index())) print_rank(r, s);
+}
+
+/* ---------- UPDATE ---------- */
+/* ---------- YES/NO VALIDATOR ---------- */
+// Ask a Y/N or YES/NO question; returns 1 for yes, 0 for no
+int prompt_yes_no(const char *msg) {
+    char buf[16];
+    
+    while (1) {
+        cms_printf("%s (Y/N): ", msg);  
+        if (!cms_fgets(buf, sizeof(buf))) return 0;  // Get user input (end of input = No)
+        rstrip(buf);  // Remove trailing newline characters
+        trim(buf);    // Remove leading/trailing spaces
+
+        // Check if the input is valid: "Y", "YES", "N", or "NO"
+        if (equals_ic(buf, "Y") || equals_ic(buf, "YES")) {
+            return 1;  // Yes response
+        } else if (equals_ic(buf, "N") || equals_ic(buf, "NO")) {
+            return 0;  // No response
+        } else {
+            cms_printf("Invalid choice. Please enter Y (Yes) or N (No).\n");
+        }
+    }
+}
+
+/* ---------- BULK UPDATE / DELETE ---------- */
+// Mark expression bytecode (postfix), used by UPDATE SET mark = <expr>
+#define EX_NUM  0   // push constant
+#define EX_MARK 1   // push current mark
+#define EX_ADD  2
+#define EX_SUB  3
+#define EX_MUL  4
+#define EX_DIV  5
+#define EX_NEG  6
+#define EX_MIN  7
+#define EX_MAX  8
+
+#define EXPR_MAX_INSNS 64
+
+typedef struct {
+    int   op;     // EX_*
+    float val;    // EX_NUM only
+} ExprInsn;
+
+// Compiled mark expression
+typedef struct {
+    ExprInsn code[EXPR_MAX_INSNS];
+    int len;
+    int depth;    // current / maximum stack depth while compiling
+    int max_depth;
+} MarkExpr;
+
+// Append one instruction, tracking the stack depth it leaves behind
+int expr_emit(MarkExpr *e, int op, float val) {
+    if (e->len >= EXPR_MAX_INSNS) return 0;
+    e->code[e->len].op = op;
+    e->code[e->len].val = val;
+    e->len++;
+    if (op == EX_NUM || op == EX_MARK) e->depth++;
+    else if (op != EX_NEG) e->depth--;
+    if (e->depth > e->max_depth) e->max_depth = e->depth;
+    return 1;
+}
+
+int parse_mark_expr(const Token *t, int *pos, MarkExpr *e);
+
+// factor := NUM | MARK | '-' factor | '(' expr ')' | MIN|MAX '(' expr ',' expr ')'
+int parse_mark_factor(const Token *t, int *pos, MarkExpr *e) {
+    const Token *k = &t[*pos];
+    if (k->kind == TK_NUM) {
+        (*pos)++;
+        return expr_emit(e, EX_NUM, strtof(k->text, NULL));
+    }
+    if (k->kind == TK_WORD && equals_ic(k->text, "MARK")) {
+        (*pos)++;
+        return expr_emit(e, EX_MARK, 0);
+    }
+    if (k->kind == TK_PUNCT && k->text[0] == '-') {
+        (*pos)++;
+        return parse_mark_factor(t, pos, e) && expr_emit(e, EX_NEG, 0);
+    }
+    if (k->kind == TK_PUNCT && k->text[0] == '(') {
+        (*pos)++;
+        if (!parse_mark_expr(t, pos, e)) return 0;
+        if (t[*pos].kind != TK_PUNCT || t[*pos].text[0] != ')') return 0;
+        (*pos)++;
+        return 1;
+    }
+    if (k->kind == TK_WORD && (equals_ic(k->text, "MIN") || equals_ic(k->text, "MAX"))) {
+        int op = equals_ic(k->text, "MIN") ? EX_MIN : EX_MAX;
+        (*pos)++;
+        if (t[*pos].kind != TK_PUNCT || t[*pos].text[0] != '(') return 0;
+        (*pos)++;
+        if (!parse_mark_expr(t, pos, e)) return 0;
+        if (t[*pos].kind != TK_PUNCT || t[*pos].text[0] != ',') return 0;
+        (*pos)++;
+        if (!parse_mark_expr(t, pos, e)) return 0;
+        if (t[*pos].kind != TK_PUNCT || t[*pos].text[0] != ')') return 0;
+        (*pos)++;
+        return expr_emit(e, op, 0);
+    }
+    return 0;
+}
+
+// term := factor (('*' | '/') factor)*
+int parse_mark_term(const Token *t, int *pos, MarkExpr *e) {
+    if (!parse_mark_factor(t, pos, e)) return 0;
+    while (t[*pos].kind == TK_PUNCT && (t[*pos].text[0] == '*' || t[*pos].text[0] == '/')) {
+        int op = t[*pos].text[0] == '*' ? EX_MUL : EX_DIV;
+        (*pos)++;
+        if (!parse_mark_factor(t, pos, e) || !expr_emit(e, op, 0)) return 0;
+    }
+    return 1;
+}
+
+// expr := term (('+' | '-') term)*
+int parse_mark_expr(const Token *t, int *pos, MarkExpr *e) {
+    if (!parse_mark_term(t, pos, e)) return 0;
+    while (t[*pos].kind == TK_PUNCT && (t[*pos].text[0] == '+' || t[*pos].text[0] == '-')) {
+        int op = t[*pos].text[0] == '+' ? EX_ADD : EX_SUB;
+        (*pos)++;
+        if (!parse_mark_term(t, pos, e) || !expr_emit(e, op, 0)) return 0;
+    }
+    return 1;
+}
+
+// Evaluate the expression for the selected rows in batches; writes out[i]
+// for sel[i]. Returns the number of results outside 0-100.
+int eval_mark_expr(const MarkExpr *e, const int *sel, int n, float *out) {
+    float stack[PRED_MAX_DEPTH][FILTER_BATCH];
+    int bad = 0;
+
+    for (int base = 0; base < n; base += FILTER_BATCH) {
+        int cnt = n - base < FILTER_BATCH ? n - base : FILTER_BATCH;
+        int sp = 0;
+
+        for (int pc = 0; pc < e->len; pc++) {
+            const ExprInsn *in = &e->code[pc];
+            float *a, *b;
+            int k;
+            switch (in->op) {
+            case EX_NUM:
+                for (k = 0; k < cnt; k++) stack[sp][k] = in->val;
+                sp++;
+                break;
+            case EX_MARK:
+                for (k = 0; k < cnt; k++) stack[sp][k] = row_key(sel[base + k])->mark;
+                sp++;
+                break;
+            case EX_NEG:
+                a = stack[sp - 1];
+                for (k = 0; k < cnt; k++) a[k] = -a[k];
+                break;
+            default:
+                // Binary operators: a = a (op) b, where b is the popped top
+                sp--;
+                a = stack[sp - 1];
+                b = stack[sp];
+                if (in->op == EX_ADD)      for (k = 0; k < cnt; k++) a[k] += b[k];
+                else if (in->op == EX_SUB) for (k = 0; k < cnt; k++) a[k] -= b[k];
+                else if (in->op == EX_MUL) for (k = 0; k < cnt; k++) a[k] *= b[k];
+                else if (in->op == EX_DIV) for (k = 0; k < cnt; k++) a[k] /= b[k];
+                else if (in->op == EX_MIN) for (k = 0; k < cnt; k++) a[k] = b[k] < a[k] ? b[k] : a[k];
+                else                       for (k = 0; k < cnt; k++) a[k] = b[k] > a[k] ? b[k] : a[k];
+            }
+        }
+
+        // Same rounding and range rule as prompt_mark (1 dp, 0-100)
+        for (int k = 0; k < cnt; k++) {
+            float v = roundf(stack[0][k] * 10.0f) / 10.0f;
+            bad += !(v >= 0 && v <= 100);   // also catches NaN
+            out[base + k] = v;
+        }
+    }
+    return bad;
+}
+
+// Parse an optional trailing "WHERE <condition>" and select matching rows.
+// Returns the number of matches (sel must hold t_tab->count slots), or -1 on error.
+int select_where(const Token *toks, int ntok, int pos, int *sel) {
+    Filter f;
+    f.len = 0;
+
+    if (pos < ntok) {
+        if (toks[pos].kind != TK_WORD || !equals_ic(toks[pos].text, "WHERE")) {
+            cms_printf("CMS: Expected WHERE near \"%s\".\n", toks[pos].text);
+            return -1;
+        }
+        pos++;
+        if (!parse_where(toks, ntok, &pos, &f)) {
+            cms_printf("CMS: Invalid WHERE condition near \"%s\".\n",
+                   pos < ntok ? toks[pos].text : "end of line");
+            return -1;
+        }
+        if (pos < ntok) {
+            cms_printf("CMS: Unexpected \"%s\" after WHERE condition.\n", toks[pos].text);
+            return -1;
+        }
+    }
+    return filter_select(&f, sel);
+}
+
+// UPDATE SET <col> = <value> [, ...] [WHERE <condition>]
+// NAME/PROGRAMME take a text value; MARK takes an expression over mark
+// (+ - * / min() max()), e.g. UPDATE SET mark = min(mark+5,100) WHERE ...
+void cmd_update_bulk(const char *args) {
+    Token toks[MAX_TOKENS];
+    int ntok = tokenize_clause(args, toks, MAX_TOKENS);
+    if (ntok < 0) {
+        cms_printf("CMS: Invalid UPDATE statement.\n");
+        return;
+    }
+
+    int pos = 1;   // toks[0] is SET
+    MarkExpr expr;
+    memset(&expr, 0, sizeof(expr));
+    int set_mark = 0;
+    const char *new_name = NULL, *new_prog = NULL;
+
+    // Assignment list
+    while (1) {
+        int col = toks[pos].kind == TK_WORD ? column_from_name(toks[pos].text) : 0;
+        if (!col || toks[pos + 1].kind != TK_OP || !equals_ic(toks[pos + 1].text, "=")) {
+            cms_printf("CMS: Expected <column> = <value> near \"%s\".\n",
+                   pos < ntok ? toks[pos].text : "end of line");
+            return;
+        }
+        pos += 2;
+
+        if (col == COL_ID) {
+            cms_printf("CMS: Student IDs cannot be changed in a bulk UPDATE.\n");
+            return;
+        } else if (col == COL_MARK) {
+            if (set_mark || !parse_mark_expr(toks, &pos, &expr) ||
+                expr.max_depth > PRED_MAX_DEPTH) {
+                cms_printf("CMS: Invalid mark expression.\n");
+                return;
+            }
+            set_mark = 1;
+        } else {
+            const Token *v = &toks[pos];
+            if ((v->kind != TK_STR && v->kind != TK_WORD) || !is_alpha_space(v->text)) {
+                cms_printf("Error: %s must only contain letters and spaces.\n",
+                       col == COL_NAME ? "Name" : "Programme");
+                return;
+            }
+            if (col == COL_NAME) new_name = v->text;
+            else new_prog = v->text;
+            pos++;
+        }
+
+        if (toks[pos].kind == TK_PUNCT && toks[pos].text[0] == ',') { pos++; continue; }
+        break;
+    }
+
+    int *sel = malloc((size_t)(t_tab->count ? t_tab->count : 1) * sizeof(int));
+    float *marks = malloc((size_t)(t_tab->count ? t_tab->count : 1) * sizeof(float));
+    if (!sel || !marks) {
+        cms_printf("CMS: Out of memory.\n");
+        free(sel); free(marks);
+        return;
+    }
+
+    int n = select_where(toks, ntok, pos, sel);
+    if (n <= 0) {
+        if (n == 0) cms_printf("CMS: No records match.\n");
+        free(sel); free(marks);
+        return;
+    }
+
+    // Compute every new mark first so a bad expression changes nothing
+    if (set_mark) {
+        int bad = eval_mark_expr(&expr, sel, n, marks);
+        if (bad) {
+            cms_printf("CMS: %d record(s) would get a mark outside 0-100. Nothing changed.\n", bad);
+            free(sel); free(marks);
+            return;
+        }
+    }
+
+    cms_printf("CMS: %d record(s) will be updated.\n", n);
+    if (!prompt_yes_no("Apply this update?")) {
+        cms_printf("Update cancelled.\n");
+        free(sel); free(marks);
+        return;
+    }
+
+    // Keep the before- and after-images as one grouped undo entry
+    Student *before = malloc((size_t)n * sizeof(Student));
+    Student *after = malloc((size_t)n * sizeof(Student));
+    if (!before || !after) {
+        cms_printf("CMS: Out of memory.\n");
+        free(before); free(after);
+        free(sel); free(marks);
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        Student *s = row_mut(sel[i]);
+        before[i] = *s;
+        if (new_name) {
+            strncpy(s->name, new_name, NAME_MAX_LEN - 1);
+            s->name[NAME_MAX_LEN - 1] = '\0';
+        }
+        if (new_prog) {
+            strncpy(s->programme, new_prog, PROG_MAX_LEN - 1);
+            s->programme[PROG_MAX_LEN - 1] = '\0';
+        }
+        if (set_mark) s->mark = marks[i];
+        after[i] = *s;
+        cdc_record('U', &before[i], s, 0);
+    }
+    push_undo_bulk('B', before, after, n);
+
+    cms_printf("CMS: %d record(s) updated.\n", n);
+    cms_printf("Remember to type SAVE to save your changes.\n");
+    free(sel);
+    free(marks);
+}
+
+// DELETE WHERE <condition>: remove every matching record in one pass
+void cmd_delete_bulk(const char *args) {
+    Token toks[MAX_TOKENS];
+    int ntok = tokenize_clause(args, toks, MAX_TOKENS);
+    if (ntok < 0) {
+        cms_printf("CMS: Invalid DELETE statement.\n");
+        return;
+    }
+
+    int *sel = malloc((size_t)(t_tab->count ? t_tab->count : 1) * sizeof(int));
+    if (!sel) {
+        cms_printf("CMS: Out of memory.\n");
+        return;
+    }
+
+    int n = select_where(toks, ntok, 0, sel);
+    if (n <= 0) {
+        if (n == 0) cms_printf("CMS: No records match.\n");
+        free(sel);
+        return;
+    }
+
+    cms_printf("CMS: %d record(s) will be deleted.\n", n);
+    if (!prompt_yes_no("Are you sure you want to delete these records?")) {
+        cms_printf("Delete cancelled.\n");
+        free(sel);
+        return;
+    }
+
+    Student *removed = malloc((size_t)n * sizeof(Student));
+    if (!removed) {
+        cms_printf("CMS: Out of memory.\n");
+        free(sel);
+        return;
+    }
+
+    // Stable compaction: sel is ascending, so one forward sweep suffices
+    int w = 0, next = 0;
+    for (int r = 0; r < t_tab->count; r++) {
+        if (next < n && sel[next] == r) {
+            removed[next++] = *row_at(r);
+            continue;
+        }
+        if (w != r) *row_mut(w) = *row_at(r);
+        w++;
+    }
+    t_tab->count = w;
+    push_undo_bulk('X', removed, NULL, n);
+
+    cms_printf("CMS: %d record(s) deleted.\n", n);
+    cms_printf("Remember to type SAVE to save your changes.\n");
+    free(sel);
+}
+
+// Compare two students by ID (qsort callback)
+int cmp_student_id(const void *a, const void *b) {
+    int x = ((const Student *)a)->id, y = ((const Student *)b)->id;
+    return (x > y) - (x < y);
+}
+
+// One after-image of a bulk UPDATE, found by ID
+typedef struct {
+    int id;
+    int k;      // index into the entry's images (-1 once used)
+} UndoSlot;
+
+int cmp_undo_slot(const void *a, const void *b) {
+    const UndoSlot *x = a, *y = b;
+    if (x->id != y->id) return (x->id > y->id) - (x->id < y->id);
+    return (x->k > y->k) - (x->k < y->k);
+}
+
+// Undo a bulk UPDATE in one sweep of the table. IDs may repeat in a
+// loaded file, so a row is put back only while it still equals one of
+// the after-images with its ID, and each after-image is used once: rows
+// the UPDATE never touched, or changed since, are left alone.
+// Returns the rows restored, or -1 if out of memory.
+int undo_bulk_update(const Student *before, const Student *after, int nrows) {
+    UndoSlot *slot = malloc((size_t)(nrows ? nrows : 1) * sizeof(UndoSlot));
+    if (!slot) return -1;
+    for (int k = 0; k < nrows; k++) {
+        slot[k].id = after[k].id;
+        slot[k].k = k;
+    }
+    qsort(slot, (size_t)nrows, sizeof(UndoSlot), cmp_undo_slot);
+
+    int restored = 0;
+    for (int i = 0; i < t_tab->count && restored < nrows; i++) {
+        int id = row_key(i)->id, lo = 0, hi = nrows;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (slot[mid].id < id) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < nrows && slot[lo].id == id; lo++) {
+            int k = slot[lo].k;
+            if (k < 0 || !same_row(row_at(i), &after[k])) continue;
+            cdc_record('U', row_at(i), &before[k], 1);
+            *row_mut(i) = before[k];
+            slot[lo].k = -1;
+            restored++;
+            break;
+        }
+    }
+    free(slot);
+    return restored;
+}
+
+/* ---------- UPDATE (fully rewritten) ---------- */
+// UPDATE command: let admin selectively change ID, Name, Programme, Mark
+void cmd_update(const char *args) {
+    // Check if user wants to exit at the start of the function
+    if (check_exit(args)) {
+        cms_printf("Exiting update operation.\n");
+        return;  // Exit the update operation
+    }
+
+    // block if no file open
+    if (t_tab->filename[0] == '\0') {
+        cms_printf("CMS: No file opened.\n");
+        return;
+    }
+
+    // Set-based form: UPDATE SET ... [WHERE ...]
+    if (starts_with_ic(args, "SET") && (args[3] == '\0' || isspace((unsigned char)args[3]))) {
+        cmd_update_bulk(args);
+        return;
+    }
+
+    // Prompt user for student ID to update
+    int id = prompt_student_id();
+    if (id < 0) {
+        cms_printf("Exiting update operation.\n");
+        return;
+    }
+
+    
+    // If the user enters "quit" in some earlier input, eventually exit
+    if (check_exit(args)) {
+        cms_printf("Exiting update operation.\n");
+        return;  // Exit the update operation immediately
+    }
+
+    // Find the record by ID
+    int idx = find_index_by_id(id);
+
+    if (idx < 0) {
+        cms_printf("CMS: No record found.\n");
+        return;  // Exit the function early if no record is found
+    }
+
+    Student *s = row_mut(idx);
+
+    /* ----- Show record BEFORE update ----- */
+    cms_printf("\nRecord found:\n");
+    cms_printf("ID      : %d\n", s->id);
+    cms_printf("Name    : %s\n", s->name);
+    cms_printf("Programme: %s\n", s->programme);
+    cms_printf("Mark    : %.1f\n\n", s->mark);
+
+    Student old = *s;     // backup for undo
+    Student updated = *s; // temp copy for editing
+
+    int changed = 0;      // track if anything changed
+
+    /* ===========================
+       UPDATE STUDENT ID
+       =========================== */
+    if (prompt_yes_no("Do you want to update the student ID?")) {
+
+        int newID;
+
+        while (1) {
+            newID = prompt_student_id();  // validated student ID format
+            if (newID < 0) {
+                cms_printf("Exiting update operation.\n");
+                return;
+            }
+
+            // ensure this ID isn't used by other students
+            int exist = find_index_by_id(newID);
+            if (exist >= 0 && exist != idx) {
+                cms_printf("Error: This ID already exists.\n");
+                continue;
+            }
+            break;
+        }
+
+        if (newID != updated.id) {
+            updated.id = newID;
+            changed = 1;
+        } else {
+            cms_printf("No change detected for ID.\n");
+        }
+    }
+
+    /* ===========================
+       UPDATE NAME
+       =========================== */
+    if (prompt_yes_no("Do you want to update the Name?")) {
+
+        char temp[NAME_MAX_LEN];
+
+        while (1) {
+            cms_printf("Enter new Name (current: %s): ", updated.name);
+            if (!cms_fgets(temp, sizeof(temp))) {
+                cms_printf("Exiting update operation.\n");
+                return;
+            }
+            rstrip(temp);
+            trim(temp);
+
+            if (temp[0] == '\0') {
+                cms_printf("Name cannot be empty.\n");
+                continue;
+            }
+
+            if (!is_alpha_space(temp)) {
+                cms_printf("Error: Name must only contain letters and spaces.\n");
+                continue;
+            }
+
+            break;
+        }
+
+        if (strcmp(temp, updated.name) != 0) {
+            strncpy(updated.name, temp, NAME_MAX_LEN - 1);
+            updated.name[NAME_MAX_LEN - 1] = '\0';
+            changed = 1;
+        } else {
+            cms_printf("No change detected for Name.\n");
+        }
+    }
+
+    /* ===========================
+       UPDATE PROGRAMME
+       =========================== */
+    if (prompt_yes_no("Do you want to update the Programme?")) {
+
+        char temp[PROG_MAX_LEN];
+
+        while (1) {
+            cms_printf("Enter new Programme (current: %s): ", updated.programme);
+            if (!cms_fgets(temp, sizeof(temp))) {
+                cms_printf("Exiting update operation.\n");
+                return;
+            }
+            rstrip(temp);
+            trim(temp);
+
+            if (temp[0] == '\0') {
+                cms_printf("Programme cannot be empty.\n");
+                continue;
+            }
+
+            if (!is_alpha_space(temp)) {
+                cms_printf("Error: Programme must only contain letters and spaces.\n");
+                continue;
+            }
+
+            break;
+        }
+
+        if (strcmp(temp, updated.programme) != 0) {
+            strncpy(updated.programme, temp, PROG_MAX_LEN - 1);
+            updated.programme[PROG_MAX_LEN - 1] = '\0';
+            changed = 1;
+        } else {
+            cms_printf("No change detected for Programme.\n");
+        }
+    }
+
+    /* ===========================
+       UPDATE MARK
+       =========================== */
+    if (prompt_yes_no("Do you want to update the Mark?")) {
+
+        while (1) {
+            char buf[64];
+            cms_printf("Enter new Mark (current: %.1f): ", updated.mark);
+
+            if (!cms_fgets(buf, sizeof(buf))) {
+                cms_printf("Exiting update operation.\n");
+                return;
+            }
+            rstrip(buf);
+            trim(buf);
+
+            if (buf[0] == '\0') {
+                cms_printf("Mark cannot be empty.\n");
+                continue;
+            }
+
+            char *end;
+            float v = strtof(buf, &end);
+
+            if (*end != '\0' || v < 0 || v > 100) {
+                cms_printf("Invalid mark. Must be 0-100.\n");
+                continue;
+            }
+
+            v = roundf(v * 10.0f) / 10.0f; // 1dp rounding
+
+            if (v != updated.mark) {
+                updated.mark = v;
+                changed = 1;
+            } else {
+                cms_printf("No change detected for Mark.\n");
+            }
+            break;
+        }
+    }
+
+    /* ===========================
+       NO CHANGES?
+       =========================== */
+    if (!changed) {
+        cms_printf("\nCMS: No changes made. Update cancelled.\n");
+        return;
+    }
+
+    /* ===========================
+       APPLY UPDATE + UNDO
+       =========================== */
+    *s = updated; // commit changes to actual record
+
+    // Store old and new versions for undo
+    push_undo('U', old, *s);
+
+    cms_printf("\nCMS: Record updated successfully.\n");
+    cms_printf("Remember to type SAVE to save your changes.\n");
+
+    /* ===========================
+       SHOW UPDATED RECORD
+       =========================== */
+    cms_printf("Updated Record:\n");
+    cms_printf("ID       : %d\n", s->id);
+    cms_printf("Name     : %s\n", s->name);
+    cms_printf("Programme: %s\n", s->programme);
+    cms_printf("Mark     : %.1f\n", s->mark);
+}
+
+
+/* ---------- DELETE ---------- */
+// DELETE command: remove a record by ID, with double confirmation
+void cmd_delete(const char *args) {
+    // Check if user wants to exit at the start of the function
+    if (check_exit(args)) {
+        cms_printf("Exiting delete operation.\n");
+        return;  // Exit the delete operation immediately
+    }
+
+    if (t_tab->filename[0] == '\0') {
+        cms_printf("CMS: No file opened.\n");
+        return;
+    }
+
+    // Set-based form: DELETE WHERE ...
+    if (starts_with_ic(args, "WHERE") && (args[5] == '\0' || isspace((unsigned char)args[5]))) {
+        cmd_delete_bulk(args);
+        return;
+    }
+
+    // Prompt user for student ID to delete
+    int id = prompt_student_id();
+    if (id < 0) {
+        cms_printf("Exiting delete operation.\n");
+        return;
+    }
+
+    
+    // If the user enters "quit", exit the delete operation immediately
+    if (check_exit(args)) {
+        cms_printf("Exiting delete operation.\n");
+        return;  // Exit the delete operation immediately
+    }
+
+    // Find the record by ID
+    int idx = find_index_by_id(id);
+
+    if (idx < 0) {
+        cms_printf("CMS: No record found.\n");
+        return;  // Exit if no record found 
+    }
+
+    // First confirmation prompt
+    if (!prompt_yes_no("Are you sure you want to delete this record?")) {
+        cms_printf("Delete cancelled.\n");
+        return;
+    }
+
+    // Second confirmation prompt (extra safety)
+    if (!prompt_yes_no("Confirm again")) {
+        cms_printf("Delete cancelled.\n");
+        return;
+    }
+
+    // Perform delete operation
+    Student removed = *row_at(idx);
+    push_undo('D', removed, removed);   // Store the deletion in the undo stack
+
+    // Shift all records after the deleted one left by one position
+    for (int i = idx; i < t_tab->count - 1; i++) {
+        *row_mut(i) = *row_at(i + 1);
+    }
+    t_tab->count--;
+
+    cms_printf("CMS: Record deleted.\n");
+    cms_printf("Remember to type SAVE to save your changes.\n");
+}
+
+/* ---------- SAVE ---------- */
+// SAVE pins the current table version and hands it to a background
+// writer thread, so the prompt returns at once. Only the newest queued
+// version is kept: a second SAVE before the first one starts replaces it.
+// The same thread runs AUTOSAVE when the table has unsaved changes.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             started;          // writer thread running
+    TableVersion   *pending;          // pinned version waiting to be written
+    TableVersion   *writing;          // pinned version being written
+    unsigned long   saved_version;    // last version known to match its file
+    int             last_ok;          // result of the last save (-1 = none yet)
+    unsigned long   last_version;
+    char            last_file[260];
+    time_t          last_time;
+    int             autosave;         // seconds between autosaves (0 = off)
+} Saver;
+
+Saver g_saver = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER,
+                  .last_ok = -1 };
+
+// The table version being built matches its file (OPEN just read it)
+void saver_mark_clean(unsigned long version){
+    pthread_mutex_lock(&g_saver.lock);
+    g_saver.saved_version = version;
+    pthread_mutex_unlock(&g_saver.lock);
+}
+
+// Pin the latest version if it has unsaved changes (autosave). NULL if clean.
+TableVersion *saver_take_dirty(void){
+    table_read_begin();
+    TableVersion *v = t_tab;
+    if(v->number != g_saver.saved_version && v->filename[0]) atomic_fetch_add(&v->pins, 1);
+    else v = NULL;
+    table_read_end();
+    return v;
+}
+
+// Writer thread: write queued versions, or autosave when it is time
+void *saver_main(void *arg){
+    (void)arg;
+    pthread_mutex_lock(&g_saver.lock);
+    while(1){
+        if(!g_saver.pending){
+            if(g_saver.autosave){
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_sec += g_saver.autosave;
+                if(pthread_cond_timedwait(&g_saver.cond, &g_saver.lock, &ts) == 0) continue;
+                if(!g_saver.autosave) continue;
+                g_saver.pending = saver_take_dirty();
+                if(!g_saver.pending) continue;
+            } else {
+                pthread_cond_wait(&g_saver.cond, &g_saver.lock);
+                continue;
+            }
+        }
+        TableVersion *v = g_saver.pending;
+        g_saver.pending = NULL;
+        g_saver.writing = v;
+        pthread_mutex_unlock(&g_saver.lock);
+
+        t_tab = v;
+        int ok = save_to_file(v->filename);
+        if(ok){
+            watch_rebase();   // the file now holds exactly these rows
+            // Refresh the shared snapshot that student sessions map
+            if(!save_snapshot(v->filename))
+                printf("\nCMS: Note: could not write the shared snapshot file.\n");
+        } else {
+            printf("\nCMS: Saving \"%s\" failed; the file on disk is unchanged.\n", v->filename);
+        }
+        fflush(stdout);
+        t_tab = NULL;
+
+        pthread_mutex_lock(&g_saver.lock);
+        g_saver.writing = NULL;
+        g_saver.last_ok = ok;
+        g_saver.last_version = v->number;
+        memcpy(g_saver.last_file, v->filename, sizeof(g_saver.last_file));
+        g_saver.last_time = time(NULL);
+        if(ok) g_saver.saved_version = v->number;
+        atomic_fetch_sub(&v->pins, 1);
+        pthread_cond_broadcast(&g_saver.cond);
+    }
+    return NULL;
+}
+
+// Start the writer thread on first use (call with g_saver.lock held)
+int saver_start(void){
+    if(!g_saver.started){
+        pthread_t th;
+        if(pthread_create(&th, NULL, saver_main, NULL) != 0) return 0;
+        pthread_detach(th);
+        g_saver.started = 1;
+    }
+    return 1;
+}
+
+// Block until every queued save has been written (before exiting)
+void save_wait(void){
+    pthread_mutex_lock(&g_saver.lock);
+    if(g_saver.pending || g_saver.writing)
+        printf("CMS: Waiting for the background save to finish...\n");
+    while(g_saver.pending || g_saver.writing)
+        pthread_cond_wait(&g_saver.cond, &g_saver.lock);
+    pthread_mutex_unlock(&g_saver.lock);
+}
+
+// SAVE STATUS: what the writer thread is doing and what is unsaved
+void cmd_save_status(void){
+    pthread_mutex_lock(&g_saver.lock);
+    if(g_saver.writing){
+        cms_printf("CMS: Saving version %lu to \"%s\": %d of %d records written.\n",
+                   g_saver.writing->number, g_saver.writing->filename,
+                   atomic_load(&g_save_rows_done), g_saver.writing->count);
+    }
+    if(g_saver.pending)
+        cms_printf("CMS: Version %lu is queued to save next.\n", g_saver.pending->number);
+    if(g_saver.last_ok >= 0){
+        char when[16];
+        strftime(when, sizeof(when), "%H:%M:%S", localtime(&g_saver.last_time));
+        cms_printf("CMS: Last save: version %lu to \"%s\" %s at %s.\n", g_saver.last_version,
+                   g_saver.last_file, g_saver.last_ok ? "succeeded" : "FAILED", when);
+    } else if(!g_saver.writing){
+        cms_printf("CMS: No save has run yet.\n");
+    }
+    // Judge the latest version, not a SNAPSHOT this session may hold
+    TableVersion *cur = atomic_load(&g_table.current);
+    if(cur->filename[0]=='\0')
+        cms_printf("CMS: No file opened.\n");
+    else if(cur->number == g_saver.saved_version)
+        cms_printf("CMS: All changes are saved.\n");
+    else
+        cms_printf("CMS: The table (version %lu) has unsaved changes.\n", cur->number);
+    if(g_saver.autosave)
+        cms_printf("CMS: Autosave is on (every %d seconds).\n", g_saver.autosave);
+    pthread_mutex_unlock(&g_saver.lock);
+}
+
+// SAVE command: queue the current version for the writer thread
+// (SAVE STATUS reports on it). That is the latest version even while
+// this session holds a SNAPSHOT, so no later edit is written over.
+void cmd_save(const char *args){
+    if(equals_ic(args, "STATUS")){
+        cmd_save_status();
+        return;
+    }
+    if(args[0]){
+        cms_printf("CMS: Use SAVE or SAVE STATUS.\n");
+        return;
+    }
+    // This command's reader epoch keeps the current version from being freed
+    TableVersion *cur = atomic_load(&g_table.current);
+    if(cur->filename[0]=='\0'){
+        cms_printf("CMS: No file opened.\n");
+        return;
+    }
+
+    pthread_mutex_lock(&g_saver.lock);
+    if(!saver_start()){
+        pthread_mutex_unlock(&g_saver.lock);
+        cms_printf("CMS: Save failed.\n");
+        return;
+    }
+    TableVersion *old = g_saver.pending;
+    atomic_fetch_add(&cur->pins, 1);
+    g_saver.pending = cur;
+    if(old) atomic_fetch_sub(&old->pins, 1);
+    pthread_cond_broadcast(&g_saver.cond);
+    pthread_mutex_unlock(&g_saver.lock);
+
+    if(t_snapshot && t_snapshot != cur)
+        cms_printf("CMS: Saving the latest version (%lu), not your snapshot (version %lu).\n",
+                   cur->number, t_snapshot->number);
+    cms_printf("CMS: Saving \"%s\" in the background (%d records).%s\n", cur->filename,
+               cur->count, old ? " It replaces the save still queued." : "");
+    cms_printf("Type SAVE STATUS to check on it.\n");
+}
+
+// AUTOSAVE <seconds> | AUTOSAVE OFF: save unsaved changes periodically
+void cmd_autosave(const char *args){
+    int secs = 0;
+    if(!equals_ic(args, "OFF") && (sscanf(args, "%d", &secs) != 1 || secs < 1)){
+        cms_printf("CMS: Use AUTOSAVE <seconds> or AUTOSAVE OFF.\n");
+        return;
+    }
+    pthread_mutex_lock(&g_saver.lock);
+    if(secs && !saver_start()){
+        pthread_mutex_unlock(&g_saver.lock);
+        cms_printf("CMS: Cannot start autosave.\n");
+        return;
+    }
+    g_saver.autosave = secs;
+    pthread_cond_broadcast(&g_saver.cond);
+    pthread_mutex_unlock(&g_saver.lock);
+    if(secs) cms_printf("CMS: Unsaved changes are saved every %d seconds.\n", secs);
+    else cms_printf("CMS: Autosave is off.\n");
+}
+
+/* ---------- CATALOG (several open tables) ---------- */
+// Every OPENed file is a named table in the catalog (OPEN <file> AS
+// <name>, or the file name without its extension). One table is active:
+// its versions are g_table's, and every command works on it. OPEN of
+// another file or USE <name> parks the active table: its current version
+// stays pinned in memory together with its undo history, so switching
+// back is instant. Parked tables share the memory budget (SET CACHE);
+// over budget, the least recently used table without unsaved changes is
+// evicted to its binary snapshot and mapped back in by the next USE.
+#define CATALOG_MAX 32
+#define CATALOG_DEFAULT_KB 1024   // parked records kept in memory
+
+typedef struct {
+    char          name[CATALOG_NAME_LEN];   // "" = free slot
+    char          filename[260];
+    TableVersion *version;      // parked version (NULL = active or evicted)
+    int           dirty;        // parked rows differ from the file
+    long long     src_size;     // the file when it was parked clean,
+    unsigned long long src_hash;   // to tell if a snapshot may be written
+    UndoEntry    *undo;         // parked undo history
+    int           undo_count;
+    unsigned long last_used;    // LRU clock
+} CatalogEntry;
+
+typedef struct {
+    pthread_mutex_t lock;       // guards everything below
+    CatalogEntry    entries[CATALOG_MAX];
+    int             active;     // entry of the table in g_table (-1 = none)
+    unsigned long   clock;
+    int             budget_kb;
+} Catalog;
+
+Catalog g_catalog = { .lock = PTHREAD_MUTEX_INITIALIZER, .active = -1,
+                      .budget_kb = CATALOG_DEFAULT_KB };
+
+// Default table name: the file name without directory and extension
+void catalog_default_name(const char *filename, char *out, size_t outsz) {
+    const char *base = filename;
+    for (const char *c = filename; *c; c++)
+        if (*c == '/' || *c == '\\') base = c + 1;
+    size_t n = strcspn(base, ".");
+    if (n >= outsz) n = outsz - 1;
+    memcpy(out, base, n);
+    out[n] = '\0';
+}
+
+// Entry with this name (-1 if none)
+int catalog_find(const char *name) {
+    for (int i = 0; i < CATALOG_MAX; i++)
+        if (g_catalog.entries[i].name[0] && equals_ic(g_catalog.entries[i].name, name)) return i;
+    return -1;
+}
+
+// Free the undo history g_table or an entry holds
+void undo_free(UndoEntry *undo, int count) {
+    for (int i = 0; i < count; i++) {
+        free(undo[i].rows);
+        free(undo[i].afters);
+    }
+}
+
+// Forget a parked or evicted table's data
+void catalog_drop(CatalogEntry *e) {
+    if (e->version) atomic_fetch_sub(&e->version->pins, 1);
+    e->version = NULL;
+    undo_free(e->undo, e->undo_count);
+    free(e->undo);
+    e->undo = NULL;
+    e->undo_count = 0;
+}
+
+// Empty t_tab (writers only)
+void table_clear(void) {
+    for (int p = 0; p < MAX_PAGES; p++) {
+        page_release(t_tab->pages[p]);
+        t_tab->pages[p] = NULL;
+    }
+    t_tab->count = 0;
+}
+
+// Evict parked tables, least recently used first, until the parked
+// records fit the budget. Tables with unsaved changes always stay.
+void catalog_evict(void) {
+    for (;;) {
+        long long used = 0;
+        int victim = -1;
+        for (int i = 0; i < CATALOG_MAX; i++) {
+            CatalogEntry *e = &g_catalog.entries[i];
+            if (!e->version) continue;
+            used += (long long)e->version->count * (long long)sizeof(Student);
+            if (!e->dirty && (victim < 0 || e->last_used < g_catalog.entries[victim].last_used))
+                victim = i;
+        }
+        if (used <= (long long)g_catalog.budget_kb * 1024 || victim < 0) return;
+
+        // Write its snapshot if the file still holds exactly these rows
+        CatalogEntry *e = &g_catalog.entries[victim];
+        long long size;
+        unsigned long long hash;
+        if (e->src_size >= 0 && file_fingerprint(e->filename, &size, &hash) &&
+            size == e->src_size && hash == e->src_hash) {
+            TableVersion *keep = t_tab;
+            t_tab = e->version;
+            save_snapshot(e->filename);
+            t_tab = keep;
+        }
+        atomic_fetch_sub(&e->version->pins, 1);
+        e->version = NULL;
+    }
+}
+
+// Park the active table: pin its current version and keep its undo
+// history with its entry (writer lock held)
+void catalog_park(void) {
+    if (g_catalog.active < 0) {
+        undo_free(g_table.undo, g_table.undo_count);   // an unnamed table
+        g_table.undo_count = 0;
+        return;
+    }
+    CatalogEntry *e = &g_catalog.entries[g_catalog.active];
+    TableVersion *cur = atomic_load(&g_table.current);
+    atomic_fetch_add(&cur->pins, 1);
+    e->version = cur;
+    pthread_mutex_lock(&g_saver.lock);
+    e->dirty = cur->number != g_saver.saved_version;
+    pthread_mutex_unlock(&g_saver.lock);
+    e->src_size = -1;
+    if (e->dirty || !file_fingerprint(e->filename, &e->src_size, &e->src_hash))
+        e->src_size = -1;
+    e->undo = NULL;
+    e->undo_count = 0;
+    if (g_table.undo_count) {
+        e->undo = malloc((size_t)g_table.undo_count * sizeof(UndoEntry));
+        if (e->undo) {
+            memcpy(e->undo, g_table.undo, (size_t)g_table.undo_count * sizeof(UndoEntry));
+            e->undo_count = g_table.undo_count;
+        } else {
+            undo_free(g_table.undo, g_table.undo_count);
+        }
+    }
+    g_table.undo_count = 0;
+    e->last_used = ++g_catalog.clock;
+    g_catalog.active = -1;
+}
+
+// OPEN is about to load 'filename' as table 'name' into t_tab. Parks
+// the active table if it is a different one and empties t_tab. Returns
+// 1 if it switched tables, 0 if 'name' is already active (a reopen) and
+// -1 if the catalog is full.
+int catalog_switch_to(const char *name, const char *filename) {
+    pthread_mutex_lock(&g_catalog.lock);
+    int i = catalog_find(name);
+    if (i >= 0 && i == g_catalog.active) {
+        strncpy(g_catalog.entries[i].filename, filename, sizeof(g_catalog.entries[i].filename) - 1);
+        pthread_mutex_unlock(&g_catalog.lock);
+        return 0;
+    }
+    for (int k = 0; i < 0 && k < CATALOG_MAX; k++)
+        if (!g_catalog.entries[k].name[0]) i = k;
+    if (i < 0) {
+        pthread_mutex_unlock(&g_catalog.lock);
+        return -1;
+    }
+
+    catalog_park();
+    CatalogEntry *e = &g_catalog.entries[i];
+    catalog_drop(e);   // OPEN rereads the file, as it always has
+    memset(e, 0, sizeof(*e));
+    strncpy(e->name, name, sizeof(e->name) - 1);
+    strncpy(e->filename, filename, sizeof(e->filename) - 1);
+    e->last_used = ++g_catalog.clock;
+    g_catalog.active = i;
+    table_clear();
+    catalog_evict();
+    pthread_mutex_unlock(&g_catalog.lock);
+    return 1;
+}
+
+// USE <name>: make another open table the active one
+void cmd_use(const char *args) {
+    pthread_mutex_lock(&g_catalog.lock);
+    int i = args[0] ? catalog_find(args) : -1;
+    if (i < 0) {
+        pthread_mutex_unlock(&g_catalog.lock);
+        cms_printf("CMS: No table named \"%s\". Type SHOW TABLES to list them.\n", args);
+        return;
+    }
+    CatalogEntry *e = &g_catalog.entries[i];
+    if (i == g_catalog.active) {
+        pthread_mutex_unlock(&g_catalog.lock);
+        cms_printf("CMS: Table \"%s\" is already in use.\n", e->name);
+        return;
+    }
+    struct stat st;
+    if (!e->version && stat(e->filename, &st) != 0) {
+        pthread_mutex_unlock(&g_catalog.lock);
+        cms_printf("CMS: Cannot reload \"%s\": %s is missing.\n", e->name, e->filename);
+        return;
+    }
+
+    catalog_park();
+    table_clear();
+    const char *from = "memory";
+    if (e->version) {
+        // Parked: share its pages, as a new version of the table
+        for (int p = 0; p < MAX_PAGES; p++) {
+            t_tab->pages[p] = e->version->pages[p];
+            page_ref(t_tab->pages[p]);
+        }
+        t_tab->count = e->version->count;
+        atomic_fetch_sub(&e->version->pins, 1);
+        e->version = NULL;
+    } else if (load_snapshot(e->filename)) {
+        from = "snapshot";
+    } else {
+        load_from_file(e->filename);
+        from = "file";
+    }
+    memcpy(t_tab->filename, e->filename, sizeof(t_tab->filename));
+    if (e->undo_count) memcpy(g_table.undo, e->undo, (size_t)e->undo_count * sizeof(UndoEntry));
+    g_table.undo_count = e->undo_count;
+    free(e->undo);
+    e->undo = NULL;
+    e->undo_count = 0;
+    if (!e->dirty) saver_mark_clean(t_tab->number);
+    e->last_used = ++g_catalog.clock;
+    g_catalog.active = i;
+    catalog_evict();
+    pthread_mutex_unlock(&g_catalog.lock);
+
+    watch_switch();
+    cms_printf("CMS: Using table \"%s\" (%s, %d records, from %s)%s.\n", e->name, e->filename,
+               t_tab->count, from, e->dirty ? " with unsaved changes" : "");
+}
+
+// SHOW TABLES: the catalog
+void cmd_show_tables(void) {
+    pthread_mutex_lock(&g_catalog.lock);
+    int any = 0;
+    long long used = 0;
+    for (int i = 0; i < CATALOG_MAX; i++) {
+        const CatalogEntry *e = &g_catalog.entries[i];
+        if (!e->name[0]) continue;
+        if (!any) cms_printf("  %-16s %-28s %7s  %s\n", "Name", "File", "Records", "State");
+        any = 1;
+        char rows[16] = "-";
+        const char *state;
+        int dirty = e->dirty;
+        if (i == g_catalog.active) {
+            snprintf(rows, sizeof(rows), "%d", t_tab->count);
+            state = "in use";
+            pthread_mutex_lock(&g_saver.lock);
+            dirty = atomic_load(&g_table.current)->number != g_saver.saved_version;
+            pthread_mutex_unlock(&g_saver.lock);
+        } else if (e->version) {
+            snprintf(rows, sizeof(rows), "%d", e->version->count);
+            used += (long long)e->version->count * (long long)sizeof(Student);
+            state = "in memory";
+        } else {
+            state = "on disk";
+        }
+        cms_printf("%c %-16s %-28s %7s  %s%s\n", i == g_catalog.active ? '*' : ' ', e->name,
+                   e->filename, rows, state, dirty ? ", unsaved changes" : "");
+    }
+    if (!any) cms_printf("CMS: No tables are open.\n");
+    else cms_printf("CMS: Parked tables use %lld of %d KB.\n", (used + 1023) / 1024, g_catalog.budget_kb);
+    pthread_mutex_unlock(&g_catalog.lock);
+}
+
+/* ---------- MERGE (k-way merge of database files) ---------- */
+// MERGE <file> ... INTO <out> [KEEP FIRST|LAST|HIGHEST|LOWEST] combines
+// database files by student ID without loading them into the table.
+// Each input is parsed line by line (the OPEN rules) into sorted runs of
+// at most MERGE_RUN_ROWS records on temporary files; input that is
+// already in ID order simply extends one run. The runs are then merged
+// with a min-heap, MERGE_FAN_IN at a time, so memory stays bounded
+// however large the files are. Records with the same ID are resolved by
+// the KEEP rule (default FIRST: the file listed first wins). The output
+// is always text: a columnar file is encoded from all of its rows at
+// once, which would undo the bounded memory.
+#define MERGE_MAX_INPUTS 64
+#define MERGE_RUN_ROWS   4096   // records sorted in memory at a time
+#define MERGE_FAN_IN     64     // runs merged at once (open temp files)
+
+#define KEEP_FIRST   0
+#define KEEP_LAST    1
+#define KEEP_HIGHEST 2
+#define KEEP_LOWEST  3
+
+// A record with its place in the input (for ordering duplicates)
+typedef struct {
+    Student   s;
+    int       src;    // input file, in the order listed
+    long long seq;    // record number within that file
+} MergeRec;
+
+// A sorted run on a temporary file, and its merge level
+typedef struct {
+    FILE *fp;
+    int   level;      // 0 = made from input, n = merged from level n-1 runs
+} MergeRun;
+
+typedef struct {
+    MergeRun runs[MERGE_FAN_IN * 8];
+    int      nruns;
+    int      failed;
+} MergeRuns;
+
+// Order by ID, then input file, then position in the file
+int merge_rec_cmp(const void *a, const void *b) {
+    const MergeRec *x = a, *y = b;
+    if (x->s.id != y->s.id) return (x->s.id > y->s.id) - (x->s.id < y->s.id);
+    if (x->src != y->src) return (x->src > y->src) - (x->src < y->src);
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+// Merge runs[0..k) in key order, handing every record to emit()
+int merge_pass(MergeRun *runs, int k, int (*emit)(void *ctx, const MergeRec *r), void *ctx) {
+    MergeRec cur[MERGE_FAN_IN];
+    int heap[MERGE_FAN_IN], n = 0, ok = 1;
+
+    for (int i = 0; i < k; i++) {
+        rewind(runs[i].fp);
+        if (fread(&cur[i], sizeof(MergeRec), 1, runs[i].fp) != 1) continue;
+        // Sift the new run up
+        int c = n++;
+        while (c > 0 && merge_rec_cmp(&cur[i], &cur[heap[(c - 1) / 2]]) < 0) {
+            heap[c] = heap[(c - 1) / 2];
+            c = (c - 1) / 2;
+        }
+        heap[c] = i;
+    }
+
+    while (n > 0 && ok) {
+        int top = heap[0];
+        ok = emit(ctx, &cur[top]);
+        if (fread(&cur[top], sizeof(MergeRec), 1, runs[top].fp) != 1) top = heap[--n];
+        // Sift 'top' down from the root
+        int c = 0;
+        for (;;) {
+            int l = 2 * c + 1;
+            if (l >= n) break;
+            if (l + 1 < n && merge_rec_cmp(&cur[heap[l + 1]], &cur[heap[l]]) < 0) l++;
+            if (merge_rec_cmp(&cur[heap[l]], &cur[top]) >= 0) break;
+            heap[c] = heap[l];
+            c = l;
+        }
+        if (n > 0) heap[c] = top;
+    }
+    return ok;
+}
+
+// emit() for intermediate merges: append to a temporary run
+int merge_to_run(void *ctx, const MergeRec *r) {
+    return fwrite(r, sizeof(MergeRec), 1, (FILE *)ctx) == 1;
+}
+
+// Merge the last k runs into one run of the given level
+void merge_collapse(MergeRuns *rs, int k, int level) {
+    MergeRun *from = &rs->runs[rs->nruns - k];
+    FILE *fp = tmpfile();
+    if (!fp || !merge_pass(from, k, merge_to_run, fp)) rs->failed = 1;
+    for (int i = 0; i < k; i++) fclose(from[i].fp);
+    rs->nruns -= k;
+    if (fp) {
+        rs->runs[rs->nruns].fp = fp;
+        rs->runs[rs->nruns++].level = level;
+    }
+}
+
+// Add a new level-0 run. Once MERGE_FAN_IN runs of one level pile up they
+// are merged into one run of the next level, so every record is copied
+// only about log(n) / log(MERGE_FAN_IN) times.
+void merge_push_run(MergeRuns *rs, FILE *fp) {
+    rs->runs[rs->nruns].fp = fp;
+    rs->runs[rs->nruns++].level = 0;
+    while (!rs->failed && rs->nruns >= MERGE_FAN_IN &&
+           rs->runs[rs->nruns - MERGE_FAN_IN].level == rs->runs[rs->nruns - 1].level)
+        merge_collapse(rs, MERGE_FAN_IN, rs->runs[rs->nruns - 1].level + 1);
+}
+
+// Write one chunk of records to the current run (*run, not pushed yet).
+// The chunk is sorted unless it is in order already; in-order input
+// keeps extending the same run instead of starting a new one.
+void merge_add_chunk(MergeRuns *rs, MergeRec *buf, int n, FILE **run, int *last_id) {
+    int sorted = 1;
+    for (int i = 1; i < n && sorted; i++) sorted = buf[i - 1].s.id <= buf[i].s.id;
+    if (!sorted) qsort(buf, (size_t)n, sizeof(MergeRec), merge_rec_cmp);
+    if (*run && buf[0].s.id < *last_id) {
+        merge_push_run(rs, *run);
+        *run = NULL;
+    }
+    if (!*run && !(*run = tmpfile())) rs->failed = 1;
+    if (*run && fwrite(buf, sizeof(MergeRec), (size_t)n, *run) != (size_t)n) rs->failed = 1;
+    *last_id = buf[n - 1].s.id;
+}
+
+// Split one input file into sorted runs. Returns the records read, or -1
+// if the file cannot be read.
+long long merge_make_runs(const char *filename, int src, MergeRec *buf, MergeRuns *rs) {
+    if (col_detect(filename)) {   // already in ID order: one run
+        int count;
+        Student *all = col_read_file(filename, &count);
+        if (!all) return -1;
+        FILE *run = NULL;
+        int last_id = 0, k = 0;
+        for (int i = 0; i < count && !rs->failed; i++) {
+            buf[k].s = all[i];
+            buf[k].src = src;
+            buf[k].seq = i;
+            if (++k == MERGE_RUN_ROWS || i == count - 1) {
+                merge_add_chunk(rs, buf, k, &run, &last_id);
+                k = 0;
+            }
+        }
+        if (run) merge_push_run(rs, run);
+        free(all);
+        return count;
+    }
+
+    FileReader r;
+    if (!reader_open(&r, filename)) return -1;
+
+    char line[LINE_MAX_LEN];
+    int table_started = 0, n = 0, eof = 0;
+    long long seq = 0;
+    FILE *run = NULL;        // the run being extended (not pushed yet)
+    int last_id = 0;         // highest ID written to it
+    while (!eof && !rs->failed) {
+        eof = !reader_gets(&r, line, sizeof(line));
+        if (!eof && parse_record_line(line, &buf[n].s, &table_started)) {
+            buf[n].src = src;
+            buf[n].seq = seq++;
+            n++;
+        }
+        if ((n < MERGE_RUN_ROWS && !eof) || n == 0) continue;
+        merge_add_chunk(rs, buf, n, &run, &last_id);
+        n = 0;
+    }
+    if (run) merge_push_run(rs, run);
+    reader_close(&r);
+    return seq;
+}
+
+// Final merge: resolve duplicate IDs and write the output file
+typedef struct {
+    FileWriter  w;
+    int         keep;        // KEEP_*
+    MergeRec    held;        // best record so far for the current ID
+    int         have;
+    long long   written, duplicates;
+    int         dup_ids[5];  // first few duplicated IDs, for the report
+} MergeOut;
+
+// Hand one resolved record to the output
+void merge_out_row(MergeOut *o, const Student *s) {
+    write_db_row(&o->w, s);
+    o->written++;
+}
+
+int merge_to_file(void *ctx, const MergeRec *r) {
+    MergeOut *o = ctx;
+    if (o->have && r->s.id == o->held.s.id) {
+        if (o->held.seq >= 0) {   // first duplicate of this ID
+            if (o->duplicates < 5) o->dup_ids[o->duplicates] = r->s.id;
+            o->duplicates++;
+        }
+        int take = o->keep == KEEP_LAST ||
+                   (o->keep == KEEP_HIGHEST && r->s.mark > o->held.s.mark) ||
+                   (o->keep == KEEP_LOWEST && r->s.mark < o->held.s.mark);
+        if (take) o->held = *r;
+        o->held.seq = -1;         // mark the ID as counted
+        return 1;
+    }
+    if (o->have) merge_out_row(o, &o->held.s);
+    o->held = *r;
+    o->have = 1;
+    return !o->w.failed;
+}
+
+// MERGE <file> ... INTO <out> [KEEP FIRST|LAST|HIGHEST|LOWEST]
+void cmd_merge(const char *args) {
+    char words[MERGE_MAX_INPUTS + 4][260];
+    int nw = 0;
+    while (*args && nw < MERGE_MAX_INPUTS + 4) {
+        while (*args && isspace((unsigned char)*args)) args++;
+        if (!*args) break;
+        size_t k = 0;
+        while (*args && !isspace((unsigned char)*args) && k < sizeof(words[0]) - 1)
+            words[nw][k++] = *args++;
+        words[nw++][k] = '\0';
+    }
+
+    int into = -1;
+    for (int i = 0; i < nw; i++)
+        if (equals_ic(words[i], "INTO")) into = i;
+    int keep = KEEP_FIRST, nin = into;
+    int tail = into >= 0 ? nw - into - 1 : 0;   // words after INTO
+    if (tail == 3 && equals_ic(words[into + 2], "KEEP")) {
+        const char *k = words[into + 3];
+        keep = equals_ic(k, "FIRST") ? KEEP_FIRST : equals_ic(k, "LAST") ? KEEP_LAST :
+               equals_ic(k, "HIGHEST") ? KEEP_HIGHEST : equals_ic(k, "LOWEST") ? KEEP_LOWEST : -1;
+        tail = 1;
+    }
+    if (nin < 1 || tail != 1 || keep < 0) {
+        cms_printf("CMS: Use MERGE <file> [<file> ...] INTO <out> [KEEP FIRST|LAST|HIGHEST|LOWEST]"
+                   " (up to %d files).\n", MERGE_MAX_INPUTS);
+        return;
+    }
+    const char *out = words[into + 1];
+    if (col_wanted(out)) {
+        cms_printf("CMS: MERGE writes text files only. Merge into a text file, rename it to end in"
+                   " %s, then OPEN it and SAVE to store it by column.\n", COL_EXT);
+        return;
+    }
+
+    MergeRec *buf = malloc(MERGE_RUN_ROWS * sizeof(MergeRec));
+    MergeRuns *rs = calloc(1, sizeof(MergeRuns));
+    MergeOut *o = calloc(1, sizeof(MergeOut));
+    if (!buf || !rs || !o) {
+        cms_printf("CMS: Out of memory.\n");
+        free(buf);
+        free(rs);
+        free(o);
+        return;
+    }
+
+    // Phase 1: every input becomes sorted runs
+    long long total = 0;
+    int ok = 1;
+    for (int i = 0; i < nin && ok; i++) {
+        long long n = merge_make_runs(words[i], i, buf, rs);
+        if (n < 0) {
+            cms_printf("CMS: Cannot read \"%s\"; nothing was merged.\n", words[i]);
+            ok = 0;
+        }
+        total += n;
+    }
+    free(buf);
+    while (ok && !rs->failed && rs->nruns > MERGE_FAN_IN)   // leftovers of mixed levels
+        merge_collapse(rs, MERGE_FAN_IN, 0);
+    if (ok && rs->failed) {
+        cms_printf("CMS: Merge failed: cannot write temporary files.\n");
+        ok = 0;
+    }
+
+    // Phase 2: one k-way merge into "<out>.tmp", renamed over <out>
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out);
+    if (ok && !writer_open(&o->w, tmp)) {
+        cms_printf("CMS: Cannot create \"%s\".\n", out);
+        ok = 0;
+    }
+    if (ok) {
+        o->keep = keep;
+        write_db_header(&o->w);
+        merge_pass(rs->runs, rs->nruns, merge_to_file, o);
+        if (o->have) merge_out_row(o, &o->held.s);
+        ok = writer_close(&o->w) && replace_file(tmp, out);
+        if (!ok) {
+            remove(tmp);
+            cms_printf("CMS: Writing \"%s\" failed; it is unchanged.\n", out);
+        }
+    }
+    for (int i = 0; i < rs->nruns; i++) fclose(rs->runs[i].fp);
+
+    if (ok) {
+        static const char *keep_names[] = { "FIRST", "LAST", "HIGHEST", "LOWEST" };
+        cms_printf("CMS: Merged %d file(s), %lld record(s), into \"%s\": %lld record(s) written.\n",
+                   nin, total, out, o->written);
+        if (o->duplicates) {
+            cms_printf("CMS: %lld duplicate ID(s) resolved with KEEP %s, e.g.", o->duplicates,
+                       keep_names[keep]);
+            for (int i = 0; i < o->duplicates && i < 5; i++) cms_printf(" %d", o->dup_ids[i]);
+            cms_printf(".\n");
+        }
+    }
+    free(rs);
+    free(o);
+}
+
+/* ---------- DIFF (compare two database snapshots) ---------- */
+// DIFF <a> <b> lists the records inserted, deleted and modified going
+// from file a to file b; DIFF <a> compares file a with the current table.
+// Both sides go through the MERGE runs, so unsorted files of any size are
+// handled with bounded memory, and one merge pass pairs the records by ID
+// (side a before side b). With INTO <script> the changes are also written
+// as commands that, fed to an admin session with a opened, turn it into b.
+// The INSERTs go last, after the deletes have made room in the table.
+#define DIFF_SHOW_MAX 20   // changes listed on screen
+
+typedef struct {
+    FileWriter w;            // change script (INTO only)
+    FILE      *inserts;      // its INSERTs, appended after the deletes
+    int        scripting;
+    Student    old;          // side a record of the current ID
+    int        id, have_id, have_old, have_new;
+    long long  inserted, deleted, modified, unchanged;
+    long long  duplicates;   // extra records for an ID on one side (ignored)
+    long long  unscriptable; // changes the script commands cannot express
+    long long  listed;
+} DiffOut;
+
+// The current table as one sorted run, ordered with the parallel sort
+long long diff_table_runs(int src, MergeRec *buf, MergeRuns *rs) {
+    int n = t_tab->count;
+    int *sel = malloc((size_t)(n ? n : 1) * sizeof(int));
+    if (!sel) return -1;
+    for (int i = 0; i < n; i++) sel[i] = i;
+    sort_selection_par(sel, n, COL_ID, 1);
+
+    FILE *run = NULL;
+    int last_id = 0, k = 0;
+    for (int i = 0; i < n && !rs->failed; i++) {
+        buf[k].s = *row_at(sel[i]);
+        buf[k].src = src;
+        buf[k].seq = i;
+        if (++k == MERGE_RUN_ROWS || i == n - 1) {
+            merge_add_chunk(rs, buf, k, &run, &last_id);
+            k = 0;
+        }
+    }
+    if (run) merge_push_run(rs, run);
+    free(sel);
+    return n;
+}
+
+// Per-column pieces of the listing and the script. The ID is the key:
+// the listing prints it up front, and it never changes within a pair.
+#define DIFF_OK_ID(f)     (s->f >= 2000000 && s->f <= 2999999)
+#define DIFF_OK_TEXT(f)   is_alpha_space(s->f)
+#define DIFF_OK_MARK(f)   (s->f >= 0 && s->f <= 100 && roundf(s->f * 10.0f) / 10.0f == s->f)
+#define DIFF_OK(kind, field, tag, head, key, alias, width, size) && DIFF_OK_##kind(field)
+#define DIFF_ROW_ID       ""
+#define DIFF_ROW_TEXT     " | %s"
+#define DIFF_ROW_MARK     " | %.1f"
+#define DIFF_ROW_PIECE(kind, field, tag, head, key, alias, width, size) DIFF_ROW_##kind
+#define DIFF_ROW_ARG_ID(f)
+#define DIFF_ROW_ARG_TEXT(f) , s->f
+#define DIFF_ROW_ARG_MARK(f) , s->f
+#define DIFF_ROW_ARG(kind, field, tag, head, key, alias, width, size) DIFF_ROW_ARG_##kind(field)
+#define DIFF_VALUE_ID     "%d"
+#define DIFF_VALUE_TEXT   "\"%s\""
+#define DIFF_VALUE_MARK   "%.1f"
+#define DIFF_SHOW(kind, field, tag, head, key, alias, width, size)                      \
+    if (changed & (1u << COL_##tag))                                                   \
+        cms_printf(" " key " " DIFF_VALUE_##kind " -> " DIFF_VALUE_##kind ";", a->field, b->field);
+#define DIFF_SET(kind, field, tag, head, key, alias, width, size)                       \
+    if (changed & (1u << COL_##tag)) {                                                 \
+        writer_printf(&o->w, "%s" key " = " DIFF_VALUE_##kind, sep, b->field);          \
+        sep = ", ";                                                                    \
+    }
+#define DIFF_ANSWER_ID    "%d\n"
+#define DIFF_ANSWER_TEXT  "%s\n"
+#define DIFF_ANSWER_MARK  "%.1f\n"
+#define DIFF_ANSWER(kind, field, tag, head, key, alias, width, size) DIFF_ANSWER_##kind
+
+// Can INSERT / UPDATE SET reproduce this record? (the prompts' rules:
+// a mark outside 0-100 is refused, one with more than 1 dp is rounded)
+int diff_scriptable(const Student *s) {
+    return 1 STUDENT_COLUMNS(DIFF_OK);
+}
+
+void diff_list(DiffOut *o, char tag, const Student *s) {
+    if (o->listed++ >= DIFF_SHOW_MAX) return;
+    cms_printf("  %c %d  ", tag, s->id);
+    cms_printf((STUDENT_COLUMNS(DIFF_ROW_PIECE) "\n") + 3 STUDENT_COLUMNS(DIFF_ROW_ARG));
+}
+
+void diff_deleted(DiffOut *o) {
+    o->deleted++;
+    diff_list(o, '-', &o->old);
+    if (o->scripting) writer_printf(&o->w, "DELETE WHERE id = %d\nY\n", o->old.id);
+}
+
+void diff_inserted(DiffOut *o, const Student *s) {
+    o->inserted++;
+    diff_list(o, '+', s);
+    if (!o->scripting) return;
+    if (!diff_scriptable(s)) { o->unscriptable++; return; }
+    // One answer per INSERT prompt, in column order
+    if (fprintf(o->inserts, "INSERT\n" STUDENT_COLUMNS(DIFF_ANSWER) STUDENT_COLUMNS(COLUMN_ARG)) < 0)
+        o->w.failed = 1;
+}
+
+// Compare the two records of one ID column by column
+void diff_compare(DiffOut *o, const Student *a, const Student *b) {
+    unsigned changed = row_changes(a, b);
+    if (!changed) {
+        o->unchanged++;
+        return;
+    }
+    o->modified++;
+
+    if (o->listed++ < DIFF_SHOW_MAX) {
+        cms_printf("  ~ %d ", b->id);
+        STUDENT_COLUMNS(DIFF_SHOW)
+        cms_printf("\n");
+    }
+    if (!o->scripting) return;
+    if (!diff_scriptable(b)) { o->unscriptable++; return; }
+    const char *sep = "";
+    writer_printf(&o->w, "UPDATE SET ");
+    STUDENT_COLUMNS(DIFF_SET)
+    writer_printf(&o->w, " WHERE id = %d\nY\n", b->id);
+}
+
+// Close the current ID: a record only on side a was deleted
+void diff_flush(DiffOut *o) {
+    if (o->have_old && !o->have_new) diff_deleted(o);
+    o->have_id = o->have_old = o->have_new = 0;
+}
+
+// emit() for the merge: records arrive by ID, side a first
+int diff_emit(void *ctx, const MergeRec *r) {
+    DiffOut *o = ctx;
+    if (o->have_id && r->s.id != o->id) diff_flush(o);
+    o->id = r->s.id;
+    o->have_id = 1;
+
+    if (r->src == 0) {
+        if (o->have_old) o->duplicates++;
+        else {
+            o->old = r->s;
+            o->have_old = 1;
+        }
+    } else if (o->have_new) {
+        o->duplicates++;
+    } else {
+        o->have_new = 1;
+        if (o->have_old) diff_compare(o, &o->old, &r->s);
+        else diff_inserted(o, &r->s);
+    }
+    return !o->scripting || !o->w.failed;
+}
+
+// DIFF <a> [<b>] [INTO <script>]
+void cmd_diff(const char *args) {
+    char words[4][260];
+    int nw = 0;
+    while (*args && nw < 4) {
+        while (*args && isspace((unsigned char)*args)) args++;
+        if (!*args) break;
+        size_t k = 0;
+        while (*args && !isspace((unsigned char)*args) && k < sizeof(words[0]) - 1)
+            words[nw][k++] = *args++;
+        words[nw++][k] = '\0';
+    }
+    while (*args && isspace((unsigned char)*args)) args++;
+
+    const char *script = NULL;
+    int nin = nw;
+    if (nw >= 3 && equals_ic(words[nw - 2], "INTO")) {
+        script = words[nw - 1];
+        nin = nw - 2;
+    }
+    if (*args || nin < 1 || nin > 2) {
+        cms_printf("CMS: Use DIFF <file> [<file>] [INTO <script>].\n");
+        return;
+    }
+    if (nin == 1 && t_tab->filename[0] == '\0') {
+        cms_printf("CMS: No file opened.\n");
+        return;
+    }
+    const char *to = nin == 2 ? words[1] : "the table";
+
+    MergeRec *buf = malloc(MERGE_RUN_ROWS * sizeof(MergeRec));
+    MergeRuns *rs = calloc(1, sizeof(MergeRuns));
+    DiffOut *o = calloc(1, sizeof(DiffOut));
+    if (!buf || !rs || !o) {
+        cms_printf("CMS: Out of memory.\n");
+        free(buf);
+        free(rs);
+        free(o);
+        return;
+    }
+
+    // Both sides become sorted runs: src 0 is a, src 1 is b
+    int ok = 1;
+    long long na = merge_make_runs(words[0], 0, buf, rs), nb = 0;
+    if (na < 0) {
+        cms_printf("CMS: Cannot read \"%s\".\n", words[0]);
+        ok = 0;
+    } else if (nin == 2 && (nb = merge_make_runs(words[1], 1, buf, rs)) < 0) {
+        cms_printf("CMS: Cannot read \"%s\".\n", words[1]);
+        ok = 0;
+    } else if (nin == 1 && (nb = diff_table_runs(1, buf, rs)) < 0) {
+        cms_printf("CMS: Out of memory.\n");
+        ok = 0;
+    }
+    free(buf);
+    while (ok && !rs->failed && rs->nruns > MERGE_FAN_IN)
+        merge_collapse(rs, MERGE_FAN_IN, 0);
+    if (ok && rs->failed) {
+        cms_printf("CMS: Diff failed: cannot write temporary files.\n");
+        ok = 0;
+    }
+
+    char tmp[300];
+    if (ok && script) {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", script);
+        o->inserts = tmpfile();
+        if (!o->inserts || !writer_open(&o->w, tmp)) {
+            cms_printf("CMS: Cannot create \"%s\".\n", script);
+            ok = 0;
+        }
+        o->scripting = ok;
+    }
+    if (ok) {
+        cms_printf("CMS: Changes from \"%s\" (%lld records) to %s%s%s (%lld records):\n",
+                   words[0], na, nin == 2 ? "\"" : "", to, nin == 2 ? "\"" : "", nb);
+        merge_pass(rs->runs, rs->nruns, diff_emit, o);
+        diff_flush(o);
+        if (o->listed > DIFF_SHOW_MAX)
+            cms_printf("  ... and %lld more change(s).\n", o->listed - DIFF_SHOW_MAX);
+        cms_printf("CMS: %lld inserted, %lld deleted, %lld modified, %lld unchanged.\n",
+                   o->inserted, o->deleted, o->modified, o->unchanged);
+        if (o->duplicates)
+            cms_printf("CMS: %lld repeated ID(s) ignored (the first record of each ID counts).\n",
+                       o->duplicates);
+    }
+    if (ok && script) {
+        char chunk[1024];
+        size_t got;
+        rewind(o->inserts);
+        while ((got = fread(chunk, 1, sizeof(chunk), o->inserts)) > 0)
+            writer_write(&o->w, chunk, got);
+        if (!writer_close(&o->w) || !replace_file(tmp, script)) {
+            remove(tmp);
+            cms_printf("CMS: Writing \"%s\" failed; it is unchanged.\n", script);
+        } else {
+            cms_printf("CMS: Change script written to \"%s\".\n", script);
+            if (o->unscriptable)
+                cms_printf("CMS: %lld change(s) left out of the script: ID, name, programme or"
+                           " mark would not pass INSERT/UPDATE checks.\n", o->unscriptable);
+        }
+    }
+    if (o->inserts) fclose(o->inserts);
+    for (int i = 0; i < rs->nruns; i++) fclose(rs->runs[i].fp);
+    free(rs);
+    free(o);
+}
+
+/* ---------- EXPORT (CSV, JSON Lines, fixed-width) ---------- */
+// EXPORT <file> FORMAT csv|jsonl|fixed [WHERE ...] [SORT BY ...] writes
+// the matching records of the version the command reads for use by
+// other tools. Rows are selected and ordered like SHOW ALL, then
+// formatted one at a time straight into the FileWriter's blocks, so the
+// output is never held in memory. Like SAVE it goes to "<file>.tmp" and
+// is renamed over the file once complete.
+#define EXPORT_FIELD_MAX (2 * NAME_MAX_LEN + 3)   // longest escaped text field
+
+// One output format: an optional header line and the line of one record
+typedef struct {
+    const char *name;
+    void (*header)(FileWriter *w);
+    void (*row)(FileWriter *w, const Student *s);
+} ExportFormat;
+
+// Write a CSV text field, quoted if it holds a comma, quote, line break
+// or edge space; quotes inside are doubled (RFC 4180)
+void export_csv_text(FileWriter *w, const char *s) {
+    size_t n = strlen(s);
+    int quote = n > 0 && (s[0] == ' ' || s[n - 1] == ' ');
+    for (size_t i = 0; i < n && !quote; i++)
+        quote = s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r';
+    if (!quote) {
+        writer_write(w, s, n);
+        return;
+    }
+    char out[EXPORT_FIELD_MAX];
+    size_t k = 0;
+    out[k++] = '"';
+    for (; *s; s++) {
+        if (*s == '"') out[k++] = '"';
+        out[k++] = *s;
+    }
+    out[k++] = '"';
+    writer_write(w, out, k);
+}
+
+// Per-column pieces of each format, expanded over STUDENT_COLUMNS; the
+// row writers put a separator before every column but the first
+#define CSV_HEAD_PIECE(kind, field, tag, head, key, alias, width, size) "," head
+#define CSV_PUT_ID(f)   writer_printf(w, "%d", s->f);
+#define CSV_PUT_TEXT(f) export_csv_text(w, s->f);
+#define CSV_PUT_MARK(f) writer_printf(w, "%.1f", s->f);
+#define CSV_PUT(kind, field, tag, head, key, alias, width, size) \
+    if (!first) writer_write(w, ",", 1);                          \
+    first = 0;                                                    \
+    CSV_PUT_##kind(field)
+
+void export_csv_header(FileWriter *w) {
+    writer_printf(w, "%s", (STUDENT_COLUMNS(CSV_HEAD_PIECE) "\n") + 1);
+}
+
+void export_csv_row(FileWriter *w, const Student *s) {
+    int first = 1;
+    STUDENT_COLUMNS(CSV_PUT)
+    writer_write(w, "\n", 1);
+}
+
+// Write a JSON string (quotes, backslashes and control characters escaped)
+void export_json_text(FileWriter *w, const char *s) {
+    char out[EXPORT_FIELD_MAX];   // written out whenever it is nearly full
+    size_t k = 0;
+    out[k++] = '"';
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (k > sizeof(out) - 8) {   // flush before the next escape
+            writer_write(w, out, k);
+            k = 0;
+        }
+        if (c == '"' || c == '\\') {
+            out[k++] = '\\';
+            out[k++] = (char)c;
+        } else if (c < 0x20) {
+            k += (size_t)snprintf(out + k, sizeof(out) - k, "\\u%04x", c);
+        } else {
+            out[k++] = (char)c;
+        }
+    }
+    out[k++] = '"';
+    writer_write(w, out, k);
+}
+
+#define JSONL_PUT_ID(f)   writer_printf(w, "%d", s->f);
+#define JSONL_PUT_TEXT(f) export_json_text(w, s->f);
+#define JSONL_PUT_MARK(f) writer_printf(w, "%.1f", s->f);
+#define JSONL_PUT(kind, field, tag, head, key, alias, width, size) \
+    writer_printf(w, "%c\"" key "\":", first ? '{' : ',');        \
+    first = 0;                                                      \
+    JSONL_PUT_##kind(field)
+
+void export_jsonl_row(FileWriter *w, const Student *s) {
+    int first = 1;
+    STUDENT_COLUMNS(JSONL_PUT)
+    writer_write(w, "}\n", 2);
+}
+
+// Fixed-width report: the SHOW ALL columns, long text cut to fit
+#define FIXED_HEAD_ID(wd)   " %-" #wd "s"
+#define FIXED_HEAD_TEXT(wd) " %-" #wd "s"
+#define FIXED_HEAD_MARK(wd) " %" #wd "s"
+#define FIXED_ROW_ID(wd)    " %-" #wd "d"
+#define FIXED_ROW_TEXT(wd)  " %-" #wd "." #wd "s"
+#define FIXED_ROW_MARK(wd)  " %" #wd ".1f"
+#define FIXED_HEAD_PIECE(kind, field, tag, head, key, alias, width, size) FIXED_HEAD_##kind(width)
+#define FIXED_ROW_PIECE(kind, field, tag, head, key, alias, width, size)  FIXED_ROW_##kind(width)
+
+void export_fixed_header(FileWriter *w) {
+    writer_printf(w, (STUDENT_COLUMNS(FIXED_HEAD_PIECE) "\n") + 1 STUDENT_COLUMNS(COLUMN_HEAD));
+}
+
+void export_fixed_row(FileWriter *w, const Student *s) {
+    writer_printf(w, (STUDENT_COLUMNS(FIXED_ROW_PIECE) "\n") + 1 STUDENT_COLUMNS(COLUMN_ARG));
+}
+
+const ExportFormat g_export_formats[] = {
+    { "csv",   export_csv_header,   export_csv_row   },
+    { "jsonl", NULL,                export_jsonl_row },
+    { "fixed", export_fixed_header, export_fixed_row },
+};
+
+// EXPORT <file> FORMAT csv|jsonl|fixed [WHERE ...] [SORT BY ...]
+void cmd_export(const char *args) {
+    char file[260], kw[16], fmt[16];
+    int used = 0;
+    if (sscanf(args, "%259s %15s %15s%n", file, kw, fmt, &used) != 3 || !equals_ic(kw, "FORMAT")) {
+        cms_printf("CMS: Use EXPORT <file> FORMAT CSV|JSONL|FIXED [WHERE ...] [SORT BY ...].\n");
+        return;
+    }
+    const ExportFormat *ef = NULL;
+    for (size_t i = 0; i < sizeof(g_export_formats) / sizeof(g_export_formats[0]); i++)
+        if (equals_ic(fmt, g_export_formats[i].name)) ef = &g_export_formats[i];
+    if (!ef) {
+        cms_printf("CMS: Unknown export format \"%s\" (use CSV, JSONL or FIXED).\n", fmt);
+        return;
+    }
+    Filter f;
+    if (!parse_view_clause(args + used, &f, "EXPORT")) return;
+
+    int *sel = malloc((size_t)(t_tab->count ? t_tab->count : 1) * sizeof(int));
+    if (!sel) {
+        cms_printf("CMS: Out of memory.\n");
+        return;
+    }
+    int n = filter_select(&f, sel);
+    sort_selection_par(sel, n, f.sort_field, f.sort_asc);
+
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FileWriter w;
+    if (!writer_open(&w, tmp)) {
+        cms_printf("CMS: Cannot create \"%s\".\n", tmp);
+        free(sel);
+        return;
+    }
+    if (ef->header) ef->header(&w);
+    for (int i = 0; i < n && !w.failed; i++) ef->row(&w, row_at(sel[i]));
+    free(sel);
+
+    if (!writer_close(&w) || !replace_file(tmp, file)) {
+        remove(tmp);
+        cms_printf("CMS: Writing \"%s\" failed; it is unchanged.\n", file);
+        return;
+    }
+    cms_printf("CMS: %d record(s) exported to \"%s\" (%s).\n", n, file, ef->name);
+}
+
+/* ---------- FIND DUPLICATES (MinHash / LSH) ---------- */
+// FIND DUPLICATES [THRESHOLD x] lists pairs of records whose names
+// probably belong to the same person. A name is compared as the set of
+// letter trigrams of its words, so case, spacing and word order do not
+// matter ("Sky Teo", "Sky  Teo" and "teo sky" are the same set); two
+// names are near-duplicates when the Jaccard index of their sets is at
+// least x. Instead of comparing every pair, each name gets a MinHash
+// signature cut into bands, and only names that agree on a whole band
+// become candidates. Candidates are then checked on their exact sets.
+#define DUP_SIG        64                   // MinHash values per name
+#define DUP_SHINGLES   (2 * NAME_MAX_LEN)   // trigrams a name can have
+#define DUP_SHOW_MAX   50                   // pairs listed on screen
+#define DUP_THRESHOLD  0.8                  // default THRESHOLD
+
+typedef struct {
+    int                 chunk;
+    unsigned long long  seed[DUP_SIG];   // one hash function per value
+    unsigned           *sig;             // DUP_SIG values per row
+    unsigned char      *empty;           // rows whose name has no words
+} DupJob;
+
+// One band of one row: the bucket key and the row
+typedef struct {
+    unsigned long long key;
+    int                row;
+} DupBucket;
+
+// Scramble a 64-bit value (the splitmix64 finaliser)
+unsigned long long dup_mix(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+int cmp_ull(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+int cmp_dup_bucket(const void *a, const void *b) {
+    const DupBucket *x = a, *y = b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+// Distinct trigram hashes of a name, sorted; returns how many. Words are
+// runs of letters and digits (any non-ASCII byte counts as a letter),
+// lower-cased and padded with '#' so short words still give a trigram.
+int dup_shingles(const char *name, unsigned long long *out) {
+    int n = 0;
+    const unsigned char *p = (const unsigned char *)name;
+    while (*p) {
+        while (*p && !isalnum(*p) && *p < 0x80) p++;
+        if (!*p) break;
+        unsigned char gram[3] = { '#', 0, 0 };
+        int have = 1;
+        for (;;) {
+            int word = *p && (isalnum(*p) || *p >= 0x80);
+            unsigned char c = word ? (unsigned char)tolower(*p) : '#';
+            if (have < 3) {
+                gram[have++] = c;
+            } else {
+                gram[0] = gram[1];
+                gram[1] = gram[2];
+                gram[2] = c;
+            }
+            if (have == 3 && n < DUP_SHINGLES) out[n++] = fnv1a(FNV_OFFSET, gram, 3);
+            if (!word) break;
+            p++;
+        }
+    }
+    qsort(out, (size_t)n, sizeof(out[0]), cmp_ull);
+    int k = 0;
+    for (int i = 0; i < n; i++)
+        if (k == 0 || out[i] != out[k - 1]) out[k++] = out[i];
+    return k;
+}
+
+// Jaccard index of two names' trigram sets
+double dup_similarity(const char *a, const char *b) {
+    unsigned long long sa[DUP_SHINGLES], sb[DUP_SHINGLES];
+    int na = dup_shingles(a, sa), nb = dup_shingles(b, sb);
+    if (na == 0 || nb == 0) return 0;
+    int i = 0, j = 0, common = 0;
+    while (i < na && j < nb) {
+        if (sa[i] == sb[j]) {
+            common++;
+            i++;
+            j++;
+        } else if (sa[i] < sb[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return (double)common / (na + nb - common);
+}
+
+// MinHash signatures of one chunk of rows
+void dup_sig_task(void *arg, int c) {
+    DupJob *job = arg;
+    int lo = c * job->chunk;
+    int hi = lo + job->chunk < t_tab->count ? lo + job->chunk : t_tab->count;
+    unsigned long long sh[DUP_SHINGLES];
+    for (int i = lo; i < hi; i++) {
+        int n = dup_shingles(row_at(i)->name, sh);
+        unsigned *sig = &job->sig[(size_t)i * DUP_SIG];
+        job->empty[i] = n == 0;
+        for (int k = 0; k < DUP_SIG; k++) {
+            unsigned m = UINT_MAX;
+            for (int s = 0; s < n; s++) {
+                unsigned h = (unsigned)dup_mix(sh[s] ^ job->seed[k]);
+                if (h < m) m = h;
+            }
+            sig[k] = m;
+        }
+    }
+}
+
+// Values per band: as many as possible (fewer false candidates) while a
+// pair at the threshold still very likely agrees on some band, i.e. the
+// band curve's midpoint (1/bands)^(1/rows) stays well below it
+int dup_band_rows(double threshold) {
+    for (int r = 8; r > 1; r /= 2)
+        if (pow(1.0 / (DUP_SIG / r), 1.0 / r) <= 0.75 * threshold) return r;
+    return 1;
+}
+
+// Candidate pairs (lower row << 32 | higher row), sorted and distinct;
+// returns how many, or -1 if out of memory
+long long dup_candidates(const DupJob *job, int rows, unsigned long long **pairs) {
+    int n = t_tab->count;
+    DupBucket *b = malloc((size_t)n * sizeof(DupBucket));
+    unsigned long long *p = NULL;
+    long long np = 0, cap = 0;
+    if (!b) return -1;
+
+    for (int band = 0; band < DUP_SIG / rows; band++) {
+        int nb = 0;
+        for (int i = 0; i < n; i++) {
+            if (job->empty[i]) continue;
+            b[nb].key = fnv1a(FNV_OFFSET ^ (unsigned long long)band,
+                              &job->sig[(size_t)i * DUP_SIG + (size_t)band * rows],
+                              (size_t)rows * sizeof(unsigned));
+            b[nb++].row = i;
+        }
+        qsort(b, (size_t)nb, sizeof(DupBucket), cmp_dup_bucket);
+        for (int s = 0, e; s < nb; s = e) {
+            for (e = s + 1; e < nb && b[e].key == b[s].key; e++) {}
+            for (int x = s; x < e; x++) {
+                for (int y = x + 1; y < e; y++) {
+                    if (np == cap) {
+                        cap = cap ? cap * 2 : 1024;
+                        unsigned long long *q = realloc(p, (size_t)cap * sizeof(*p));
+                        if (!q) {
+                            free(p);
+                            free(b);
+                            return -1;
+                        }
+                        p = q;
+                    }
+                    p[np++] = (unsigned long long)b[x].row << 32 | (unsigned)b[y].row;
+                }
+            }
+        }
+    }
+    free(b);
+
+    qsort(p, (size_t)np, sizeof(*p), cmp_ull);
+    long long k = 0;
+    for (long long i = 0; i < np; i++)
+        if (k == 0 || p[i] != p[k - 1]) p[k++] = p[i];
+    *pairs = p;
+    return k;
+}
+
+// FIND DUPLICATES [THRESHOLD x]
+void cmd_find(const char *args) {
+    char what[16] = "", kw[16] = "";
+    double threshold = DUP_THRESHOLD;
+    int used = 0;
+    int nf = sscanf(args, "%15s %15s %lf%n", what, kw, &threshold, &used);
+    while (nf >= 3 && isspace((unsigned char)args[used])) used++;
+    if (nf < 1 || !equals_ic(what, "DUPLICATES") ||
+        (nf >= 2 && (!equals_ic(kw, "THRESHOLD") || nf < 3 || args[used] != '\0')) ||
+        !(threshold > 0 && threshold <= 1)) {
+        cms_printf("CMS: Use FIND DUPLICATES [THRESHOLD <0-1>] (default %.2f).\n", DUP_THRESHOLD);
+        return;
+    }
+    int n = t_tab->count;
+    if (n == 0) {
+        cms_printf("CMS: No records loaded.\n");
+        return;
+    }
+
+    DupJob job;
+    job.chunk = par_chunk(n);
+    job.sig = malloc((size_t)n * DUP_SIG * sizeof(unsigned));
+    job.empty = malloc((size_t)n);
+    if (!job.sig || !job.empty) {
+        cms_printf("CMS: Out of memory.\n");
+        free(job.sig);
+        free(job.empty);
+        return;
+    }
+    for (int k = 0; k < DUP_SIG; k++) job.seed[k] = dup_mix((unsigned long long)k + 1);
+    par_run((n + job.chunk - 1) / job.chunk, dup_sig_task, &job, n >= PAR_MIN_ROWS);
+
+    unsigned long long *pairs = NULL;
+    long long ncand = dup_candidates(&job, dup_band_rows(threshold), &pairs);
+    free(job.sig);
+    free(job.empty);
+    if (ncand < 0) {
+        cms_printf("CMS: Out of memory.\n");
+        return;
+    }
+
+    long long found = 0;
+    for (long long i = 0; i < ncand; i++) {
+        const Student *a = row_at((int)(pairs[i] >> 32));
+        const Student *b = row_at((int)(pairs[i] & 0xffffffffu));
+        double sim = dup_similarity(a->name, b->name);
+        if (sim < threshold) continue;
+        if (found == 0)
+            cms_printf("CMS: Names with similarity >= %.2f:\n", threshold);
+        if (found < DUP_SHOW_MAX)
+            cms_printf("  %-10d %-20s ~ %-10d %-20s (%.2f)\n", a->id, a->name, b->id, b->name, sim);
+        found++;
+    }
+    free(pairs);
+
+    if (found > DUP_SHOW_MAX)
+        cms_printf("  ... and %lld more pair(s).\n", found - DUP_SHOW_MAX);
+    if (found == 0)
+        cms_printf("CMS: No near-duplicate names at similarity >= %.2f.\n", threshold);
+    cms_printf("CMS: %lld pair(s) found; %lld candidate pair(s) checked out of %lld.\n",
+               found, ncand, (long long)n * (n - 1) / 2);
+}
+
+/* ---------- CHANGE DATA CAPTURE (CDC) ---------- */
+// CDC ON <log> appends every change to the table to an append-only log,
+// one JSON object per line: the events the undo history records (INSERT,
+// UPDATE, DELETE, one event per row for the bulk forms), the UNDOs that
+// reverse them ("undo":true), rows WATCH brings in from disk, and an
+// "open" event when OPEN replaces the table (consumers reload the file).
+//   {"seq":7,"version":12,"ts":1760780000123456,"table":"P10_6-cms.txt",
+//    "op":"update","before":{"id":2201234,...},"after":{"id":2201234,...}}
+// Sequence numbers keep counting across runs, so a consumer remembers
+// the last one it applied and resumes after it. A writing command's
+// events are held back and appended when it publishes its version, so
+// the log holds only committed changes, in commit order; "ts" is the
+// publish time (microseconds) and the version's last event is marked
+// "commit":true.
+// CDC SERVE <socket> (Linux) streams the log over a Unix socket: a
+// consumer sends "FROM <seq>" and gets every event from that number on,
+// then new ones as they are committed.
+#define CDC_TAIL_SCAN 65536            // bytes read back to find the last sequence number
+#define CDC_LINE_MAX  (8 * LINE_MAX_LEN) // longest event, every character escaped
+
+typedef struct {
+    pthread_mutex_t lock;       // guards everything below but 'pending'
+    pthread_cond_t  grown;      // broadcast when events are appended
+    atomic_int      on;
+    FILE           *log;
+    char            path[260];
+    unsigned long long seq;     // last sequence number in the log
+    int             gen;        // bumped by CDC OFF (consumers of the old log stop)
+    int             listen_fd;  // CDC SERVE socket (-1 = none)
+    char            sock_path[108];
+    int             consumers;
+    char           *pending;    // events of the running write (writer lock)
+    size_t          pending_len, pending_cap;
+} Cdc;
+
+Cdc g_cdc = { .lock = PTHREAD_MUTEX_INITIALIZER, .grown = PTHREAD_COND_INITIALIZER,
+              .listen_fd = -1 };
+
+// Append formatted text to the pending events
+void cdc_putf(const char *fmt, ...) {
+    va_list ap;
+    for (int tries = 0; tries < 2; tries++) {
+        size_t room = g_cdc.pending_cap - g_cdc.pending_len;
+        va_start(ap, fmt);
+        int n = vsnprintf(g_cdc.pending ? g_cdc.pending + g_cdc.pending_len : NULL, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            g_cdc.pending_len += (size_t)n;
+            return;
+        }
+        size_t ncap = g_cdc.pending_cap ? g_cdc.pending_cap : 4096;
+        while (ncap < g_cdc.pending_len + (size_t)n + 1) ncap *= 2;
+        char *nb = realloc(g_cdc.pending, ncap);
+        if (!nb) return;   // the event is lost rather than the command
+        g_cdc.pending = nb;
+        g_cdc.pending_cap = ncap;
+    }
+}
+
+// A JSON string (names come from files, so escape everything needed)
+void cdc_put_str(const char *s) {
+    cdc_putf("\"");
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') cdc_putf("\\%c", c);
+        else if (c < 0x20) cdc_putf("\\u%04x", c);
+        else cdc_putf("%c", c);
+    }
+    cdc_putf("\"");
+}
+
+#define CDC_PUT_ID(f)   cdc_putf("%d", s->f);
+#define CDC_PUT_TEXT(f) cdc_put_str(s->f);
+#define CDC_PUT_MARK(f) cdc_putf("%.1f", s->f);
+#define CDC_PUT(kind, field, tag, head, key, alias, width, size) \
+    cdc_putf("%c\"" key "\":", first ? '{' : ',');               \
+    first = 0;                                                     \
+    CDC_PUT_##kind(field)
+
+void cdc_put_row(const char *key, const Student *s) {
+    int first = 1;
+    cdc_putf(",\"%s\":", key);
+    STUDENT_COLUMNS(CDC_PUT)
+    cdc_putf("}");
+}
+
+// Record one row change of the running write: op 'I', 'U' or 'D'
+void cdc_record(char op, const Student *before, const Student *after, int undo) {
+    if (!atomic_load(&g_cdc.on)) return;
+    cdc_putf("\"table\":");
+    cdc_put_str(t_tab->filename);
+    cdc_putf(",\"op\":\"%s\"", op == 'I' ? "insert" : op == 'U' ? "update" : "delete");
+    if (undo) cdc_putf(",\"undo\":true");
+    if (before) cdc_put_row("before", before);
+    if (after) cdc_put_row("after", after);
+    cdc_putf("}\n");
+}
+
+// OPEN replaced the table with the contents of its file
+void cdc_record_open(void) {
+    if (!atomic_load(&g_cdc.on)) return;
+    cdc_putf("\"table\":");
+    cdc_put_str(t_tab->filename);
+    cdc_putf(",\"op\":\"open\",\"count\":%d}\n", t_tab->count);
+}
+
+// Wall-clock time in microseconds (event times, replication lag)
+long long cdc_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The write is being published: number its events and append them
+void cdc_commit(unsigned long version) {
+    if (!g_cdc.pending_len) return;
+    pthread_mutex_lock(&g_cdc.lock);
+    if (g_cdc.log) {
+        long long now = cdc_now_us();
+        for (char *ev = g_cdc.pending, *end = ev + g_cdc.pending_len; ev < end; ) {
+            char *nl = memchr(ev, '\n', (size_t)(end - ev));
+            fprintf(g_cdc.log, "{\"seq\":%llu,\"version\":%lu,\"ts\":%lld,%s%.*s\n",
+                    ++g_cdc.seq, version, now, nl + 1 == end ? "\"commit\":true," : "",
+                    (int)(nl - ev), ev);
+            ev = nl + 1;
+        }
+        fflush(g_cdc.log);
+        pthread_cond_broadcast(&g_cdc.grown);
+    }
+    pthread_mutex_unlock(&g_cdc.lock);
+    g_cdc.pending_len = 0;
+}
+
+// The write was abandoned: so are its events
+void cdc_discard(void) {
+    g_cdc.pending_len = 0;
+}
+
+// Sequence number of one log line (0 if it has none)
+unsigned long long cdc_line_seq(const char *line) {
+    return strncmp(line, "{\"seq\":", 7) == 0 ? strtoull(line + 7, NULL, 10) : 0;
+}
+
+#ifdef __linux__
+
+// One consumer of CDC SERVE: replay the log from the asked-for number,
+// then follow it as it grows
+void *cdc_consumer_main(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    char req[64];
+    size_t n = 0;
+    // The request line: "FROM <seq>" (up to 5 s to send it)
+    struct timeval tv = { 5, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while (n < sizeof(req) - 1) {
+        ssize_t r = recv(fd, req + n, 1, 0);
+        if (r <= 0 || req[n] == '\n') break;
+        n++;
+    }
+    req[n] = '\0';
+    unsigned long long from = 0;
+    if (!starts_with_ic(req, "FROM ") || sscanf(req + 5, "%llu", &from) != 1) {
+        const char *msg = "ERROR expected FROM <seq>\n";
+        if (send(fd, msg, strlen(msg), MSG_NOSIGNAL) < 0) { /* closing anyway */ }
+        close(fd);
+        pthread_mutex_lock(&g_cdc.lock);
+        g_cdc.consumers--;
+        pthread_mutex_unlock(&g_cdc.lock);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_cdc.lock);
+    int gen = g_cdc.gen;
+    FILE *fp = g_cdc.log ? fopen(g_cdc.path, "r") : NULL;
+    pthread_mutex_unlock(&g_cdc.lock);
+
+    char line[CDC_LINE_MAX];
+    unsigned long long sent = from ? from - 1 : 0;   // last number delivered
+    while (fp) {
+        long at = ftell(fp);
+        if (fgets(line, sizeof(line), fp)) {
+            size_t len = strlen(line);
+            if (line[len - 1] != '\n') {      // caught an append half-way
+                fseek(fp, at, SEEK_SET);
+            } else {
+                unsigned long long seq = cdc_line_seq(line);
+                if (seq <= sent) continue;
+                if (send(fd, line, len, MSG_NOSIGNAL) < 0) break;
+                sent = seq;
+                continue;
+            }
+        }
+        // At the end of the log: wait for more (or for CDC OFF)
+        clearerr(fp);
+        pthread_mutex_lock(&g_cdc.lock);
+        while (g_cdc.gen == gen && g_cdc.seq <= sent)
+            pthread_cond_wait(&g_cdc.grown, &g_cdc.lock);
+        int stop = g_cdc.gen != gen;
+        pthread_mutex_unlock(&g_cdc.lock);
+        if (stop) break;
+    }
+    if (fp) fclose(fp);
+    close(fd);
+    pthread_mutex_lock(&g_cdc.lock);
+    g_cdc.consumers--;
+    pthread_mutex_unlock(&g_cdc.lock);
+    return NULL;
+}
+
+// Accept consumers until CDC OFF closes the socket
+void *cdc_accept_main(void *arg) {
+    int lfd = (int)(intptr_t)arg;
+    while (1) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;   // socket shut down
+        }
+        pthread_t th;
+        pthread_mutex_lock(&g_cdc.lock);
+        g_cdc.consumers++;
+        pthread_mutex_unlock(&g_cdc.lock);
+        if (pthread_create(&th, NULL, cdc_consumer_main, (void *)(intptr_t)fd) == 0) {
+            pthread_detach(th);
+        } else {
+            close(fd);
+            pthread_mutex_lock(&g_cdc.lock);
+            g_cdc.consumers--;
+            pthread_mutex_unlock(&g_cdc.lock);
+        }
+    }
+    close(lfd);
+    return NULL;
+}
+
+// CDC SERVE <socket>
+void cdc_serve(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        cms_printf("CMS: Socket path too long.\n");
+        return;
+    }
+    pthread_mutex_lock(&g_cdc.lock);
+    int busy = g_cdc.listen_fd >= 0, on = g_cdc.log != NULL;
+    pthread_mutex_unlock(&g_cdc.lock);
+    if (!on) {
+        cms_printf("CMS: Turn CDC on first (CDC ON <log>).\n");
+        return;
+    }
+    if (busy) {
+        cms_printf("CMS: Already serving the change stream on \"%s\".\n", g_cdc.sock_path);
+        return;
+    }
+
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    pthread_t th;
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 16) < 0 ||
+        pthread_create(&th, NULL, cdc_accept_main, (void *)(intptr_t)lfd) != 0) {
+        cms_printf("CMS: Cannot listen on \"%s\".\n", path);
+        if (lfd >= 0) close(lfd);
+        return;
+    }
+    pthread_detach(th);
+    pthread_mutex_lock(&g_cdc.lock);
+    g_cdc.listen_fd = lfd;
+    snprintf(g_cdc.sock_path, sizeof(g_cdc.sock_path), "%s", path);
+    pthread_mutex_unlock(&g_cdc.lock);
+    cms_printf("CMS: Serving the change stream on \"%s\" (consumers send FROM <seq>).\n", path);
+}
+
+// Stop accepting consumers (lock held)
+void cdc_unserve(void) {
+    if (g_cdc.listen_fd < 0) return;
+    shutdown(g_cdc.listen_fd, SHUT_RDWR);   // the accept thread closes it
+    unlink(g_cdc.sock_path);
+    g_cdc.listen_fd = -1;
+    g_cdc.sock_path[0] = '\0';
+}
+
+#else
+
+void cdc_serve(const char *path) {
+    (void)path;
+    cms_printf("CMS: CDC SERVE is only available on Linux.\n");
+}
+
+void cdc_unserve(void) {
+}
+
+#endif
+
+// CDC ON <log> | OFF | SERVE <socket> | STATUS
+void cmd_cdc(const char *args) {
+    while (*args && isspace((unsigned char)*args)) args++;
+    if (starts_with_ic(args, "ON ")) {
+        char path[260] = "";
+        sscanf(args + 3, " %259s", path);
+        pthread_mutex_lock(&g_cdc.lock);
+        if (g_cdc.log) {
+            cms_printf("CMS: CDC is already on (\"%s\").\n", g_cdc.path);
+            pthread_mutex_unlock(&g_cdc.lock);
+            return;
+        }
+        FILE *fp = path[0] ? fopen(path, "a+") : NULL;
+        if (!fp) {
+            cms_printf("CMS: Cannot open \"%s\" for the change log.\n", path);
+            pthread_mutex_unlock(&g_cdc.lock);
+            return;
+        }
+        // Carry on from the last sequence number already in the log
+        unsigned long long seq = 0;
+        char line[CDC_LINE_MAX];
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, size > CDC_TAIL_SCAN ? size - CDC_TAIL_SCAN : 0, SEEK_SET);
+        while (fgets(line, sizeof(line), fp)) {
+            unsigned long long s = cdc_line_seq(line);
+            if (s > seq) seq = s;
+        }
+        fseek(fp, 0, SEEK_END);
+        g_cdc.log = fp;
+        g_cdc.seq = seq;
+        snprintf(g_cdc.path, sizeof(g_cdc.path), "%s", path);
+        atomic_store(&g_cdc.on, 1);
+        pthread_mutex_unlock(&g_cdc.lock);
+        cms_printf("CMS: Recording changes to \"%s\" (next sequence number %llu).\n", path, seq + 1);
+    } else if (equals_ic(args, "OFF")) {
+        pthread_mutex_lock(&g_cdc.lock);
+        if (!g_cdc.log) {
+            cms_printf("CMS: CDC is already off.\n");
+        } else {
+            atomic_store(&g_cdc.on, 0);
+            cdc_unserve();
+            fclose(g_cdc.log);
+            g_cdc.log = NULL;
+            g_cdc.gen++;
+            pthread_cond_broadcast(&g_cdc.grown);
+            cms_printf("CMS: CDC is off (last sequence number %llu).\n", g_cdc.seq);
+        }
+        pthread_mutex_unlock(&g_cdc.lock);
+    } else if (starts_with_ic(args, "SERVE ")) {
+        char path[260] = "";
+        sscanf(args + 6, " %259s", path);
+        cdc_serve(path);
+    } else if (args[0] == '\0' || equals_ic(args, "STATUS")) {
+        pthread_mutex_lock(&g_cdc.lock);
+        if (!g_cdc.log) cms_printf("CMS: CDC is off.\n");
+        else {
+            cms_printf("CMS: Recording changes to \"%s\"; last sequence number %llu.\n",
+                       g_cdc.path, g_cdc.seq);
+            if (g_cdc.listen_fd >= 0)
+                cms_printf("CMS: Serving \"%s\" to %d consumer(s).\n", g_cdc.sock_path, g_cdc.consumers);
+        }
+        pthread_mutex_unlock(&g_cdc.lock);
+    } else {
+        cms_printf("CMS: Use CDC ON <log>, CDC OFF, CDC SERVE <socket> or CDC STATUS.\n");
+    }
+}
+
+/* ---------- REPLICA (cms --replica) ---------- */
+// A replica is a separate, read-only server process that follows the
+// change stream of a primary, so student sessions query a copy of the
+// table instead of sharing the primary's CPU and writer lock:
+//   primary:  CDC ON cms.cdc   then   CDC SERVE cms-cdc.sock
+//   replica:  cms --replica cms-cdc.sock replica.sock [file]
+// The replica loads the file, replays the log from the start and then
+// follows it. Each event sets a row to its logged state (inserting a row
+// that is already there replaces it, deleting a missing one does
+// nothing), so replaying changes the file already has still ends at the
+// primary's table. The events of one primary version are published as
+// one replica version. Edits the primary made before CDC ON reach the
+// replica only through SAVE.
+#define REPLICA_RETRY_MS 1000   // wait before reconnecting to the primary
+
+typedef struct {
+    pthread_mutex_t lock;            // guards the figures below
+    int    on;                       // set once at startup: this is a replica
+    char   source[108];              // the primary's CDC socket
+    char   table[260];               // the table file followed
+    int    connected;
+    unsigned long long seq;          // last event applied and published
+    unsigned long long events, versions;
+    long long connected_at;          // when the current link came up (us)
+    // Lag (primary publish -> replica publish, us) of versions published
+    // while connected; the catch-up after connecting is not lag
+    long long lag_last, lag_max, lag_n;
+    double lag_sum;
+} Replica;
+
+Replica g_replica = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Read a JSON string written by cdc_put_str; returns the text after it
+const char *json_get_str(const char *p, char *out, size_t cap) {
+    size_t n = 0;
+    if (*p++ != '"') return NULL;
+    while (*p && *p != '"') {
+        char c = *p++;
+        if (c == '\\' && *p == 'u') {   // \u00XX: a control character
+            char hex[5] = "";
+            for (int k = 0; k < 4 && p[k + 1]; k++) hex[k] = p[k + 1];
+            c = (char)strtol(hex, NULL, 16);
+            p += 1 + strlen(hex);
+        } else if (c == '\\' && *p) {
+            c = *p++;
+        }
+        if (n + 1 < cap) out[n++] = c;
+    }
+    out[n] = '\0';
+    return *p == '"' ? p + 1 : NULL;
+}
+
+// Read the row object after "key": (the cdc_put_row layout)
+#define JSON_GET_ID(f)   if (sscanf(p, "%d%n", &s->f, &used) != 1) return 0; p += used;
+#define JSON_GET_TEXT(f) if (!(p = json_get_str(p, s->f, sizeof(s->f)))) return 0;
+#define JSON_GET_MARK(f) if (sscanf(p, "%f%n", &s->f, &used) != 1) return 0; p += used;
+#define JSON_GET(kind, field, tag, head, key, alias, width, size) \
+    if (!first && *p++ != ',') return 0;                           \
+    first = 0;                                                     \
+    if (strncmp(p, "\"" key "\":", sizeof(key) + 2) != 0) return 0; \
+    p += sizeof(key) + 2;                                          \
+    JSON_GET_##kind(field)
+
+int json_get_row(const char *line, const char *key, Student *s) {
+    char pat[16];
+    snprintf(pat, sizeof(pat), "\"%s\":{", key);
+    const char *p = strstr(line, pat);
+    int used, first = 1;
+    if (!p) return 0;
+    p += strlen(pat);
+    STUDENT_COLUMNS(JSON_GET)
+    return 1;
+}
+
+// Set the row with s's ID to s, adding it if it is not there
+void replica_upsert(const Student *s) {
+    int idx = find_index_by_id(s->id);
+    if (idx >= 0) *row_mut(idx) = *s;
+    else if (t_tab->count < MAX_STUDENTS) *row_mut(t_tab->count++) = *s;
+}
+
+void replica_remove(int id) {
+    int idx = find_index_by_id(id);
+    if (idx < 0) return;
+    for (int i = idx; i < t_tab->count - 1; i++) *row_mut(i) = *row_at(i + 1);
+    t_tab->count--;
+}
+
+// Apply one event line. The write stays open until the version's last
+// event; returns 0 if the line is not an event.
+int replica_apply(const char *line, int *writing) {
+    unsigned long long seq = cdc_line_seq(line);
+    const char *p = strstr(line, "\"table\":");
+    char table[260], op[16] = "";
+    if (!seq || !p || !(p = json_get_str(p + 8, table, sizeof(table)))) return 0;
+    sscanf(p, ",\"op\":\"%15[a-z]\"", op);
+
+    if (strcmp(table, g_replica.table) == 0) {
+        if (!*writing && !table_write_begin()) return 0;
+        *writing = 1;
+        Student before, after;
+        int has_before = json_get_row(line, "before", &before);
+        int has_after = json_get_row(line, "after", &after);
+        if (strcmp(op, "open") == 0) {
+            if (!load_from_file(g_replica.table)) table_clear();
+        } else if (strcmp(op, "insert") == 0 && has_after) {
+            replica_upsert(&after);
+        } else if (strcmp(op, "update") == 0 && has_before && has_after) {
+            if (before.id != after.id) replica_remove(before.id);
+            replica_upsert(&after);
+        } else if (strcmp(op, "delete") == 0 && has_before) {
+            replica_remove(before.id);
+        }
+    }
+
+    int commit = strstr(line, "\"commit\":true") != NULL;
+    long long published = 0, now = 0;
+    if (commit) {
+        if (*writing) table_write_end();
+        *writing = 0;
+        const char *ts = strstr(line, "\"ts\":");
+        if (ts) published = strtoll(ts + 5, NULL, 10);
+        now = cdc_now_us();
+    }
+    pthread_mutex_lock(&g_replica.lock);
+    g_replica.events++;
+    if (commit) {
+        g_replica.seq = seq;
+        g_replica.versions++;
+        if (published >= g_replica.connected_at) {
+            long long lag = now - published;
+            g_replica.lag_last = lag;
+            if (lag > g_replica.lag_max) g_replica.lag_max = lag;
+            g_replica.lag_sum += (double)lag;
+            g_replica.lag_n++;
+        }
+    }
+    pthread_mutex_unlock(&g_replica.lock);
+    return 1;
+}
+
+#ifdef __linux__
+
+// Replication thread: stream events from the primary, reconnecting (and
+// resuming after the last published event) whenever the link drops
+void *replica_main(void *arg) {
+    (void)arg;
+    static char buf[4 * CDC_LINE_MAX];
+    while (1) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, g_replica.source);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            if (fd >= 0) close(fd);
+            poll(NULL, 0, REPLICA_RETRY_MS);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_replica.lock);
+        unsigned long long from = g_replica.seq + 1;
+        g_replica.connected = 1;
+        g_replica.connected_at = cdc_now_us();
+        pthread_mutex_unlock(&g_replica.lock);
+        char req[64];
+        int n = snprintf(req, sizeof(req), "FROM %llu\n", from);
+        size_t len = 0;
+        int writing = 0, ok = send(fd, req, (size_t)n, MSG_NOSIGNAL) == n;
+        while (ok) {
+            ssize_t r = recv(fd, buf + len, sizeof(buf) - len, 0);
+            if (r <= 0) break;
+            len += (size_t)r;
+            char *line = buf, *nl;
+            while (ok && (nl = memchr(line, '\n', (size_t)(buf + len - line)))) {
+                *nl = '\0';
+                ok = replica_apply(line, &writing);
+                line = nl + 1;
+            }
+            len -= (size_t)(line - buf);
+            memmove(buf, line, len);
+            if (len == sizeof(buf)) ok = 0;   // no event is this long
+        }
+        // A version cut off half-way is asked for again on reconnecting
+        if (writing) table_write_abort();
+        close(fd);
+        pthread_mutex_lock(&g_replica.lock);
+        g_replica.connected = 0;
+        pthread_mutex_unlock(&g_replica.lock);
+        poll(NULL, 0, REPLICA_RETRY_MS);
+    }
+    return NULL;
+}
+
+// Start following 'source' with 'table' loaded; returns 0 on failure
+int replica_start(const char *source, const char *table) {
+    struct sockaddr_un addr;
+    if (strlen(source) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "CMS: Socket path too long.\n");
+        return 0;
+    }
+    snprintf(g_replica.source, sizeof(g_replica.source), "%s", source);
+    snprintf(g_replica.table, sizeof(g_replica.table), "%s", table);
+    g_replica.on = 1;
+    pthread_t th;
+    if (pthread_create(&th, NULL, replica_main, NULL) != 0) {
+        fprintf(stderr, "CMS: Cannot start replication.\n");
+        return 0;
+    }
+    pthread_detach(th);
+    return 1;
+}
+
+#else
+
+int replica_start(const char *source, const char *table) {
+    (void)source;
+    (void)table;
+    fprintf(stderr, "CMS: Replica mode is only available on Linux.\n");
+    return 0;
+}
+
+#endif
+
+// STATS: table, change log and replication figures
+void cmd_stats(void) {
+    cms_printf("CMS: Table \"%s\": %d record(s), version %lu.\n",
+               t_tab->filename, t_tab->count, t_tab->number);
+    pthread_mutex_lock(&g_cdc.lock);
+    if (g_cdc.log)
+        cms_printf("CMS: Change log \"%s\": last sequence number %llu, %d consumer(s).\n",
+                   g_cdc.path, g_cdc.seq, g_cdc.consumers);
+    pthread_mutex_unlock(&g_cdc.lock);
+    if (!g_replica.on) return;
+
+    pthread_mutex_lock(&g_replica.lock);
+    cms_printf("CMS: Replica of \"%s\" (%s): applied up to event %llu, %llu event(s) in %llu version(s).\n",
+               g_replica.source, g_replica.connected ? "connected" : "reconnecting",
+               g_replica.seq, g_replica.events, g_replica.versions);
+    if (g_replica.lag_n)
+        cms_printf("CMS: Replication lag: last %.3f ms, average %.3f ms, max %.3f ms.\n",
+                   g_replica.lag_last / 1000.0, g_replica.lag_sum / g_replica.lag_n / 1000.0,
+                   g_replica.lag_max / 1000.0);
+    pthread_mutex_unlock(&g_replica.lock);
+}
+
+/* ---------- UNDO ---------- */
+// UNDO command: revert the last INSERT/UPDATE/DELETE if possible
+void cmd_undo(void) {
+    if (g_table.undo_count == 0) {
+        cms_printf("CMS: No actions to undo.\n");
+        return;
+    }
+
+    // Take the last action from the undo stack
+    UndoEntry last = g_table.undo[g_table.undo_count - 1];
+    g_table.undo_count--;
+
+    // Display the most recent amendment in a clear, professional format
+    cms_printf("\n--------------------------------------------------\n");
+    cms_printf("   MOST RECENT AMENDMENT DETAILS\n");
+    cms_printf("--------------------------------------------------\n");
+
+    if (last.op == 'I') {
+        // INSERT operation
+        cms_printf("Operation:  Insert\n");
+        cms_printf("Student ID: %d\n", last.after.id);
+        cms_printf("Name:       %s\n", last.after.name);
+        cms_printf("Programme:  %s\n", last.after.programme);
+        cms_printf("Mark:       %.1f\n", last.after.mark);
+    } else if (last.op == 'U') {
+        // UPDATE operation
+        cms_printf("Operation:  Update\n");
+        cms_printf("Student ID: %d\n", last.before.id);
+        cms_printf("Name:       %s -> %s\n", last.before.name, last.after.name);
+        cms_printf("Programme:  %s -> %s\n", last.before.programme, last.after.programme);
+        cms_printf("Mark:       %.1f -> %.1f\n", last.before.mark, last.after.mark);
+    } else if (last.op == 'D') {
+        // DELETE operation
+        cms_printf("Operation:  Delete\n");
+        cms_printf("Student ID: %d\n", last.before.id);
+        cms_printf("Name:       %s\n", last.before.name);
+        cms_printf("Programme:  %s\n", last.before.programme);
+        cms_printf("Mark:       %.1f\n", last.before.mark);
+    } else if (last.op == 'B' || last.op == 'X') {
+        // Bulk UPDATE / DELETE: one grouped entry covering many records
+        cms_printf("Operation:  %s\n", last.op == 'B' ? "Bulk update" : "Bulk delete");
+        cms_printf("Records:    %d\n", last.nrows);
+        for (int i = 0; i < last.nrows && i < 5; i++)
+            cms_printf("  ID: %d, Name: %s, Mark: %.1f\n",
+                   last.rows[i].id, last.rows[i].name, last.rows[i].mark);
+        if (last.nrows > 5) cms_printf("  ... and %d more\n", last.nrows - 5);
+    }
+
+    cms_printf("--------------------------------------------------\n");
+
+    // Ask for confirmation before actually undoing
+    if (prompt_yes_no("Do you want to undo this action?")) {
+        if (last.op == 'I') {
+            // Undo INSERT → remove inserted student
+            int idx = find_index_by_id(last.after.id);
+            if (idx >= 0) {
+                cdc_record('D', row_at(idx), NULL, 1);
+                for (int i = idx; i < t_tab->count - 1; i++)
+                    *row_mut(i) = *row_at(i + 1);
+                t_tab->count--;
+            }
+            cms_printf("CMS: Undo successful (INSERT undone).\n");
+        } else if (last.op == 'D') {
+            // Undo DELETE → restore deleted student
+            if (t_tab->count < MAX_STUDENTS) {
+                *row_mut(t_tab->count++) = last.before;
+                cdc_record('I', NULL, &last.before, 1);
+                cms_printf("CMS: Undo successful (DELETE undone).\n");
+            } else {
+                cms_printf("CMS: Undo failed (storage full).\n");
+            }
+        } else if (last.op == 'U') {
+            // Undo UPDATE → revert back to old state
+            int idx = find_index_by_id(last.after.id);
+            if (idx >= 0) {
+                cdc_record('U', row_at(idx), &last.before, 1);
+                *row_mut(idx) = last.before;
+                cms_printf("CMS: Undo successful (UPDATE undone).\n");
+            } else {
+                cms_printf("CMS: Undo failed (record not found).\n");
+            }
+        } else if (last.op == 'B') {
+            // Undo bulk UPDATE → restore the rows that still hold its after-images
+            int restored = undo_bulk_update(last.rows, last.afters, last.nrows);
+            if (restored < 0) {
+                cms_printf("CMS: Undo failed (out of memory).\n");
+            } else {
+                cms_printf("CMS: Undo successful (bulk UPDATE of %d record(s) undone).\n", restored);
+                if (restored < last.nrows)
+                    cms_printf("CMS: %d record(s) changed since the update were left as they are.\n",
+                           last.nrows - restored);
+            }
+        } else if (last.op == 'X') {
+            // Undo bulk DELETE → append the deleted records back
+            if (t_tab->count + last.nrows <= MAX_STUDENTS) {
+                for (int i = 0; i < last.nrows; i++) {
+                    *row_mut(t_tab->count++) = last.rows[i];
+                    cdc_record('I', NULL, &last.rows[i], 1);
+                }
+                cms_printf("CMS: Undo successful (bulk DELETE of %d record(s) undone).\n", last.nrows);
+            } else {
+                cms_printf("CMS: Undo failed (storage full).\n");
+            }
+        }
+        cms_printf("Remember to type SAVE to save your changes.\n");
+    } else {
+        cms_printf("Undo cancelled.\n");
+    }
+    free(last.rows);   // bulk entries own their images
+    free(last.afters);
+}
+
+// Ascending order of ints (row indices)
+int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// SHOW SUMMARY from the intake partitions: totals come from the
+// per-partition stats, and only partitions holding the highest or lowest
+// mark are scanned for the students to list (in table order).
+// Returns the average.
+float summary_from_parts(const PartDir *d, float *max_mark, float *min_mark,
+                         int *max_students, int *max_count,
+                         int *min_students, int *min_count) {
+    double sum = 0;
+    *max_mark = d->parts[0].max_mark;
+    *min_mark = d->parts[0].min_mark;
+    for (int p = 0; p < d->nparts; p++) {
+        sum += d->parts[p].sum;
+        if (d->parts[p].max_mark > *max_mark) *max_mark = d->parts[p].max_mark;
+        if (d->parts[p].min_mark < *min_mark) *min_mark = d->parts[p].min_mark;
+    }
+
+    *max_count = *min_count = 0;
+    for (int p = 0; p < d->nparts; p++) {
+        const Partition *pt = &d->parts[p];
+        if (pt->max_mark != *max_mark && pt->min_mark != *min_mark) continue;
+        for (int k = 0; k < pt->count; k++) {
+            float mark = row_key(pt->rows[k])->mark;
+            if (mark == *max_mark) max_students[(*max_count)++] = pt->rows[k];
+            if (mark == *min_mark) min_students[(*min_count)++] = pt->rows[k];
+        }
+    }
+    qsort(max_students, (size_t)*max_count, sizeof(int), cmp_int);
+    qsort(min_students, (size_t)*min_count, sizeof(int), cmp_int);
+    return (float)(sum / t_tab->count);
+}
+
+// Partial SHOW SUMMARY result for one chunk of rows
+typedef struct {
+    double sum;
+    float  max_mark, min_mark;
+    int    max_count, min_count;   // tied students found in pass two
+} SummaryPart;
+
+// Parallel SHOW SUMMARY reduction over chunks of rows
+typedef struct {
+    int          chunk;
+    SummaryPart *parts;
+    float        max_mark, min_mark;            // totals, for pass two
+    int         *max_students, *min_students;   // chunk c writes from c*chunk
+} SummaryJob;
+
+// Pass one: sum, highest and lowest mark of a chunk
+void summary_stats_task(void *arg, int c) {
+    SummaryJob *job = arg;
+    SummaryPart *sp = &job->parts[c];
+    int lo = c * job->chunk;
+    int hi = lo + job->chunk < t_tab->count ? lo + job->chunk : t_tab->count;
+    sp->sum = 0;
+    sp->max_mark = sp->min_mark = row_key(lo)->mark;
+    for (int i = lo; i < hi; i++) {
+        float mark = row_key(i)->mark;
+        sp->sum += mark;
+        if (mark > sp->max_mark) sp->max_mark = mark;
+        if (mark < sp->min_mark) sp->min_mark = mark;
+    }
+}
+
+// Pass two: a chunk's students with the overall highest or lowest mark
+void summary_ties_task(void *arg, int c) {
+    SummaryJob *job = arg;
+    SummaryPart *sp = &job->parts[c];
+    int lo = c * job->chunk;
+    int hi = lo + job->chunk < t_tab->count ? lo + job->chunk : t_tab->count;
+    sp->max_count = sp->min_count = 0;
+    if (sp->max_mark != job->max_mark && sp->min_mark != job->min_mark) return;
+    for (int i = lo; i < hi; i++) {
+        float mark = row_key(i)->mark;
+        if (mark == job->max_mark) job->max_students[lo + sp->max_count++] = i;
+        if (mark == job->min_mark) job->min_students[lo + sp->min_count++] = i;
+    }
+}
+
+// SHOW SUMMARY over the whole table on the thread pool: each chunk is
+// reduced on its own, then the partial results are combined in chunk
+// order, so the tie lists come out in table order as with one thread.
+// Returns 0 if out of memory.
+int summary_reduce(float *average, float *max_mark, float *min_mark,
+                     int *max_students, int *max_count,
+                     int *min_students, int *min_count) {
+    int n = t_tab->count;
+    SummaryJob job;
+    job.chunk = par_chunk(n);
+    int nchunks = (n + job.chunk - 1) / job.chunk;
+    job.parts = malloc((size_t)nchunks * sizeof(SummaryPart));
+    if (!job.parts) return 0;
+    job.max_students = max_students;
+    job.min_students = min_students;
+
+    int parallel = n >= PAR_MIN_ROWS;
+    par_run(nchunks, summary_stats_task, &job, parallel);
+    double sum = 0;
+    job.max_mark = job.parts[0].max_mark;
+    job.min_mark = job.parts[0].min_mark;
+    for (int c = 0; c < nchunks; c++) {
+        sum += job.parts[c].sum;
+        if (job.parts[c].max_mark > job.max_mark) job.max_mark = job.parts[c].max_mark;
+        if (job.parts[c].min_mark < job.min_mark) job.min_mark = job.parts[c].min_mark;
+    }
+    par_run(nchunks, summary_ties_task, &job, parallel);
+
+    // Close the gaps between the chunks' slices of the tie lists
+    *max_count = *min_count = 0;
+    for (int c = 0; c < nchunks; c++) {
+        int lo = c * job.chunk;
+        memmove(max_students + *max_count, max_students + lo, (size_t)job.parts[c].max_count * sizeof(int));
+        memmove(min_students + *min_count, min_students + lo, (size_t)job.parts[c].min_count * sizeof(int));
+        *max_count += job.parts[c].max_count;
+        *min_count += job.parts[c].min_count;
+    }
+    *max_mark = job.max_mark;
+    *min_mark = job.min_mark;
+    *average = (float)(sum / n);
+    free(job.parts);
+    return 1;
+}
+
+// SHOW SUMMARY: display basic statistics about the marks
+void cmd_show_summary(void) {
+    if (t_tab->count == 0) {
+        cms_printf("CMS: No records loaded.\n");
+        return;
+    }
+
+    int count = t_tab->count;
+
+    int idx_max = 0;   // index of the highest mark
+    int idx_min = 0;   // index of the lowest mark
+    float max_mark = row_key(0)->mark;
+    float min_mark = row_key(0)->mark;
+
+    // Arrays to store students with the same highest or lowest mark
+    int max_students[MAX_STUDENTS];
+    int min_students[MAX_STUDENTS];
+    int max_count = 0, min_count = 0;
+    float average;
+
+    // Several intakes: combine their stats; otherwise reduce the rows
+    PartDir *d = part_dir();
+    if (d && d->nparts > 1)
+        average = summary_from_parts(d, &max_mark, &min_mark, max_students, &max_count,
+                                     min_students, &min_count);
+    else if (!summary_reduce(&average, &max_mark, &min_mark, max_students, &max_count,
+                             min_students, &min_count)) {
+        cms_printf("CMS: Out of memory.\n");
+        return;
+    }
+
+    // Display the highest and lowest marks along with student names
+    cms_printf("CMS SUMMARY\n");
+    cms_printf("-----------\n");
+    cms_printf("Total number of students : %d\n", count);
+    cms_printf("Average mark             : %.2f\n", average);
+    cms_printf("Highest mark             : %.1f\n", max_mark);
+    cms_printf("Lowest mark              : %.1f\n", min_mark);
+
+    // Show highest mark details
+    cms_printf("Student(s) with highest mark:\n");
+    for (int i = 0; i < max_count; i++) {
+        int idx = max_students[i];
+        cms_printf("  ID: %d, Name: %s, Mark: %.1f\n", row_at(idx)->id, row_at(idx)->name, row_at(idx)->mark);
+    }
+    
+    // Show lowest mark details
+    cms_printf("\nStudent(s) with lowest mark:\n");
+    for (int i = 0; i < min_count; i++) {
+        int idx = min_students[i];
+        cms_printf("  ID: %d, Name: %s, Mark: %.1f\n", row_at(idx)->id, row_at(idx)->name, row_at(idx)->mark);
+    }
+
+    // Per-intake breakdown (first two digits of the ID)
+    if (d) {
+        cms_printf("\nBy intake (ID prefix):\n");
+        for (int p = 0; p < d->nparts; p++) {
+            const Partition *pt = &d->parts[p];
+            cms_printf("  %02d: %d student(s), average %.2f, highest %.1f, lowest %.1f\n",
+                       pt->key, pt->count, pt->sum / pt->count, pt->max_mark, pt->min_mark);
+        }
+    }
+}
+
+
+/* ---------- PRINT DECLARATION ---------- */
+// Print contents of declaration.txt (e.g. academic honesty / group info)
+void print_declaration(void){
+    FILE *fp=fopen("declaration.txt","r");
+    if(!fp){
+        cms_printf("Error: declaration.txt not found.\n\n");
+        return;
+    }
+    char line[256];
+    while(fgets(line,sizeof(line),fp))
+        cms_printf("%s",line);
+    fclose(fp);
+    cms_printf("\n");
+}
+
+/* ---------- SNAPSHOT / RELEASE ---------- */
+// SNAPSHOT: keep reading the current table version across commands, so a
+// multi-command report stays consistent while others edit the table
+void cmd_snapshot(void) {
+    if (t_snapshot) {
+        cms_printf("CMS: Snapshot (version %lu) already held. Type RELEASE first.\n",
+                   t_snapshot->number);
+        return;
+    }
+    atomic_fetch_add(&t_tab->pins, 1);   // t_tab is pinned by this command
+    t_snapshot = t_tab;
+    cms_printf("CMS: Snapshot taken (version %lu, %d records).\n", t_tab->number, t_tab->count);
+    cms_printf("Reads use this snapshot until RELEASE; your own edits show after RELEASE.\n");
+}
+
+// RELEASE: go back to reading the latest version
+void cmd_release(void) {
+    if (!t_snapshot) {
+        cms_printf("CMS: No snapshot held.\n");
+        return;
+    }
+    TableVersion *latest = atomic_load(&g_table.current);
+    cms_printf("CMS: Snapshot (version %lu) released. Latest is version %lu.\n",
+               t_snapshot->number, latest->number);
+    atomic_fetch_sub(&t_snapshot->pins, 1);
+    t_snapshot = NULL;
+}
+
+/* ---------- ARCHIVE (out-of-core B+tree) ---------- */
+// The archive is a second, on-disk table for rosters too big to hold in
+// memory (e.g. every historical intake). It is a B+tree keyed on student
+// ID in 4 KB pages, read through a buffer pool with CLOCK replacement
+// (SET POOL <pages>), so a command only touches the pages on its path
+// and memory use stays bounded whatever the file size. Leaves are
+// chained in ID order so SHOW ALL streams them. Deletes do not merge
+// pages: an emptied leaf stays in the chain and is reused by inserts.
+#define BT_PAGE_SIZE  4096
+#define BT_MAGIC      "CMSBTRE1"
+#define BT_LEAF       1
+#define BT_INNER      2
+#define BT_LEAF_MAX   ((BT_PAGE_SIZE - 16) / (int)sizeof(Student))   // rows per leaf
+#define BT_INNER_MAX  ((BT_PAGE_SIZE - 20) / 8)                      // keys per inner page
+#define POOL_DEFAULT  64    // buffer pool frames (256 KB)
+#define POOL_MIN      8     // enough for the deepest insert path
+
+typedef struct {
+    int type;      // BT_LEAF / BT_INNER
+    int nkeys;     // rows in a leaf, keys in an inner page
+    int next;      // next leaf in ID order (0 = last)
+    int pad;
+} BtHeader;
+
+typedef struct {
+    BtHeader h;
+    Student  rows[BT_LEAF_MAX];                 // sorted by ID
+} BtLeaf;
+
+typedef struct {
+    BtHeader h;
+    int      keys[BT_INNER_MAX];                // keys[i] = first ID under child[i+1]
+    int      child[BT_INNER_MAX + 1];
+} BtInner;
+
+// Page 0 of the file
+typedef struct {
+    char magic[8];         // BT_MAGIC
+    int  student_size;     // sizeof(Student), guards against layout changes
+    int  root;             // root page (0 = empty tree)
+    int  npages;           // pages in the file, including this one
+    int  nrows;
+    int  height;
+} BtMeta;
+
+_Static_assert(sizeof(BtLeaf) <= BT_PAGE_SIZE, "leaf must fit in a page");
+_Static_assert(sizeof(BtInner) <= BT_PAGE_SIZE, "inner page must fit in a page");
+
+// One buffer pool frame
+typedef struct {
+    int            page;    // page held (-1 = empty)
+    int            pins;    // users of the frame right now
+    int            ref;     // CLOCK reference bit
+    int            dirty;   // must be written back before reuse
+    unsigned char *data;    // BT_PAGE_SIZE bytes
+} PoolFrame;
+
+typedef struct {
+    pthread_mutex_t lock;           // one archive command at a time
+    FILE           *fp;             // NULL = no archive open
+    char            filename[260];
+    BtMeta          meta;
+    PoolFrame      *frames;
+    int             nframes;
+    int             pool_size;      // frames to use (SET POOL)
+    int             hand;           // CLOCK hand
+    long long       hits, misses, reads, writes;
+} Archive;
+
+Archive g_archive = { .lock = PTHREAD_MUTEX_INITIALIZER, .pool_size = POOL_DEFAULT };
+
+#define LEAF(f)  ((BtLeaf *)g_archive.frames[f].data)
+#define INNER(f) ((BtInner *)g_archive.frames[f].data)
+
+// Read or write one page of the archive file
+int bt_io(int page, unsigned char *buf, int write) {
+    long long off = (long long)page * BT_PAGE_SIZE;
+#ifdef _WIN32
+    if (_fseeki64(g_archive.fp, off, SEEK_SET) != 0) return 0;
+#else
+    if (fseeko(g_archive.fp, (off_t)off, SEEK_SET) != 0) return 0;
+#endif
+    if (write) {
+        g_archive.writes++;
+        return fwrite(buf, BT_PAGE_SIZE, 1, g_archive.fp) == 1;
+    }
+    g_archive.reads++;
+    return fread(buf, BT_PAGE_SIZE, 1, g_archive.fp) == 1;
+}
+
+// Pin a page in the pool, reading it in if needed. Returns its frame, or
+// -1 on an I/O error or when every frame is pinned.
+int pool_pin(int page) {
+    for (int f = 0; f < g_archive.nframes; f++) {
+        if (g_archive.frames[f].page == page) {
+            g_archive.frames[f].pins++;
+            g_archive.frames[f].ref = 1;
+            g_archive.hits++;
+            return f;
+        }
+    }
+    g_archive.misses++;
+
+    // CLOCK: skip pinned frames, give referenced ones a second chance
+    for (int sweep = 0; sweep < 2 * g_archive.nframes; sweep++) {
+        int f = g_archive.hand;
+        PoolFrame *fr = &g_archive.frames[f];
+        g_archive.hand = (g_archive.hand + 1) % g_archive.nframes;
+        if (fr->pins) continue;
+        if (fr->ref) {
+            fr->ref = 0;
+            continue;
+        }
+        if (fr->dirty && !bt_io(fr->page, fr->data, 1)) return -1;
+        fr->dirty = 0;
+        fr->page = -1;
+        if (page < g_archive.meta.npages) {
+            if (!bt_io(page, fr->data, 0)) return -1;
+        } else {
+            memset(fr->data, 0, BT_PAGE_SIZE);   // new page past the end
+        }
+        fr->page = page;
+        fr->pins = 1;
+        fr->ref = 1;
+        return f;
+    }
+    return -1;
+}
 
-        while (1) {
-            newID = prompt_student_id();  // validated student ID format
+// Release a pinned frame; 'dirty' if the page was changed
+void pool_unpin(int f, int dirty) {
+    g_archive.frames[f].pins--;
+    if (dirty) g_archive.frames[f].dirty = 1;
+}
 
-            // ensure this ID isn't used by other students
-            int exist = find_index_by_id(newID);
-            if (exist >= 0 && exist != idx) {
-                printf("Error: This ID already exists.\n");
-                continue;
-            }
-            break;
+// Allocate a new page at the end of the file, pinned and zeroed
+int pool_new(int type) {
+    int f = pool_pin(g_archive.meta.npages);
+    if (f < 0) return -1;
+    g_archive.meta.npages++;
+    g_archive.frames[f].dirty = 1;
+    ((BtHeader *)g_archive.frames[f].data)->type = type;
+    return f;
+}
+
+// Write every dirty page and the meta page, and sync the file
+int pool_flush(void) {
+    int ok = 1;
+    for (int f = 0; f < g_archive.nframes; f++) {
+        PoolFrame *fr = &g_archive.frames[f];
+        if (fr->dirty) {
+            if (bt_io(fr->page, fr->data, 1)) fr->dirty = 0;
+            else ok = 0;
         }
+    }
+    unsigned char page[BT_PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+    memcpy(page, &g_archive.meta, sizeof(g_archive.meta));
+    if (!bt_io(0, page, 1)) ok = 0;
+    if (!sync_file(g_archive.fp)) ok = 0;
+    return ok;
+}
 
-        if (newID != updated.id) {
-            updated.id = newID;
-            changed = 1;
-        } else {
-            printf("No change detected for ID.\n");
+// (Re)allocate the pool with g_archive.pool_size empty frames
+int pool_alloc(void) {
+    for (int f = 0; f < g_archive.nframes; f++) free(g_archive.frames[f].data);
+    free(g_archive.frames);
+    g_archive.nframes = 0;
+    g_archive.hand = 0;
+    g_archive.frames = calloc((size_t)g_archive.pool_size, sizeof(PoolFrame));
+    if (!g_archive.frames) return 0;
+    for (int f = 0; f < g_archive.pool_size; f++) {
+        g_archive.frames[f].page = -1;
+        g_archive.frames[f].data = malloc(BT_PAGE_SIZE);
+        if (!g_archive.frames[f].data) return 0;
+        g_archive.nframes++;
+    }
+    return 1;
+}
+
+// Child of an inner page to follow for 'id'
+int bt_child_slot(const BtInner *in, int id) {
+    int lo = 0, hi = in->h.nkeys;   // first key greater than id
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (id < in->keys[mid]) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// Position of 'id' in a leaf, or where it would be inserted
+int bt_leaf_slot(const BtLeaf *lf, int id, int *found) {
+    int lo = 0, hi = lf->h.nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (lf->rows[mid].id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    *found = lo < lf->h.nkeys && lf->rows[lo].id == id;
+    return lo;
+}
+
+// Pin the leaf that holds (or would hold) 'id'; -1 on error
+int bt_find_leaf(int id) {
+    int page = g_archive.meta.root;
+    while (1) {
+        int f = pool_pin(page);
+        if (f < 0 || LEAF(f)->h.type == BT_LEAF) return f;
+        int next = INNER(f)->child[bt_child_slot(INNER(f), id)];
+        pool_unpin(f, 0);
+        page = next;
+    }
+}
+
+// Look up one row: 1 found, 0 not found, -1 error
+int bt_get(int id, Student *out) {
+    if (!g_archive.meta.root) return 0;
+    int f = bt_find_leaf(id);
+    if (f < 0) return -1;
+    int found, i = bt_leaf_slot(LEAF(f), id, &found);
+    if (found) *out = LEAF(f)->rows[i];
+    pool_unpin(f, 0);
+    return found;
+}
+
+// Insert or replace a row under 'page'. If the page splits, the new
+// right sibling and its first key come back in *split_page / *split_key.
+// Returns 1 = inserted, 2 = replaced, -1 = error.
+int bt_insert_at(int page, const Student *s, int *split_page, int *split_key) {
+    *split_page = 0;
+    int f = pool_pin(page);
+    if (f < 0) return -1;
+
+    if (LEAF(f)->h.type == BT_LEAF) {
+        BtLeaf *lf = LEAF(f);
+        int found, i = bt_leaf_slot(lf, s->id, &found);
+        if (found) {
+            lf->rows[i] = *s;
+            pool_unpin(f, 1);
+            return 2;
         }
+        if (lf->h.nkeys < BT_LEAF_MAX) {
+            memmove(&lf->rows[i + 1], &lf->rows[i], (size_t)(lf->h.nkeys - i) * sizeof(Student));
+            lf->rows[i] = *s;
+            lf->h.nkeys++;
+            pool_unpin(f, 1);
+            return 1;
+        }
+        // Full: split in half, the new leaf takes the upper half
+        int nf = pool_new(BT_LEAF);
+        if (nf < 0) {
+            pool_unpin(f, 0);
+            return -1;
+        }
+        BtLeaf *rt = LEAF(nf);
+        Student tmp[BT_LEAF_MAX + 1];
+        memcpy(tmp, lf->rows, (size_t)i * sizeof(Student));
+        tmp[i] = *s;
+        memcpy(tmp + i + 1, lf->rows + i, (size_t)(BT_LEAF_MAX - i) * sizeof(Student));
+        int left = (BT_LEAF_MAX + 1) / 2;
+        memcpy(lf->rows, tmp, (size_t)left * sizeof(Student));
+        lf->h.nkeys = left;
+        memcpy(rt->rows, tmp + left, (size_t)(BT_LEAF_MAX + 1 - left) * sizeof(Student));
+        rt->h.nkeys = BT_LEAF_MAX + 1 - left;
+        rt->h.next = lf->h.next;
+        lf->h.next = g_archive.frames[nf].page;
+        *split_page = g_archive.frames[nf].page;
+        *split_key = rt->rows[0].id;
+        pool_unpin(nf, 1);
+        pool_unpin(f, 1);
+        return 1;
     }
 
-    /* ===========================
-       UPDATE NAME
-       =========================== */
-    if (prompt_yes_no("Do you want to update the Name?")) {
+    // Inner page: insert below, then take in the child's split if any
+    BtInner *in = INNER(f);
+    int slot = bt_child_slot(in, s->id);
+    int cp, ck;
+    int r = bt_insert_at(in->child[slot], s, &cp, &ck);
+    if (r < 0 || !cp) {
+        pool_unpin(f, 0);
+        return r;
+    }
+    if (in->h.nkeys < BT_INNER_MAX) {
+        memmove(&in->keys[slot + 1], &in->keys[slot], (size_t)(in->h.nkeys - slot) * sizeof(int));
+        memmove(&in->child[slot + 2], &in->child[slot + 1], (size_t)(in->h.nkeys - slot) * sizeof(int));
+        in->keys[slot] = ck;
+        in->child[slot + 1] = cp;
+        in->h.nkeys++;
+        pool_unpin(f, 1);
+        return r;
+    }
+    // Full: split around the middle key, which moves up
+    int nf = pool_new(BT_INNER);
+    if (nf < 0) {
+        pool_unpin(f, 0);
+        return -1;
+    }
+    BtInner *rt = INNER(nf);
+    int tk[BT_INNER_MAX + 1], tc[BT_INNER_MAX + 2];
+    memcpy(tk, in->keys, (size_t)slot * sizeof(int));
+    tk[slot] = ck;
+    memcpy(tk + slot + 1, in->keys + slot, (size_t)(BT_INNER_MAX - slot) * sizeof(int));
+    memcpy(tc, in->child, (size_t)(slot + 1) * sizeof(int));
+    tc[slot + 1] = cp;
+    memcpy(tc + slot + 2, in->child + slot + 1, (size_t)(BT_INNER_MAX - slot) * sizeof(int));
+    int mid = (BT_INNER_MAX + 1) / 2;
+    memcpy(in->keys, tk, (size_t)mid * sizeof(int));
+    memcpy(in->child, tc, (size_t)(mid + 1) * sizeof(int));
+    in->h.nkeys = mid;
+    memcpy(rt->keys, tk + mid + 1, (size_t)(BT_INNER_MAX - mid) * sizeof(int));
+    memcpy(rt->child, tc + mid + 1, (size_t)(BT_INNER_MAX - mid + 1) * sizeof(int));
+    rt->h.nkeys = BT_INNER_MAX - mid;
+    *split_page = g_archive.frames[nf].page;
+    *split_key = tk[mid];
+    pool_unpin(nf, 1);
+    pool_unpin(f, 1);
+    return r;
+}
 
-        char temp[NAME_MAX_LEN];
+// Insert or replace a row: 1 inserted, 2 replaced, -1 error
+int bt_put(const Student *s) {
+    if (!g_archive.meta.root) {
+        int f = pool_new(BT_LEAF);
+        if (f < 0) return -1;
+        g_archive.meta.root = g_archive.frames[f].page;
+        g_archive.meta.height = 1;
+        pool_unpin(f, 1);
+    }
+    int sp, sk;
+    int r = bt_insert_at(g_archive.meta.root, s, &sp, &sk);
+    if (r > 0 && sp) {
+        // The root split: grow the tree by one level
+        int f = pool_new(BT_INNER);
+        if (f < 0) return -1;
+        BtInner *in = INNER(f);
+        in->h.nkeys = 1;
+        in->keys[0] = sk;
+        in->child[0] = g_archive.meta.root;
+        in->child[1] = sp;
+        g_archive.meta.root = g_archive.frames[f].page;
+        g_archive.meta.height++;
+        pool_unpin(f, 1);
+    }
+    if (r == 1) g_archive.meta.nrows++;
+    return r;
+}
 
-        while (1) {
-            printf("Enter new Name (current: %s): ", updated.name);
-            if (!fgets(temp, sizeof(temp), stdin)) continue;
-            rstrip(temp);
-            trim(temp);
+// Remove a row: 1 removed, 0 not found, -1 error
+int bt_delete(int id) {
+    if (!g_archive.meta.root) return 0;
+    int f = bt_find_leaf(id);
+    if (f < 0) return -1;
+    BtLeaf *lf = LEAF(f);
+    int found, i = bt_leaf_slot(lf, id, &found);
+    if (found) {
+        memmove(&lf->rows[i], &lf->rows[i + 1], (size_t)(lf->h.nkeys - i - 1) * sizeof(Student));
+        lf->h.nkeys--;
+        g_archive.meta.nrows--;
+    }
+    pool_unpin(f, found);
+    return found;
+}
 
-            if (temp[0] == '\0') {
-                printf("Name cannot be empty.\n");
-                continue;
-            }
+// Print every row in ID order, one leaf at a time; -1 on error
+int bt_print_all(void) {
+    if (!g_archive.meta.root) return 0;
+    int f = bt_find_leaf(INT_MIN);   // leftmost leaf
+    while (f >= 0) {
+        for (int i = 0; i < LEAF(f)->h.nkeys; i++)
+            print_row(&LEAF(f)->rows[i]);
+        int next = LEAF(f)->h.next;
+        pool_unpin(f, 0);
+        if (!next) return 0;
+        f = pool_pin(next);
+    }
+    return -1;
+}
 
-            if (!is_alpha_space(temp)) {
-                printf("Error: Name must only contain letters and spaces.\n");
-                continue;
-            }
+// Open (or create) an archive file
+int archive_open(const char *filename) {
+    FILE *fp = fopen(filename, "r+b");
+    int created = 0;
+    if (!fp) {
+        fp = fopen(filename, "w+b");
+        created = 1;
+    }
+    if (!fp) return 0;
+    g_archive.fp = fp;
+
+    if (created) {
+        memset(&g_archive.meta, 0, sizeof(g_archive.meta));
+        memcpy(g_archive.meta.magic, BT_MAGIC, sizeof(g_archive.meta.magic));
+        g_archive.meta.student_size = (int)sizeof(Student);
+        g_archive.meta.npages = 1;
+    } else {
+        unsigned char page[BT_PAGE_SIZE];
+        if (!bt_io(0, page, 0)) goto bad;
+        memcpy(&g_archive.meta, page, sizeof(g_archive.meta));
+        if (memcmp(g_archive.meta.magic, BT_MAGIC, sizeof(g_archive.meta.magic)) != 0 ||
+            g_archive.meta.student_size != (int)sizeof(Student))
+            goto bad;
+    }
+    if (!pool_alloc()) goto bad;
+    snprintf(g_archive.filename, sizeof(g_archive.filename), "%s", filename);
+    g_archive.hits = g_archive.misses = g_archive.reads = g_archive.writes = 0;
+    return 1;
+bad:
+    fclose(fp);
+    g_archive.fp = NULL;
+    return 0;
+}
+
+// Write back and close the open archive
+int archive_close(void) {
+    int ok = pool_flush();
+    if (fclose(g_archive.fp) != 0) ok = 0;
+    g_archive.fp = NULL;
+    for (int f = 0; f < g_archive.nframes; f++) free(g_archive.frames[f].data);
+    free(g_archive.frames);
+    g_archive.frames = NULL;
+    g_archive.nframes = 0;
+    return ok;
+}
+
+// ARCHIVE LOAD <file>: stream a text database into the archive. Rows are
+// parsed and inserted one at a time, so the file can be any size.
+void archive_load(const char *filename) {
+    FileReader r;
+    if (!reader_open(&r, filename)) {
+        cms_printf("CMS: Cannot open \"%s\".\n", filename);
+        return;
+    }
+    char line[LINE_MAX_LEN];
+    Student s;
+    int table_started = 0, added = 0, replaced = 0, res = 1;
+    while (res > 0 && reader_gets(&r, line, sizeof(line))) {
+        if (!parse_record_line(line, &s, &table_started)) continue;
+        res = bt_put(&s);
+        if (res == 1) added++;
+        if (res == 2) replaced++;
+    }
+    reader_close(&r);
+    if (res < 0 || !pool_flush()) {
+        cms_printf("CMS: Archive I/O error.\n");
+        return;
+    }
+    cms_printf("CMS: %d record(s) added to the archive, %d replaced (%d in total).\n",
+               added, replaced, g_archive.meta.nrows);
+}
+
+// ARCHIVE INSERT: prompt for a new record like INSERT
+void archive_insert(void) {
+    Student s, old;
+    memset(&s, 0, sizeof(s));
+    while (1) {
+        s.id = prompt_student_id();
+        if (s.id < 0) {
+            cms_printf("Exiting insert operation.\n");
+            return;
+        }
+        int r = bt_get(s.id, &old);
+        if (r < 0) {
+            cms_printf("CMS: Archive I/O error.\n");
+            return;
+        }
+        if (!r) break;
+        cms_printf("Error: This ID exists.\n");
+    }
+    if (!prompt_alpha("Enter Name: ", "Name", s.name, sizeof(s.name)) ||
+        !prompt_alpha("Enter Programme: ", "Programme", s.programme, sizeof(s.programme)) ||
+        (s.mark = prompt_mark("Enter Mark: ")) < 0) {
+        cms_printf("Exiting insert operation.\n");
+        return;
+    }
+    if (bt_put(&s) < 0 || !pool_flush()) {
+        cms_printf("CMS: Archive I/O error.\n");
+        return;
+    }
+    cms_printf("CMS: Record inserted into the archive.\n");
+}
 
+// ARCHIVE UPDATE ID=<n>: prompt for each column (Enter keeps it)
+void archive_update(int id) {
+    Student s;
+    int r = bt_get(id, &s);
+    if (r <= 0) {
+        cms_printf(r < 0 ? "CMS: Archive I/O error.\n" : "CMS: No record found.\n");
+        return;
+    }
+    char buf[LINE_MAX_LEN];
+    const char *labels[3] = { "Name", "Programme", "Mark" };
+    for (int k = 0; k < 3; k++) {
+        while (1) {
+            if (k < 2) cms_printf("Enter %s [%s]: ", labels[k], k ? s.programme : s.name);
+            else cms_printf("Enter Mark [%.1f]: ", s.mark);
+            if (!cms_fgets(buf, sizeof(buf)) || check_exit(buf)) {
+                cms_printf("Exiting update operation.\n");
+                return;
+            }
+            rstrip(buf);
+            trim(buf);
+            if (buf[0] == '\0') break;   // keep the current value
+            if (k < 2) {
+                if (!is_alpha_space(buf)) {
+                    cms_printf("Error: %s must only contain letters and spaces.\n", labels[k]);
+                    continue;
+                }
+                char *field = k ? s.programme : s.name;
+                size_t cap = k ? sizeof(s.programme) : sizeof(s.name), len = strlen(buf);
+                if (len >= cap) {
+                    cms_printf("Error: %s must be at most %d characters.\n", labels[k], (int)cap - 1);
+                    continue;
+                }
+                memcpy(field, buf, len + 1);
+            } else {
+                char *end;
+                float v = strtof(buf, &end);
+                if (*end != '\0' || v < 0 || v > 100) {
+                    cms_printf("Mark must be a number between 0 and 100.\n");
+                    continue;
+                }
+                s.mark = roundf(v * 10.0f) / 10.0f;
+            }
             break;
         }
+    }
+    if (bt_put(&s) < 0 || !pool_flush()) {
+        cms_printf("CMS: Archive I/O error.\n");
+        return;
+    }
+    cms_printf("CMS: Archive record updated.\n");
+}
 
-        if (strcmp(temp, updated.name) != 0) {
-            strncpy(updated.name, temp, NAME_MAX_LEN - 1);
-            updated.name[NAME_MAX_LEN - 1] = '\0';
-            changed = 1;
+// ARCHIVE STATS: size of the tree and how the buffer pool is doing
+void archive_stats(void) {
+    long long lookups = g_archive.hits + g_archive.misses;
+    int used = 0;
+    for (int f = 0; f < g_archive.nframes; f++) used += g_archive.frames[f].page >= 0;
+    cms_printf("CMS ARCHIVE \"%s\"\n", g_archive.filename);
+    cms_printf("-----------\n");
+    cms_printf("Records                  : %d\n", g_archive.meta.nrows);
+    cms_printf("Pages (4 KB)             : %d (%d rows per leaf)\n", g_archive.meta.npages, BT_LEAF_MAX);
+    cms_printf("Tree height              : %d\n", g_archive.meta.height);
+    cms_printf("Buffer pool              : %d of %d frames in use (%d KB)\n",
+               used, g_archive.nframes, g_archive.nframes * BT_PAGE_SIZE / 1024);
+    cms_printf("Pool hit rate            : %.1f%% (%lld hits, %lld misses)\n",
+               lookups ? 100.0 * (double)g_archive.hits / (double)lookups : 0.0,
+               g_archive.hits, g_archive.misses);
+    cms_printf("Page reads / writes      : %lld / %lld\n", g_archive.reads, g_archive.writes);
+}
+
+// ARCHIVE <subcommand>: work with the on-disk archive
+void cmd_archive(const char *args) {
+    char sub[16] = "";
+    int n = 0;
+    sscanf(args, "%15s%n", sub, &n);
+    const char *rest = args + n;
+    while (*rest && isspace((unsigned char)*rest)) rest++;
+
+    int admin_only = equals_ic(sub, "OPEN") || equals_ic(sub, "CLOSE") || equals_ic(sub, "LOAD") ||
+                     equals_ic(sub, "INSERT") || equals_ic(sub, "UPDATE") || equals_ic(sub, "DELETE");
+    if (admin_only && !g_is_admin) {
+        cms_printf("You do not have permission to change the archive.\n");
+        return;
+    }
+
+    pthread_mutex_lock(&g_archive.lock);
+    if (equals_ic(sub, "OPEN")) {
+        if (rest[0] == '\0') {
+            cms_printf("CMS: Please provide a filename.\n");
+        } else {
+            if (g_archive.fp) archive_close();
+            if (archive_open(rest))
+                cms_printf("CMS: Archive \"%s\" opened (%d records).\n", rest, g_archive.meta.nrows);
+            else
+                cms_printf("CMS: Cannot open \"%s\" as an archive.\n", rest);
+        }
+    } else if (!equals_ic(sub, "QUERY") && !equals_ic(sub, "SHOW") && !equals_ic(sub, "STATS") &&
+               !equals_ic(sub, "CLOSE") && !admin_only) {
+        cms_printf("CMS: Use ARCHIVE OPEN|CLOSE|LOAD|QUERY|SHOW ALL|INSERT|UPDATE|DELETE|STATS.\n");
+    } else if (!g_archive.fp) {
+        cms_printf("CMS: No archive opened. Use ARCHIVE OPEN <file>.\n");
+    } else if (equals_ic(sub, "CLOSE")) {
+        cms_printf(archive_close() ? "CMS: Archive closed.\n" : "CMS: Archive I/O error.\n");
+    } else if (equals_ic(sub, "LOAD")) {
+        archive_load(rest);
+    } else if (equals_ic(sub, "SHOW")) {
+        cms_printf("CMS: Here are all the archived records.\n");
+        print_header();
+        if (bt_print_all() < 0) cms_printf("CMS: Archive I/O error.\n");
+    } else if (equals_ic(sub, "STATS")) {
+        archive_stats();
+    } else if (equals_ic(sub, "INSERT")) {
+        archive_insert();
+    } else {
+        // QUERY / UPDATE / DELETE take ID=<n> (or prompt for it)
+        int id = starts_with_ic(rest, "ID=") ? atoi(rest + 3) : prompt_student_id();
+        Student s;
+        if (id < 0) {
+            cms_printf("Exiting operation.\n");
+        } else if (equals_ic(sub, "UPDATE")) {
+            archive_update(id);
+        } else if (equals_ic(sub, "DELETE")) {
+            if (prompt_yes_no("Delete this archived record?")) {
+                int r = bt_delete(id);
+                if (r > 0 && !pool_flush()) r = -1;
+                cms_printf(r < 0 ? "CMS: Archive I/O error.\n" :
+                           r ? "CMS: Archive record deleted.\n" : "CMS: No record found.\n");
+            }
         } else {
-            printf("No change detected for Name.\n");
+            int r = bt_get(id, &s);
+            if (r < 0) {
+                cms_printf("CMS: Archive I/O error.\n");
+            } else if (!r) {
+                cms_printf("CMS: No record found.\n");
+            } else {
+                cms_printf("Record found:\n");
+                print_record(&s);
+            }
         }
     }
+    pthread_mutex_unlock(&g_archive.lock);
+}
 
-    /* ===========================
-       UPDATE PROGRAMME
-       =========================== */
-    if (prompt_yes_no("Do you want to update the Programme?")) {
+/* ---------- SET (runtime settings) ---------- */
+// SET IO URING | STDIO: how database files are read and written
+// SET POOL <pages>: size of the archive's buffer pool
+// SET THREADS n | AUTO: threads for parallel sorts, scans and SHOW SUMMARY
+// SET CACHE <KB>: memory for tables parked in the catalog
+void cmd_set(const char *args) {
+    char name[16] = "", value[16] = "";
+    sscanf(args, "%15s %15s", name, value);
+
+    if (equals_ic(name, "IO")) {
+        if (equals_ic(value, "URING")) {
+#ifdef __linux__
+            g_io_uring = 1;
+            cms_printf("CMS: Database files use io_uring (stdio if the kernel refuses it).\n");
+#else
+            cms_printf("CMS: io_uring is only available on Linux.\n");
+#endif
+        } else if (equals_ic(value, "STDIO")) {
+            g_io_uring = 0;
+            cms_printf("CMS: Database files use stdio.\n");
+        } else {
+            cms_printf("CMS: Use SET IO URING or SET IO STDIO (now %s).\n",
+                       g_io_uring ? "URING" : "STDIO");
+        }
+        return;
+    }
+    if (equals_ic(name, "POOL")) {
+        int frames = atoi(value);
+        if (frames < POOL_MIN) {
+            cms_printf("CMS: Use SET POOL <pages> (at least %d; now %d).\n", POOL_MIN, g_archive.pool_size);
+            return;
+        }
+        pthread_mutex_lock(&g_archive.lock);
+        g_archive.pool_size = frames;
+        int ok = 1;
+        if (g_archive.fp) ok = pool_flush() && pool_alloc();   // resize now
+        pthread_mutex_unlock(&g_archive.lock);
+        if (ok) cms_printf("CMS: Archive buffer pool is %d pages (%d KB).\n", frames, frames * BT_PAGE_SIZE / 1024);
+        else cms_printf("CMS: Could not resize the buffer pool.\n");
+        return;
+    }
+    if (equals_ic(name, "THREADS")) {
+        int n = atoi(value);
+        if (equals_ic(value, "AUTO")) {
+            atomic_store(&g_par_threads, 0);
+        } else if (n >= 1 && n <= PAR_MAX_THREADS) {
+            atomic_store(&g_par_threads, n);
+        } else {
+            cms_printf("CMS: Use SET THREADS <1-%d> or SET THREADS AUTO (now %d).\n",
+                       PAR_MAX_THREADS, par_width());
+            return;
+        }
+        cms_printf("CMS: Parallel work uses %d thread(s)%s.\n", par_width(),
+                   atomic_load(&g_par_threads) ? "" : " (one per CPU)");
+        return;
+    }
+    if (equals_ic(name, "CACHE")) {
+        int kb = atoi(value);
+        if (kb < 0 || !isdigit((unsigned char)value[0])) {
+            cms_printf("CMS: Use SET CACHE <KB> (now %d).\n", g_catalog.budget_kb);
+            return;
+        }
+        pthread_mutex_lock(&g_catalog.lock);
+        g_catalog.budget_kb = kb;
+        catalog_evict();
+        pthread_mutex_unlock(&g_catalog.lock);
+        cms_printf("CMS: Parked tables may use %d KB.\n", kb);
+        return;
+    }
+    cms_printf("CMS: Use SET IO URING | STDIO, SET POOL <pages>, SET THREADS <n> | AUTO or SET CACHE <KB>.\n");
+}
 
-        char temp[PROG_MAX_LEN];
+/* ---------- WATCH (hot reload of externally changed files) ---------- */
+// WATCH ON follows the open file with inotify. When another program
+// rewrites it, the file is parsed and three-way merged by ID against the
+// base (the rows as last read from or written to disk) and the table:
+// rows that only changed on disk are applied, rows that also have
+// unsaved local edits are kept as they are and reported as conflicts.
+#ifdef __linux__
 
-        while (1) {
-            printf("Enter new Programme (current: %s): ", updated.programme);
-            if (!fgets(temp, sizeof(temp), stdin)) continue;
-            rstrip(temp);
-            trim(temp);
+typedef struct {
+    pthread_mutex_t control;        // held by WATCH ON/OFF for the whole switch
+    pthread_mutex_t lock;           // guards everything below
+    int             on;
+    pthread_t       thread;
+    int             ifd;            // inotify descriptor
+    int             wake;           // eventfd: file switched or WATCH OFF
+    char            filename[260];  // file being followed
+    Student        *base;           // rows as last seen on disk, sorted by ID
+    int             nbase;
+} Watch;
+
+Watch g_watch = { .control = PTHREAD_MUTEX_INITIALIZER, .lock = PTHREAD_MUTEX_INITIALIZER,
+                  .ifd = -1, .wake = -1 };
+
+// Parse every record of a file into 'rows' (at most MAX_STUDENTS).
+// Returns the number of rows, or -1 if the file cannot be read.
+int read_file_rows(const char *filename, Student *rows) {
+    if (col_detect(filename)) {
+        int n;
+        Student *all = col_read_file(filename, &n);
+        if (!all) return -1;
+        if (n > MAX_STUDENTS) n = MAX_STUDENTS;
+        memcpy(rows, all, (size_t)n * sizeof(Student));
+        free(all);
+        return n;
+    }
+    FileReader r;
+    if (!reader_open(&r, filename)) return -1;
+    char line[LINE_MAX_LEN];
+    Student s;
+    int n = 0, table_started = 0;
+    while (reader_gets(&r, line, sizeof(line)))
+        if (parse_record_line(line, &s, &table_started) && n < MAX_STUDENTS) rows[n++] = s;
+    reader_close(&r);
+    return n;
+}
 
-            if (temp[0] == '\0') {
-                printf("Programme cannot be empty.\n");
-                continue;
-            }
+// The table now matches the file on disk: make it the new base and
+// follow t_tab's file. Called by OPEN and SAVE.
+void watch_rebase(void) {
+    pthread_mutex_lock(&g_watch.lock);
+    if (g_watch.on) {
+        for (int i = 0; i < t_tab->count; i++) g_watch.base[i] = *row_at(i);
+        g_watch.nbase = t_tab->count;
+        qsort(g_watch.base, (size_t)g_watch.nbase, sizeof(Student), cmp_student_id);
+        if (strcmp(g_watch.filename, t_tab->filename) != 0) {
+            memcpy(g_watch.filename, t_tab->filename, sizeof(g_watch.filename));
+            uint64_t one = 1;
+            if (write(g_watch.wake, &one, sizeof(one)) < 0) { /* already signalled */ }
+        }
+    }
+    pthread_mutex_unlock(&g_watch.lock);
+}
 
-            if (!is_alpha_space(temp)) {
-                printf("Error: Programme must only contain letters and spaces.\n");
+// USE switched tables: follow t_tab's file with the file's rows as the
+// base, since the table may have unsaved edits of its own
+void watch_switch(void) {
+    pthread_mutex_lock(&g_watch.lock);
+    if (g_watch.on) {
+        int n = read_file_rows(t_tab->filename, g_watch.base);
+        g_watch.nbase = n < 0 ? 0 : n;
+        qsort(g_watch.base, (size_t)g_watch.nbase, sizeof(Student), cmp_student_id);
+        if (strcmp(g_watch.filename, t_tab->filename) != 0) {
+            memcpy(g_watch.filename, t_tab->filename, sizeof(g_watch.filename));
+            uint64_t one = 1;
+            if (write(g_watch.wake, &one, sizeof(one)) < 0) { /* already signalled */ }
+        }
+    }
+    pthread_mutex_unlock(&g_watch.lock);
+}
+
+// Apply what changed in 'filename' since the base. Runs as a writer.
+void watch_reload(const char *filename) {
+    Student *disk = malloc(MAX_STUDENTS * sizeof(Student));
+    int *sel = malloc(MAX_STUDENTS * sizeof(int));
+    int *add = malloc(MAX_STUDENTS * sizeof(int));   // disk rows to insert
+    unsigned char *drop = calloc(MAX_STUDENTS, 1);   // table rows to delete
+    int nd = disk ? read_file_rows(filename, disk) : -1;
+    if (nd < 0 || !sel || !add || !drop) goto out;    // e.g. mid-rename
+    qsort(disk, (size_t)nd, sizeof(Student), cmp_student_id);
+
+    if (!table_write_begin()) goto out;
+    if (strcmp(t_tab->filename, filename) != 0) {   // OPEN switched files meanwhile
+        table_write_abort();
+        goto out;
+    }
+    int nl = t_tab->count;
+    for (int i = 0; i < nl; i++) sel[i] = i;
+    sort_selection(sel, nl, COL_ID, 1);
+
+    // Merge base, disk and table in ID order
+    int updated = 0, added = 0, removed = 0, conflicts = 0, nadd = 0;
+    int conflict_ids[5];
+    pthread_mutex_lock(&g_watch.lock);
+    int b = 0, d = 0, l = 0;
+    while (b < g_watch.nbase || d < nd || l < nl) {
+        int id = INT_MAX;
+        if (b < g_watch.nbase && g_watch.base[b].id < id) id = g_watch.base[b].id;
+        if (d < nd && disk[d].id < id) id = disk[d].id;
+        if (l < nl && row_key(sel[l])->id < id) id = row_key(sel[l])->id;
+        const Student *B = b < g_watch.nbase && g_watch.base[b].id == id ? &g_watch.base[b++] : NULL;
+        const Student *D = d < nd && disk[d].id == id ? &disk[d++] : NULL;
+        int li = l < nl && row_key(sel[l])->id == id ? sel[l++] : -1;
+        const Student *L = li >= 0 ? row_at(li) : NULL;
+
+        if (same_row(D, B) || same_row(L, D)) continue;   // nothing to bring in
+        if (!same_row(L, B)) {                            // edited on both sides
+            if (conflicts < 5) conflict_ids[conflicts] = id;
+            conflicts++;
+        } else if (D && L) {
+            cdc_record('U', L, D, 0);
+            *row_mut(li) = *D;
+            updated++;
+        } else if (D) {
+            add[nadd++] = (int)(D - disk);
+        } else {
+            drop[li] = 1;
+            removed++;
+        }
+    }
+    memcpy(g_watch.base, disk, (size_t)nd * sizeof(Student));
+    g_watch.nbase = nd;
+    pthread_mutex_unlock(&g_watch.lock);
+
+    if (removed) {
+        int w = 0;
+        for (int i = 0; i < nl; i++) {
+            if (drop[i]) {
+                cdc_record('D', row_at(i), NULL, 0);
                 continue;
             }
+            if (w != i) *row_mut(w) = *row_at(i);
+            w++;
+        }
+        t_tab->count = w;
+    }
+    for (int k = 0; k < nadd && t_tab->count < MAX_STUDENTS; k++) {
+        *row_mut(t_tab->count++) = disk[add[k]];
+        cdc_record('I', NULL, &disk[add[k]], 0);
+        added++;
+    }
 
-            break;
+    if (updated || added || removed) table_write_end();
+    else table_write_abort();
+
+    if (updated || added || removed || conflicts) {
+        printf("\nCMS: \"%s\" changed on disk: %d updated, %d added, %d removed.\n",
+               filename, updated, added, removed);
+        if (conflicts) {
+            printf("CMS: %d record(s) also have unsaved edits here and were kept (ID", conflicts);
+            for (int k = 0; k < conflicts && k < 5; k++) printf(" %d", conflict_ids[k]);
+            printf("%s). SAVE overwrites the file with them.\n", conflicts > 5 ? " ..." : "");
         }
+        fflush(stdout);
+    }
+out:
+    free(disk);
+    free(sel);
+    free(add);
+    free(drop);
+}
 
-        if (strcmp(temp, updated.programme) != 0) {
-            strncpy(updated.programme, temp, PROG_MAX_LEN - 1);
-            updated.programme[PROG_MAX_LEN - 1] = '\0';
-            changed = 1;
+// Watcher thread: wait for the followed file to be rewritten
+void *watch_main(void *arg) {
+    (void)arg;
+    char path[260] = "", name[260] = "";
+    int wd = -1;
+    while (1) {
+        pthread_mutex_lock(&g_watch.lock);
+        int on = g_watch.on;
+        if (on && strcmp(path, g_watch.filename) != 0) {
+            // Follow the new file: watch its directory, since tools often
+            // replace the file by renaming a new one over it
+            memcpy(path, g_watch.filename, sizeof(path));
+            char dir[260];
+            const char *slash = strrchr(path, '/');
+            if (slash) {
+                snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+                if (dir[0] == '\0') strcpy(dir, "/");
+            } else {
+                strcpy(dir, ".");
+            }
+            snprintf(name, sizeof(name), "%s", slash ? slash + 1 : path);
+            if (wd >= 0) inotify_rm_watch(g_watch.ifd, wd);
+            wd = path[0] ? inotify_add_watch(g_watch.ifd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) : -1;
+        }
+        pthread_mutex_unlock(&g_watch.lock);
+        if (!on) break;
+
+        struct pollfd pf[2] = { { g_watch.ifd, POLLIN, 0 }, { g_watch.wake, POLLIN, 0 } };
+        if (poll(pf, 2, -1) < 0) continue;
+        if (pf[1].revents) {
+            uint64_t n;
+            if (read(g_watch.wake, &n, sizeof(n)) < 0) { /* drained */ }
+        }
+        if (!pf[0].revents) continue;
+
+        // Drain events, then wait until the writer has been quiet for
+        // 100 ms so a file written in several steps is read once
+        int changed = 0;
+        do {
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t r = read(g_watch.ifd, buf, sizeof(buf));
+            for (char *p = buf; r > 0 && p < buf + r; ) {
+                struct inotify_event *ev = (struct inotify_event *)p;
+                if (ev->wd == wd && ev->len && strcmp(ev->name, name) == 0) changed = 1;
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        } while (poll(pf, 1, 100) > 0);
+        if (changed) watch_reload(path);
+    }
+    if (wd >= 0) inotify_rm_watch(g_watch.ifd, wd);
+    return NULL;
+}
+
+// WATCH ON | OFF (admins). The watcher is shared by every session, so
+// one switch runs at a time under g_watch.control. It is not the writer
+// lock: WATCH OFF joins a thread that may be waiting for that lock.
+void cmd_watch(const char *args) {
+    if (g_replica.on) {
+        cms_printf("CMS: A replica follows its primary; WATCH is not available.\n");
+        return;
+    }
+    pthread_mutex_lock(&g_watch.control);
+    pthread_mutex_lock(&g_watch.lock);
+    int was_on = g_watch.on;
+    pthread_mutex_unlock(&g_watch.lock);
+
+    int want_on = equals_ic(args, "ON");
+    if (!want_on && !equals_ic(args, "OFF")) {
+        cms_printf("CMS: Use WATCH ON or WATCH OFF (watch is %s).\n", was_on ? "on" : "off");
+    } else if (want_on && was_on) {
+        cms_printf("CMS: Watch is already on.\n");
+    } else if (want_on && t_tab->filename[0] == '\0') {
+        cms_printf("CMS: No file opened.\n");
+    } else if (want_on) {
+        int ifd = inotify_init1(IN_CLOEXEC);
+        int wake = eventfd(0, EFD_CLOEXEC);
+        pthread_mutex_lock(&g_watch.lock);
+        if (!g_watch.base) g_watch.base = malloc(MAX_STUDENTS * sizeof(Student));
+        int ok = g_watch.base && ifd >= 0 && wake >= 0;
+        if (ok) {
+            // The base is the file as it is now: edits made since the last
+            // OPEN/SAVE become conflicts instead of being overwritten
+            g_watch.nbase = read_file_rows(t_tab->filename, g_watch.base);
+            if (g_watch.nbase < 0) g_watch.nbase = 0;
+            qsort(g_watch.base, (size_t)g_watch.nbase, sizeof(Student), cmp_student_id);
+            memcpy(g_watch.filename, t_tab->filename, sizeof(g_watch.filename));
+            g_watch.ifd = ifd;
+            g_watch.wake = wake;
+            g_watch.on = 1;
+            ok = pthread_create(&g_watch.thread, NULL, watch_main, NULL) == 0;
+            if (!ok) g_watch.on = 0;
+        }
+        pthread_mutex_unlock(&g_watch.lock);
+        if (ok) {
+            cms_printf("CMS: Watching \"%s\" for changes made by other programs.\n", t_tab->filename);
         } else {
-            printf("No change detected for Programme.\n");
+            if (ifd >= 0) close(ifd);
+            if (wake >= 0) close(wake);
+            g_watch.ifd = g_watch.wake = -1;
+            cms_printf("CMS: Cannot start watching files.\n");
         }
+    } else if (!was_on) {
+        cms_printf("CMS: Watch is already off.\n");
+    } else {
+        pthread_mutex_lock(&g_watch.lock);
+        g_watch.on = 0;
+        g_watch.filename[0] = '\0';
+        pthread_mutex_unlock(&g_watch.lock);
+        uint64_t one = 1;
+        if (write(g_watch.wake, &one, sizeof(one)) < 0) { /* thread sees on = 0 */ }
+        pthread_join(g_watch.thread, NULL);
+        close(g_watch.ifd);
+        close(g_watch.wake);
+        g_watch.ifd = g_watch.wake = -1;
+        cms_printf("CMS: Watch is off.\n");
     }
+    pthread_mutex_unlock(&g_watch.control);
+}
 
-    /* ===========================
-       UPDATE MARK
-       =========================== */
-    if (prompt_yes_no("Do you want to update the Mark?")) {
+#else
 
-        while (1) {
-            char buf[64];
-            printf("Enter new Mark (current: %.1f): ", updated.mark);
+void watch_rebase(void) {
+}
 
-            if (!fgets(buf, sizeof(buf), stdin)) continue;
-            rstrip(buf);
-            trim(buf);
+void watch_switch(void) {
+}
 
-            if (buf[0] == '\0') {
-                printf("Mark cannot be empty.\n");
-                continue;
-            }
+void cmd_watch(const char *args) {
+    (void)args;
+    cms_printf("CMS: WATCH is only available on Linux.\n");
+}
 
-            char *end;
-            float v = strtof(buf, &end);
+#endif
+
+/* ---------- COMMAND DISPATCH ---------- */
+// Execute one command line against t_tab for the current role (g_is_admin).
+// Returns 0 when the user asked to EXIT, 1 otherwise.
+int dispatch_command(const char *line) {
+    char cmd[64];
+    int i = 0;
+    const char *p = line;
+
+    // Move p to first non-space char (start of command)
+    while (*p && isspace((unsigned char)*p)) p++;
+    // Copy command word into cmd
+    while (*p && !isspace((unsigned char)*p) && i < 63)
+        cmd[i++] = *p++;
+    cmd[i] = 0;
+    // p now points to arguments part
+    while (*p && isspace((unsigned char)*p)) p++;
+
+    // Command processing
+    if (equals_ic(cmd, "EXIT")) return 0;
+    else if (equals_ic(cmd, "HELP")) {
+        if (g_is_admin)
+            show_help();           // admin gets full help
+        else
+            show_help_student();   // student gets restricted help
+    }
+    else if (equals_ic(cmd, "STATS")) {
+        cmd_stats();
+    }
+    else if (equals_ic(cmd, "OPEN")) {
+        if (g_is_admin) {
+            cmd_open(p);
+        } else {
+            cms_printf("Students cannot open database files (auto-loaded at login).\n");
+        }
+    }
+    else if (equals_ic(cmd, "MERGE")) {
+        if (g_is_admin) {
+            cmd_merge(p);
+        } else {
+            cms_printf("You do not have permission to merge database files.\n");
+        }
+    }
+    else if (equals_ic(cmd, "DIFF")) {
+        if (g_is_admin) {
+            cmd_diff(p);
+        } else {
+            cms_printf("You do not have permission to compare database files.\n");
+        }
+    }
+    else if (equals_ic(cmd, "EXPORT")) {
+        if (g_is_admin) {
+            cmd_export(p);
+        } else {
+            cms_printf("You do not have permission to export records.\n");
+        }
+    }
+    else if (equals_ic(cmd, "CDC")) {
+        if (g_is_admin) {
+            cmd_cdc(p);
+        } else {
+            cms_printf("You do not have permission to change the change log.\n");
+        }
+    }
+    else if (equals_ic(cmd, "FIND")) {
+        cmd_find(p);
+    }
+    else if (equals_ic(cmd, "USE")) {
+        if (g_is_admin) {
+            cmd_use(p);
+        } else {
+            cms_printf("Students cannot switch tables.\n");
+        }
+    }
+    else if (equals_ic(cmd, "SHOW")) {
+        if (*p == '\0') {
+            cms_printf("CMS: Use SHOW ALL, SHOW SUMMARY or SHOW TABLES.\n");
+        } else {
+            // Handle SHOW commands (ALL / SUMMARY)
+            char first[16];
+            int fi = 0;
+            const char *q = p;
+
+            while (*q && !isspace((unsigned char)*q) && fi < (int)sizeof(first) - 1) {
+                first[fi++] = *q++;
+            }
+            first[fi] = '\0';
+            while (*q && isspace((unsigned char)*q)) q++;
+
+            if (equals_ic(first, "ALL")) {
+                cmd_show_all(q);
+            } else if (equals_ic(first, "SUMMARY")) {
+                cmd_show_summary();
+            } else if (equals_ic(first, "TABLES")) {
+                cmd_show_tables();
+            } else {
+                cms_printf("CMS: Use SHOW ALL, SHOW SUMMARY or SHOW TABLES.\n");
+            }
+        }
+    }
+    else if (equals_ic(cmd, "INSERT")) {
+        if (g_is_admin) {
+            cmd_insert(p); // Only admins can insert records
+        } else {
+            cms_printf("You do not have permission to insert records.\n"); // Students cannot insert
+        }
+    }
+    else if (equals_ic(cmd, "DELETE")) {
+        if (g_is_admin) {
+            cmd_delete(p); // Only admins can delete records
+        } else {
+            cms_printf("You do not have permission to delete records.\n"); // Students cannot delete
+        }
+    }
+    else if (equals_ic(cmd, "UNDO")) {
+        if (g_is_admin) {
+            cmd_undo(); // Only admins can undo actions
+        } else {
+            cms_printf("You do not have permission to undo actions.\n"); // Students cannot undo
+        }
+    }
+    else if (equals_ic(cmd, "SAVE")) {
+        if (g_is_admin) {
+            cmd_save(p); // Only admins can save changes
+        } else {
+            cms_printf("You do not have permission to save changes.\n"); // Students cannot save
+        }
+    }
+    else if (equals_ic(cmd, "AUTOSAVE")) {
+        if (g_is_admin) {
+            cmd_autosave(p);
+        } else {
+            cms_printf("You do not have permission to save changes.\n");
+        }
+    }
+    else if (equals_ic(cmd, "QUERY")) {
+        cmd_query(p); // Both admin and student can query
+    }
+    else if (equals_ic(cmd, "SNAPSHOT")) {
+        cmd_snapshot(); // Both admin and student can pin a snapshot
+    }
+    else if (equals_ic(cmd, "RELEASE")) {
+        cmd_release();
+    }
+    else if (equals_ic(cmd, "SET")) {
+        if (g_is_admin) {
+            cmd_set(p);
+        } else {
+            cms_printf("You do not have permission to change settings.\n");
+        }
+    }
+    else if (equals_ic(cmd, "ARCHIVE")) {
+        cmd_archive(p);   // Both roles may read; only admins change it
+    }
+    else if (equals_ic(cmd, "WATCH")) {
+        if (g_is_admin) {
+            cmd_watch(p);   // Only admins: the watcher is shared by every session
+        } else {
+            cms_printf("You do not have permission to watch files.\n");
+        }
+    }
+    else if (equals_ic(cmd, "UPDATE")) {
+        if (g_is_admin) {
+            cmd_update(p);  // Only admins can update records
+        } else {
+            cms_printf("You do not have permission to update records.\n");  // Students cannot update
+        }
+    }
+    else {
+        cms_printf("CMS: Unknown command or insufficient permissions.\n");
+    }
+    return 1;
+}
 
-            if (*end != '\0' || v < 0 || v > 100) {
-                printf("Invalid mark. Must be 0-100.\n");
-                continue;
-            }
+// Does this command change the table? (an admin's SHOW ALL SORT BY reorders it)
+int command_writes(const char *line) {
+    char w1[16] = "", w2[16] = "", w3[16] = "";
+    sscanf(line, "%15s %15s %15s", w1, w2, w3);
 
-            v = roundf(v * 10.0f) / 10.0f; // 1dp rounding
+    if (equals_ic(w1, "SHOW"))
+        return g_is_admin && equals_ic(w2, "ALL") && equals_ic(w3, "SORT");
+    if (!g_is_admin) return 0;   // students are refused before touching data
+    return equals_ic(w1, "OPEN") || equals_ic(w1, "INSERT") || equals_ic(w1, "UPDATE") ||
+           equals_ic(w1, "DELETE") || equals_ic(w1, "UNDO") || equals_ic(w1, "USE");
+}
 
-            if (v != updated.mark) {
-                updated.mark = v;
-                changed = 1;
-            } else {
-                printf("No change detected for Mark.\n");
-            }
-            break;
-        }
+// Run one command line: readers pin the current table version, writers
+// take the writer lock and publish their copy when done.
+// Returns 0 when the user asked to EXIT, 1 otherwise.
+int run_command(const char *line) {
+    int keep_going;
+    char w1[16] = "";
+    sscanf(line, "%15s", w1);
+    if (!equals_ic(w1, "HELP") && !equals_ic(w1, "EXIT"))
+        prefetch_finish(1, 1);   // the command needs the table: wait for the load
+    if (command_writes(line)) {
+        if (!table_write_begin()) return 1;
+        keep_going = dispatch_command(line);
+        table_write_end();
+    } else {
+        table_read_begin();
+        keep_going = dispatch_command(line);
+        table_read_end();
     }
+    return keep_going;
+}
 
-    /* ===========================
-       NO CHANGES?
-       =========================== */
-    if (!changed) {
-        printf("\nCMS: No changes made. Update cancelled.\n");
-        return;
+// Show the help menu that matches the current role
+void show_role_help(void) {
+    if (g_is_admin) {
+        show_help();           // admin gets full help
+    } else {
+        show_help_student();   // student gets restricted help
     }
+}
 
-    /* ===========================
-       APPLY UPDATE + UNDO
-       =========================== */
-    *s = updated; // commit changes to actual record
+/* ---------- SERVER MODE (cms --serve <socket>) ---------- */
+// One process owns the table and serves many client sessions over a
+// Unix domain socket. A single epoll loop does all socket I/O and the
+// login conversation; complete command lines are handed to a pool of
+// worker threads, so read-only commands from many sessions run in
+// parallel on pinned table versions while a writer publishes new ones.
+// Each session has at most one command in flight, which keeps its output
+// in order. Prompts inside a command (e.g. Y/N confirmations) read the
+// lines the client already sent after the command; if none are waiting
+// the prompt sees end of input and the operation is cancelled.
+#ifdef __linux__
+
+#define SERVER_MAX_EVENTS 64
+#define SESSION_MAX_INPUT (1 << 20)   // drop clients that send 1 MB without a newline
+#define SERVER_MAX_WORKERS 64
+
+// Session login states
+#define SESS_USER  0   // waiting for username
+#define SESS_PASS  1   // waiting for password
+#define SESS_READY 2   // logged in, accepting commands
+
+typedef struct Session {
+    int    fd;
+    int    state;        // SESS_*
+    int    is_admin;     // role chosen at login
+    int    attempts;     // password attempts left (same rule as login())
+    char   username[64];
+    char  *in;           // bytes received but not yet processed
+    size_t in_len, in_cap;
+    char  *out;          // bytes waiting to be written
+    size_t out_len, out_cap, out_off;
+    int    busy;         // a command is running on a worker
+    int    eof;          // client has finished sending
+    int    closing;      // close once the output has drained
+    int    dead;         // socket already closed; free when the worker is done
+    TableVersion *snapshot;  // version pinned by this session's SNAPSHOT
+    struct Session *reap_next;  // next closed session on g_reap
+} Session;
+
+// Sessions closed during the current epoll batch. A later event of the
+// same batch may still point at one, so they are freed after the batch.
+Session *g_reap;
+
+// One command handed to a worker thread
+typedef struct Job {
+    Session *s;
+    char     line[LINE_MAX_LEN];
+    char    *input;        // complete lines after the command (prompt answers)
+    size_t   input_len;
+    int      is_admin;
+    TableVersion *snapshot;  // session snapshot in, updated snapshot out
+    char    *out;          // captured output
+    size_t   out_len;
+    size_t   consumed;     // prompt answer bytes used by the command
+    int      exit;         // the command was EXIT
+    struct Job *next;
+} Job;
+
+// Queue between the event loop and the workers
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+    Job *todo_head, *todo_tail;   // waiting for a worker
+    Job *done;                    // finished, waiting for the event loop
+    int  wake_fd;                 // eventfd that wakes the event loop
+    int  stop;
+} WorkQueue;
+
+WorkQueue g_work = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, NULL, -1, 0 };
+
+volatile sig_atomic_t g_server_stop = 0;
+
+// SIGINT / SIGTERM handler: ask the event loop to finish
+void server_on_signal(int sig) {
+    (void)sig;
+    g_server_stop = 1;
+}
 
-    // Store old and new versions for undo
-    push_undo('U', old, *s);
+// Append raw bytes to a growable buffer
+int buf_append(char **buf, size_t *len, size_t *cap, const char *data, size_t n) {
+    if (*len + n > *cap) {
+        size_t ncap = *cap ? *cap : 4096;
+        while (ncap < *len + n) ncap *= 2;
+        char *nb = realloc(*buf, ncap);
+        if (!nb) return 0;
+        *buf = nb;
+        *cap = ncap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    return 1;
+}
 
-    printf("\nCMS: Record updated successfully.\n");
-    printf("Remember to type SAVE to save your changes.\n");
+// Queue text for a session
+void session_send(Session *s, const char *text, size_t n) {
+    buf_append(&s->out, &s->out_len, &s->out_cap, text, n);
+}
 
-    /* ===========================
-       SHOW UPDATED RECORD
-       =========================== */
-    printf("Updated Record:\n");
-    printf("ID       : %d\n", s->id);
-    printf("Name     : %s\n", s->name);
-    printf("Programme: %s\n", s->programme);
-    printf("Mark     : %.1f\n", s->mark);
+// Write as much pending output as the socket accepts; returns 0 on error
+int session_flush(Session *s) {
+    while (s->out_off < s->out_len) {
+        ssize_t w = send(s->fd, s->out + s->out_off, s->out_len - s->out_off, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        s->out_off += (size_t)w;
+    }
+    s->out_len = s->out_off = 0;
+    return 1;
 }
 
+// Run one step of the login conversation (same messages as login())
+void session_login_line(Session *s, const char *line) {
+    char buf[64];
+    strncpy(buf, line, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    trim(buf);
 
-/* ---------- DELETE ---------- */
-// DELETE command: remove a record by ID, with double confirmation
-void cmd_delete(const char *args) {
-    // Check if user wants to exit at the start of the function
-    if (check_exit(args)) {
-        printf("Exiting delete operation.\n");
-        return;  // Exit the delete operation immediately
+    if (s->state == SESS_USER) {
+        if (!equals_ic(buf, ADMIN_USERNAME) && !equals_ic(buf, STUDENT_USERNAME)) {
+            cms_printf("Invalid username. Please enter a valid username.\nEnter username: ");
+            return;
+        }
+        if (g_replica.on && equals_ic(buf, ADMIN_USERNAME)) {
+            cms_printf("CMS: This is a read-only replica; log in as %s.\nEnter username: ",
+                       STUDENT_USERNAME);
+            return;
+        }
+        memcpy(s->username, buf, sizeof(s->username));
+        s->state = SESS_PASS;
+        cms_printf("Enter password: ");
+        return;
     }
 
-    if (g_open_filename[0] == '\0') {
-        printf("CMS: No file opened.\n");
+    int admin = equals_ic(s->username, ADMIN_USERNAME);
+    if (equals_ic(buf, admin ? ADMIN_PASSWORD : STUDENT_PASSWORD)) {
+        s->is_admin = admin;
+        s->state = SESS_READY;
+        g_is_admin = admin;
+        print_declaration();
+        show_role_help();
+        cms_printf("> ");
         return;
     }
 
-    // Prompt user for student ID to delete
-    int id = prompt_student_id();
-    if (id < 0) {
-        printf("Exiting delete operation.\n");
+    cms_printf("Invalid %s password. Try again.\n", admin ? "admin" : "student");
+    s->attempts--;
+    cms_printf("You have %d attempt(s) left.\n", s->attempts);
+    if (s->attempts == 0) {
+        cms_printf("Maximum login attempts reached. Access to the system has been temporarily locked. Please try again later or contact support.\n");
+        s->closing = 1;
         return;
     }
+    s->state = SESS_USER;
+    cms_printf("Enter username: ");
+}
 
-    
-    // If the user enters "quit", exit the delete operation immediately
-    if (check_exit(args)) {
-        printf("Exiting delete operation.\n");
-        return;  // Exit the delete operation immediately
+// Run one job on the calling worker thread
+void server_run_job(Job *job) {
+    t_out = open_memstream(&job->out, &job->out_len);
+    if (!t_out) return;
+
+    static char empty[1];
+    t_in = fmemopen(job->input_len ? job->input : empty,
+                    job->input_len ? job->input_len : 1, "r");
+    if (t_in && !job->input_len) fgetc(t_in);   // no answers waiting
+
+    g_is_admin = job->is_admin;
+    t_snapshot = job->snapshot;
+    job->exit = !run_command(job->line);
+    if (!job->exit) cms_printf("> ");
+    job->snapshot = t_snapshot;
+    t_snapshot = NULL;
+
+    if (t_in) {
+        long used = ftell(t_in);
+        if (job->input_len && used > 0) job->consumed = (size_t)used;
+        fclose(t_in);
+        t_in = NULL;
     }
+    fclose(t_out);
+    t_out = NULL;
+}
 
-    // Find the record by ID
-    int idx = find_index_by_id(id);
+// Worker thread: take jobs, run them, hand them back to the event loop
+void *server_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&g_work.lock);
+        while (!g_work.todo_head && !g_work.stop)
+            pthread_cond_wait(&g_work.ready, &g_work.lock);
+        if (g_work.stop) {
+            pthread_mutex_unlock(&g_work.lock);
+            return NULL;
+        }
+        Job *job = g_work.todo_head;
+        g_work.todo_head = job->next;
+        if (!g_work.todo_head) g_work.todo_tail = NULL;
+        pthread_mutex_unlock(&g_work.lock);
 
-    if (idx < 0) {
-        printf("CMS: No record found.\n");
-        return;  // Exit if no record found 
-    }
+        server_run_job(job);
 
-    // First confirmation prompt
-    if (!prompt_yes_no("Are you sure you want to delete this record?")) {
-        printf("Delete cancelled.\n");
-        return;
-    }
+        pthread_mutex_lock(&g_work.lock);
+        job->next = g_work.done;
+        g_work.done = job;
+        pthread_mutex_unlock(&g_work.lock);
 
-    // Second confirmation prompt (extra safety)
-    if (!prompt_yes_no("Confirm again")) {
-        printf("Delete cancelled.\n");
-        return;
+        uint64_t one = 1;
+        if (write(g_work.wake_fd, &one, sizeof(one)) < 0) { /* loop is woken anyway */ }
     }
+}
 
-    // Perform delete operation
-    Student removed = g_students[idx];
-    push_undo('D', removed, removed);   // Store the deletion in the undo stack
-
-    // Shift all records after the deleted one left by one position
-    for (int i = idx; i < g_count - 1; i++) {
-        g_students[i] = g_students[i + 1];
+// Hand one command line to the worker pool
+int session_dispatch(Session *s, const char *line) {
+    Job *job = calloc(1, sizeof(Job));
+    if (!job) return 0;
+
+    job->s = s;
+    job->is_admin = s->is_admin;
+    job->snapshot = s->snapshot;
+    strncpy(job->line, line, sizeof(job->line) - 1);
+
+    // Copy the complete lines that follow, for prompts to read
+    char *last_nl = s->in_len ? memrchr(s->in, '\n', s->in_len) : NULL;
+    size_t usable = last_nl ? (size_t)(last_nl - s->in) + 1 : 0;
+    if (usable) {
+        job->input = malloc(usable);
+        if (!job->input) { free(job); return 0; }
+        memcpy(job->input, s->in, usable);
+        job->input_len = usable;
     }
-    g_count--;
 
-    printf("CMS: Record deleted.\n");
-    printf("Remember to type SAVE to save your changes.\n");
+    s->busy = 1;
+    pthread_mutex_lock(&g_work.lock);
+    if (g_work.todo_tail) g_work.todo_tail->next = job;
+    else g_work.todo_head = job;
+    g_work.todo_tail = job;
+    pthread_cond_signal(&g_work.ready);
+    pthread_mutex_unlock(&g_work.lock);
+    return 1;
 }
 
-/* ---------- SAVE ---------- */
-// SAVE command: write in-memory data to the currently opened file
-void cmd_save(void){
-    if(g_open_filename[0]=='\0'){
-        printf("CMS: No file opened.\n");
-        return;
+// Process complete lines until a command is handed to a worker
+void session_process(Session *s) {
+    while (!s->closing && !s->busy) {
+        char *nl = memchr(s->in, '\n', s->in_len);
+        if (!nl) break;
+
+        char line[LINE_MAX_LEN];
+        size_t n = (size_t)(nl - s->in);
+        size_t keep = n < sizeof(line) - 1 ? n : sizeof(line) - 1;
+        memcpy(line, s->in, keep);
+        line[keep] = '\0';
+        rstrip(line);
+        memmove(s->in, s->in + n + 1, s->in_len - n - 1);
+        s->in_len -= n + 1;
+
+        if (s->state == SESS_READY && line[0] != '\0') {
+            if (!session_dispatch(s, line)) s->closing = 1;
+            break;
+        }
+
+        // Login steps and empty lines are answered on the loop thread
+        char *obuf = NULL;
+        size_t olen = 0;
+        t_out = open_memstream(&obuf, &olen);
+        if (!t_out) { s->closing = 1; break; }
+        if (s->state != SESS_READY) session_login_line(s, line);
+        else cms_printf("> ");
+        fclose(t_out);
+        t_out = NULL;
+        session_send(s, obuf, olen);
+        free(obuf);
     }
-    if(save_to_file(g_open_filename))
-        printf("CMS: Saved.\n");
-    else
-        printf("CMS: Save failed.\n");
+
+    // Nothing more will arrive and nothing is running: finish the session
+    if (s->eof && !s->busy) s->closing = 1;
 }
 
-/* ---------- UNDO ---------- */
-// UNDO command: revert the last INSERT/UPDATE/DELETE if possible
-void cmd_undo(void) {
-    if (g_undo_count == 0) {
-        printf("CMS: No actions to undo.\n");
-        return;
+// Create, bind and listen on the Unix socket; returns the fd or -1
+int server_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "CMS: Socket path too long.\n");
+        return -1;
     }
 
-    // Take the last action from the undo stack
-    UndoEntry last = g_undo[g_undo_count - 1];
-    g_undo_count--;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { perror("socket"); return -1; }
 
-    // Display the most recent amendment in a clear, professional format
-    printf("\n--------------------------------------------------\n");
-    printf("   MOST RECENT AMENDMENT DETAILS\n");
-    printf("--------------------------------------------------\n");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);   // remove a stale socket from an earlier run
 
-    if (last.op == 'I') {
-        // INSERT operation
-        printf("Operation:  Insert\n");
-        printf("Student ID: %d\n", last.after.id);
-        printf("Name:       %s\n", last.after.name);
-        printf("Programme:  %s\n", last.after.programme);
-        printf("Mark:       %.1f\n", last.after.mark);
-    } else if (last.op == 'U') {
-        // UPDATE operation
-        printf("Operation:  Update\n");
-        printf("Student ID: %d\n", last.before.id);
-        printf("Name:       %s -> %s\n", last.before.name, last.after.name);
-        printf("Programme:  %s -> %s\n", last.before.programme, last.after.programme);
-        printf("Mark:       %.1f -> %.1f\n", last.before.mark, last.after.mark);
-    } else if (last.op == 'D') {
-        // DELETE operation
-        printf("Operation:  Delete\n");
-        printf("Student ID: %d\n", last.before.id);
-        printf("Name:       %s\n", last.before.name);
-        printf("Programme:  %s\n", last.before.programme);
-        printf("Mark:       %.1f\n", last.before.mark);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    printf("--------------------------------------------------\n");
+// Release a session's snapshot and buffers
+void session_free(Session *s) {
+    if (s->snapshot) atomic_fetch_sub(&s->snapshot->pins, 1);
+    free(s->in);
+    free(s->out);
+    free(s);
+}
 
-    // Ask for confirmation before actually undoing
-    if (prompt_yes_no("Do you want to undo this action?")) {
-        if (last.op == 'I') {
-            // Undo INSERT → remove inserted student
-            int idx = find_index_by_id(last.after.id);
-            if (idx >= 0) {
-                for (int i = idx; i < g_count - 1; i++)
-                    g_students[i] = g_students[i + 1];
-                g_count--;
-            }
-            printf("CMS: Undo successful (INSERT undone).\n");
-        } else if (last.op == 'D') {
-            // Undo DELETE → restore deleted student
-            if (g_count < MAX_STUDENTS) {
-                g_students[g_count++] = last.before;
-                printf("CMS: Undo successful (DELETE undone).\n");
-            } else {
-                printf("CMS: Undo failed (storage full).\n");
-            }
-        } else if (last.op == 'U') {
-            // Undo UPDATE → revert back to old state
-            int idx = find_index_by_id(last.after.id);
-            if (idx >= 0) {
-                g_students[idx] = last.before;
-                printf("CMS: Undo successful (UPDATE undone).\n");
-            } else {
-                printf("CMS: Undo failed (record not found).\n");
-            }
-        }
-        printf("Remember to type SAVE to save your changes.\n");
-    } else {
-        printf("Undo cancelled.\n");
-    }
+// Free a closed session once the current epoll batch is done
+void session_reap(Session *s) {
+    s->reap_next = g_reap;
+    g_reap = s;
 }
 
-// SHOW SUMMARY: display basic statistics about the marks
-void cmd_show_summary(void) {
-    if (g_count == 0) {
-        printf("CMS: No records loaded.\n");
+// Close a session's socket; the struct is freed after this batch or, if
+// a command is running, after its job ends
+void session_close(int epfd, Session *s) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    s->dead = 1;
+    if (!s->busy) session_reap(s);
+}
+
+// Flush a session and either close it or update its epoll interest
+void session_update(int epfd, Session *s, int dead) {
+    if (!dead && !session_flush(s)) dead = 1;
+
+    if (dead || (s->closing && !s->busy && s->out_len == 0)) {
+        session_close(epfd, s);
         return;
     }
 
-    int count = g_count;
+    // Wait for writability only while output is queued
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (s->eof ? 0 : EPOLLIN | EPOLLRDHUP) | (s->out_len ? EPOLLOUT : 0);
+    ev.data.ptr = s;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+}
 
-    float sum = 0.0f;
-    int idx_max = 0;   // index of the highest mark
-    int idx_min = 0;   // index of the lowest mark
-    float max_mark = g_students[0].mark;
-    float min_mark = g_students[0].mark;
+// Collect finished jobs and continue their sessions
+void server_collect(int epfd) {
+    uint64_t cnt;
+    if (read(g_work.wake_fd, &cnt, sizeof(cnt)) < 0) { /* nothing pending */ }
+
+    pthread_mutex_lock(&g_work.lock);
+    Job *done = g_work.done;
+    g_work.done = NULL;
+    pthread_mutex_unlock(&g_work.lock);
+
+    while (done) {
+        Job *job = done;
+        done = job->next;
+        Session *s = job->s;
+        s->busy = 0;
+        s->snapshot = job->snapshot;
+
+        if (s->dead) {
+            session_reap(s);
+        } else {
+            session_send(s, job->out, job->out_len);
+            memmove(s->in, s->in + job->consumed, s->in_len - job->consumed);
+            s->in_len -= job->consumed;
+            if (job->exit) s->closing = 1;
+            session_process(s);
+            session_update(epfd, s, 0);
+        }
+        free(job->input);
+        free(job->out);
+        free(job);
+    }
+}
 
-    // Arrays to store students with the same highest or lowest mark
-    int max_students[MAX_STUDENTS];
-    int min_students[MAX_STUDENTS];
-    int max_count = 0, min_count = 0;
+// Serve the loaded table on a Unix socket until SIGINT/SIGTERM
+int run_server(const char *path) {
+    int lfd = server_listen(path);
+    if (lfd < 0) return 1;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    g_work.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || g_work.wake_fd < 0) { perror("epoll/eventfd"); close(lfd); return 1; }
+
+    // Listening socket and wake-up fd are told apart by their data.ptr
+    static int listen_tag, wake_tag;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listen_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+    ev.data.ptr = &wake_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, g_work.wake_fd, &ev);
+
+    // One worker per online CPU
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nworkers = ncpu < 1 ? 1 : ncpu > SERVER_MAX_WORKERS ? SERVER_MAX_WORKERS : (int)ncpu;
+    pthread_t workers[SERVER_MAX_WORKERS];
+    for (int w = 0; w < nworkers; w++)
+        pthread_create(&workers[w], NULL, server_worker, NULL);
+
+    signal(SIGINT, server_on_signal);
+    signal(SIGTERM, server_on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    table_read_begin();   // a replica may already be publishing versions
+    printf("CMS: Serving \"%s\" (%d records) on %s with %d worker thread(s)\n",
+           t_tab->filename, t_tab->count, path, nworkers);
+    table_read_end();
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!g_server_stop) {
+        int n = epoll_wait(epfd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
 
+        for (int e = 0; e < n; e++) {
+            if (events[e].data.ptr == &wake_tag) {
+                server_collect(epfd);
+                continue;
+            }
 
-    // loop through all records to find sum, min, max
-    for (int i = 0; i < count; i++) {
-        float mark = g_students[i].mark;
-        sum += mark;
+            // New connections
+            if (events[e].data.ptr == &listen_tag) {
+                int cfd;
+                while ((cfd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Session *ns = calloc(1, sizeof(Session));
+                    if (!ns) { close(cfd); continue; }
+                    ns->fd = cfd;
+                    ns->attempts = 5;
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.ptr = ns;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &ev);
+                    session_send(ns, "Enter username: ", 16);
+                    session_flush(ns);
+                }
+                continue;
+            }
+
+            Session *s = events[e].data.ptr;
+            if (s->dead) continue;   // closed earlier in this batch
+            int dead = (events[e].events & (EPOLLERR | EPOLLHUP)) != 0;
+
+            // Read everything available, then run complete lines
+            if (!dead && !s->eof && (events[e].events & (EPOLLIN | EPOLLRDHUP))) {
+                char chunk[1024];
+                while (1) {
+                    ssize_t r = recv(s->fd, chunk, sizeof(chunk), 0);
+                    if (r > 0) {
+                        if (s->in_len + (size_t)r > SESSION_MAX_INPUT ||
+                            !buf_append(&s->in, &s->in_len, &s->in_cap, chunk, (size_t)r)) {
+                            dead = 1;
+                            break;
+                        }
+                        continue;
+                    }
+                    if (r == 0) { s->eof = 1; break; }   // client finished sending
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) dead = 1;
+                    break;
+                }
+                if (!dead) session_process(s);
+            }
 
-        // Check for highest mark
-        if (mark > max_mark) {
-            max_mark = mark;
-            max_count = 0;  // reset the counter for students with max mark
-            max_students[max_count++] = i;
-        } else if (mark == max_mark) {
-            // If another student has the same highest mark, add them to the array
-            max_students[max_count++] = i;
+            session_update(epfd, s, dead);
         }
 
-        // Check for lowest mark
-        if (mark < min_mark) {
-            min_mark = mark;
-            min_count = 0;  // reset the counter for students with min mark
-            min_students[min_count++] = i;
-        } else if (mark == min_mark) {
-            // If another student has the same lowest mark, add them to the array
-            min_students[min_count++] = i;
+        // No event of this batch refers to the closed sessions any more
+        while (g_reap) {
+            Session *s = g_reap;
+            g_reap = s->reap_next;
+            session_free(s);
         }
     }
 
-    float average = sum / count;
-
-    // Display the highest and lowest marks along with student names
-    printf("CMS SUMMARY\n");
-    printf("-----------\n");
-    printf("Total number of students : %d\n", count);
-    printf("Average mark             : %.2f\n", average);
-    printf("Highest mark             : %.1f\n", max_mark);
-    printf("Lowest mark              : %.1f\n", min_mark);
+    // Stop the workers (running commands finish first)
+    pthread_mutex_lock(&g_work.lock);
+    g_work.stop = 1;
+    pthread_cond_broadcast(&g_work.ready);
+    pthread_mutex_unlock(&g_work.lock);
+    for (int w = 0; w < nworkers; w++)
+        pthread_join(workers[w], NULL);
+    save_wait();
+
+    close(g_work.wake_fd);
+    close(epfd);
+    close(lfd);
+    unlink(path);
+    printf("CMS: Server stopped.\n");
+    return 0;
+}
 
-    // Show highest mark details
-    printf("Student(s) with highest mark:\n");
-    for (int i = 0; i < max_count; i++) {
-        int idx = max_students[i];
-        printf("  ID: %d, Name: %s, Mark: %.1f\n", g_students[idx].id, g_students[idx].name, g_students[idx].mark);
+// Simple client: relay stdin to the server and print its replies
+int run_client(const char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "CMS: Cannot create socket.\n");
+        return 1;
     }
-    
-    // Show lowest mark details
-    printf("\nStudent(s) with lowest mark:\n");
-    for (int i = 0; i < min_count; i++) {
-        int idx = min_students[i];
-        printf("  ID: %d, Name: %s, Mark: %.1f\n", g_students[idx].id, g_students[idx].name, g_students[idx].mark);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return 1;
+    }
+
+    struct pollfd pf[2] = { { STDIN_FILENO, POLLIN, 0 }, { fd, POLLIN, 0 } };
+    char buf[4096];
+    while (1) {
+        if (poll(pf, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pf[1].revents) {
+            ssize_t r = read(fd, buf, sizeof(buf));
+            if (r <= 0) break;   // server closed the session
+            fwrite(buf, 1, (size_t)r, stdout);
+            fflush(stdout);
+        }
+        if (pf[0].revents) {
+            ssize_t r = read(STDIN_FILENO, buf, sizeof(buf));
+            if (r <= 0) {
+                shutdown(fd, SHUT_WR);   // no more input; keep reading replies
+                pf[0].fd = -1;
+                continue;
+            }
+            if (write(fd, buf, (size_t)r) != r) break;
+        }
     }
+    close(fd);
+    return 0;
 }
 
+#else
 
-/* ---------- PRINT DECLARATION ---------- */
-// Print contents of declaration.txt (e.g. academic honesty / group info)
-void print_declaration(void){
-    FILE *fp=fopen("declaration.txt","r");
-    if(!fp){
-        printf("Error: declaration.txt not found.\n\n");
-        return;
-    }
-    char line[256];
-    while(fgets(line,sizeof(line),fp))
-        printf("%s",line);
-    fclose(fp);
-    printf("\n");
+int run_server(const char *path) {
+    (void)path;
+    fprintf(stderr, "CMS: Server mode is only available on Linux.\n");
+    return 1;
+}
+
+int run_client(const char *path) {
+    (void)path;
+    fprintf(stderr, "CMS: Client mode is only available on Linux.\n");
+    return 1;
 }
 
+#endif
+
 /* ---------- MAIN ---------- */
-int main(void) {
+int main(int argc, char **argv) {
+    // Server mode: cms --serve <socket> [file]
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s --serve <socket> [file]\n", argv[0]);
+            return 1;
+        }
+        const char *db = argc >= 4 ? argv[3] : DEFAULT_STUDENT_DB;
+        table_init();
+        if (!table_write_begin()) return 1;
+        if (!load_from_file(db))
+            printf("CMS: File \"%s\" not found — will create new on SAVE.\n", db);
+        strncpy(t_tab->filename, db, sizeof(t_tab->filename)-1);
+        t_tab->filename[sizeof(t_tab->filename)-1] = '\0';
+        table_write_end();
+        return run_server(argv[2]);
+    }
+    // Replica: cms --replica <primary CDC socket> <socket> [file]
+    if (argc >= 2 && strcmp(argv[1], "--replica") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s --replica <primary-cdc-socket> <socket> [file]\n", argv[0]);
+            return 1;
+        }
+        const char *db = argc >= 5 ? argv[4] : DEFAULT_STUDENT_DB;
+        table_init();
+        if (!table_write_begin()) return 1;
+        if (!load_from_file(db))
+            printf("CMS: File \"%s\" not found — starting empty.\n", db);
+        strncpy(t_tab->filename, db, sizeof(t_tab->filename)-1);
+        t_tab->filename[sizeof(t_tab->filename)-1] = '\0';
+        table_write_end();
+        if (!replica_start(argv[2], db)) return 1;
+        return run_server(argv[3]);
+    }
+    // Client mode: cms --connect <socket>
+    if (argc >= 2 && strcmp(argv[1], "--connect") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s --connect <socket>\n", argv[0]);
+            return 1;
+        }
+        return run_client(argv[2]);
+    }
+
+    // Start loading the default DB while the user logs in
+    table_init();
+    prefetch_start();
+
     // First, force user to log in (sets admin/student mode)
     if (!login()) return 0;  // If login fails, exit the program
 
+    // For student accounts the prefetch publishes the default DB; without
+    // one, auto-load it here
+    int prefetching = prefetch_set_role(g_is_admin);
+
     print_declaration();
 
-    // For student accounts, auto-load the default DB file
-    if (!g_is_admin) {
-        if (!load_from_file(DEFAULT_STUDENT_DB)) {
-            printf("CMS: Auto-load failed. Creating new DB on SAVE.\n");
+    if (!prefetching && !g_is_admin && table_write_begin()) {
+        if (load_snapshot(DEFAULT_STUDENT_DB)) {
+            // Shared snapshot written by the last admin SAVE: no parsing
+            cms_printf("CMS: P10_6-CMS loaded successfully (%d records).\n", t_tab->count);
+        } else if (!load_from_file(DEFAULT_STUDENT_DB)) {
+            cms_printf("CMS: Auto-load failed. Creating new DB on SAVE.\n");
         } else {
-            printf("CMS: P10_6-CMS loaded successfully (%d records).\n", g_count);
+            cms_printf("CMS: P10_6-CMS loaded successfully (%d records).\n", t_tab->count);
         }
-        strncpy(g_open_filename, DEFAULT_STUDENT_DB, sizeof(g_open_filename)-1);
-        g_open_filename[sizeof(g_open_filename)-1] = '\0';
+        strncpy(t_tab->filename, DEFAULT_STUDENT_DB, sizeof(t_tab->filename)-1);
+        t_tab->filename[sizeof(t_tab->filename)-1] = '\0';
+        table_write_end();
     }
 
     // Show appropriate help menu based on role
-    if (g_is_admin) {
-        show_help();           // admin gets full help
-    } else {
-        show_help_student();   // student gets restricted help
-    }
+    show_role_help();
 
     char line[LINE_MAX_LEN];
 
     // Main command loop
     while (1) {
-        printf("> ");
-        if (!fgets(line, sizeof(line), stdin)) break;
+        prefetch_finish(0, 1);   // show the load result as soon as it is ready
+        cms_printf("> ");
+        if (!cms_fgets(line, sizeof(line))) break;
         rstrip(line);
         if (line[0] == '\0') continue;   // ignore empty input
 
-        char cmd[64];
-        int i = 0;
-        const char *p = line;
-
-        // Move p to first non-space char (start of command)
-        while (*p && isspace((unsigned char)*p)) p++;
-        // Copy command word into cmd
-        while (*p && !isspace((unsigned char)*p) && i < 63)
-            cmd[i++] = *p++;
-        cmd[i] = 0;
-        // p now points to arguments part
-        while (*p && isspace((unsigned char)*p)) p++;
-
-        // Command processing
-        if (equals_ic(cmd, "EXIT")) break;
-        else if (equals_ic(cmd, "HELP")) {
-            if (g_is_admin)
-                show_help();           // admin gets full help
-            else
-                show_help_student();   // student gets restricted help
-        }
-        else if (equals_ic(cmd, "OPEN")) {
-            if (g_is_admin) {
-                cmd_open(p);
-            } else {
-                printf("Students cannot open database files (auto-loaded at login).\n");
-            }
-        }
-        else if (equals_ic(cmd, "SHOW")) {
-            if (*p == '\0') {
-                printf("CMS: Use SHOW ALL or SHOW SUMMARY.\n");
-            } else {
-                // Handle SHOW commands (ALL / SUMMARY)
-                char first[16];
-                int fi = 0;
-                const char *q = p;
-
-                while (*q && !isspace((unsigned char)*q) && fi < (int)sizeof(first) - 1) {
-                    first[fi++] = *q++;
-                }
-                first[fi] = '\0';
-                while (*q && isspace((unsigned char)*q)) q++;
-
-                if (equals_ic(first, "ALL")) {
-                    cmd_show_all(q);
-                } else if (equals_ic(first, "SUMMARY")) {
-                    cmd_show_summary();
-                } else {
-                    printf("CMS: Use SHOW ALL or SHOW SUMMARY.\n");
-                }
-            }
-        }
-        else if (equals_ic(cmd, "INSERT")) {
-            if (g_is_admin) {
-                cmd_insert(p); // Only admins can insert records
-            } else {
-                printf("You do not have permission to insert records.\n"); // Students cannot insert
-            }
-        }
-        else if (equals_ic(cmd, "DELETE")) {
-            if (g_is_admin) {
-                cmd_delete(p); // Only admins can delete records
-            } else {
-                printf("You do not have permission to delete records.\n"); // Students cannot delete
-            }
-        }
-        else if (equals_ic(cmd, "UNDO")) {
-            if (g_is_admin) {
-                cmd_undo(); // Only admins can undo actions
-            } else {
-                printf("You do not have permission to undo actions.\n"); // Students cannot undo
-            }
-        }
-        else if (equals_ic(cmd, "SAVE")) {
-            if (g_is_admin) {
-                cmd_save(); // Only admins can save changes
-            } else {
-                printf("You do not have permission to save changes.\n"); // Students cannot save
-            }
-        }
-        else if (equals_ic(cmd, "QUERY")) {
-            cmd_query(p); // Both admin and student can query
-        }
-        else if (equals_ic(cmd, "UPDATE")) {
-            if (g_is_admin) {
-                cmd_update(p);  // Only admins can update records
-            } else {
-                printf("You do not have permission to update records.\n");  // Students cannot update
-            }
-        }
-        else {
-            printf("CMS: Unknown command or insufficient permissions.\n");
-        }
+        if (!run_command(line)) break;
     }
 
+    prefetch_finish(1, 0);   // ended before any command needed the table
+    save_wait();             // don't lose a SAVE still being written
     return 0;
 }
-
-
-